@@ -0,0 +1,144 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Block placement
+// ===============================
+// The backend falls through to the block laid out next and branches to
+// the other target, so the order of fn.blocks decides which path of a
+// conditional branch is taken. Lowering lays out the then arm of an `if`
+// right after the test; inside a loop, a then arm that returns runs at
+// most once per call while the test runs every iteration:
+//
+//     while (...) {
+//         if (found) { return i; }   // branch over the return every time
+//         ...
+//     }
+//
+// Such cold blocks, ending in a return and entered only by conditional
+// branches from deeper in a loop nest that are not the loop's own test,
+// are moved to the end of the function, so the loop falls through to the
+// rest of its body and only leaving it takes the branch. The division
+// check's div_by_zero handler already lives out of line in the runtime.
+//
+// A profile (-fprofile-use) replaces the guesswork: starting from the
+// entry, each block is followed by its most often run successor not yet
+// placed, so the hot path of every branch falls through; when a chain
+// ends, the next block of the original order starts another. Blocks that
+// never ran go to the end. Blocks without a count (made by passes after
+// the profile was read) lose to counted ones and keep their original
+// fall-through among themselves.
+
+namespace {
+
+using ir::Opcode;
+
+class BlockLayoutPass : public IRFunctionPass {
+ private:
+    static bool isCold(const ir::Function& fn, const ir::LoopInfo& li, const ir::CFG& cfg,
+                       int b) {
+        if (b == 0 || fn.blocks[b]->terminator().op != Opcode::Ret || cfg.preds[b].empty()) {
+            return false;
+        }
+        for (int p : cfg.preds[b]) {
+            int l = li.innermost[p];
+            if (l < 0 || li.depthOf(p) <= li.depthOf(b) ||
+                fn.blocks[p]->terminator().op != Opcode::CondBr || li.loops[l].header == p) {
+                return false;
+            }
+            for (int latch : li.loops[l].latches) {
+                if (latch == p) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The order of fn.blocks by the profile counts, as indices.
+    static std::vector<int> profileOrder(const ir::Function& fn) {
+        int n = static_cast<int>(fn.blocks.size());
+        auto neverRan = [&](int b) { return fn.blocks[b]->count == 0; };
+        std::vector<bool> placed(n, false);
+        std::vector<int> order;
+        int scan = 0;
+        for (int b = 0; b >= 0;) {
+            placed[b] = true;
+            order.push_back(b);
+            int next = -1;
+            for (int s : fn.blocks[b]->successors()) {
+                if (placed[s] || neverRan(s)) {
+                    continue;
+                }
+                int64_t count = fn.blocks[s]->count;
+                if (next < 0 || count > fn.blocks[next]->count ||
+                    (count == fn.blocks[next]->count && s == b + 1)) {
+                    next = s;
+                }
+            }
+            while (next < 0 && scan < n) {
+                if (!placed[scan] && !neverRan(scan)) {
+                    next = scan;
+                }
+                ++scan;
+            }
+            b = next;
+        }
+        for (int b = 0; b < n; ++b) {
+            if (!placed[b]) {
+                order.push_back(b);
+            }
+        }
+        return order;
+    }
+
+    static bool reorder(ir::Function& fn, const std::vector<int>& order) {
+        bool changed = false;
+        std::vector<std::unique_ptr<ir::BasicBlock>> blocks;
+        for (size_t k = 0; k < order.size(); ++k) {
+            changed = changed || order[k] != static_cast<int>(k);
+            blocks.push_back(std::move(fn.blocks[order[k]]));
+        }
+        fn.blocks = std::move(blocks);
+        fn.renumberBlocks();
+        return changed;
+    }
+
+ public:
+    const char* name() const override { return "layout"; }
+
+    PreservedAnalyses preserved() const override { return PreservedAnalyses::none(); }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        if (fn.entry()->count >= 0) {
+            return reorder(fn, profileOrder(fn));
+        }
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& li = am.get<ir::LoopInfo>(fn);
+        if (li.loops.empty()) {
+            return false;
+        }
+        std::vector<int> hot;
+        std::vector<int> cold;
+        for (size_t b = 0; b < fn.blocks.size(); ++b) {
+            int id = static_cast<int>(b);
+            (isCold(fn, li, cfg, id) ? cold : hot).push_back(id);
+        }
+        if (cold.empty()) {
+            return false;
+        }
+        hot.insert(hot.end(), cold.begin(), cold.end());
+        return reorder(fn, hot);
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createBlockLayoutPass() {
+    return std::make_unique<BlockLayoutPass>();
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "interpreter.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Compile-time evaluation of calls
+// ===============================
+// A call to a pure function whose arguments are all constants is run by
+// ir::Interpreter and replaced by a copy of the returned constant, so
+//     var f: int := fact(5);
+// becomes `f := 120`. A function is pure when it neither prints nor
+// touches a global and only calls pure functions. Arguments are constants
+// when they are immediates or were copied from one earlier in the same
+// block, which covers `var a: int := 5; fact(a)` before sccp has run.
+//
+// Each call gets at most kCallFuel instructions and the whole module
+// kModuleFuel; calls that run out, recurse too deep or stop on a division
+// by zero are left for run time, where they behave as before.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const int64_t kCallFuel = 100000;
+const int64_t kModuleFuel = 1000000;
+
+class CallEvaluationPass : public IRModulePass {
+ public:
+    const char* name() const override { return "ctfe"; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnModule(ir::Module& module, AnalysisManager& am) override {
+        auto& cg = am.get<ir::CallGraph>(module);
+        std::vector<bool> pure = cg.pureFunctions();
+        int64_t budget = kModuleFuel;
+
+        bool changed = false;
+        for (ir::Function* fn : cg.functions) {
+            for (auto& block : fn->blocks) {
+                // Registers holding a constant at this point of the block.
+                std::map<int, Operand> known;
+                for (Instr& instr : block->instrs) {
+                    int g = instr.op == Opcode::Call ? cg.find(instr.symbol) : -1;
+                    if (g >= 0 && pure[g] && instr.dst >= 0 && budget > 0) {
+                        std::vector<Operand> args;
+                        for (const Operand& a : instr.args) {
+                            auto found = a.isReg() ? known.find(a.reg) : known.end();
+                            args.push_back(found != known.end() ? found->second : a);
+                        }
+                        bool constant = true;
+                        for (const Operand& a : args) {
+                            constant = constant && a.isImm();
+                        }
+                        if (constant) {
+                            ir::Interpreter interp(module, std::min(budget, kCallFuel));
+                            Operand result;
+                            ir::ExecStatus status = interp.call(*cg.functions[g], args, result);
+                            budget -= std::min(budget, kCallFuel) - interp.fuelLeft();
+                            if (status == ir::ExecStatus::Returned && result.isImm()) {
+                                instr = Instr(Opcode::Copy, instr.type, instr.dst, {result});
+                                changed = true;
+                            }
+                        }
+                    }
+                    if (instr.op == Opcode::Copy && instr.args[0].isImm()) {
+                        known[instr.dst] = instr.args[0];
+                    } else if (instr.dst >= 0) {
+                        known.erase(instr.dst);
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createCallEvaluationPass() {
+    return std::make_unique<CallEvaluationPass>();
+}
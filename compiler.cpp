@@ -5,11 +5,14 @@
 
 Compiler::Compiler(const std::string& sourceFile,
                    const std::string& outputFile,
+                   const OptimizationOptions& options,
                    bool /*debug*/) {
     ctx = {
         .inputFile = sourceFile,
         .outputFile = outputFile,
         .ast = nullptr,
+        .ir = nullptr,
+        .optOptions = options,
     };
 
     stageOrder = {
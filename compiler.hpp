@@ -16,6 +16,7 @@ class Compiler {
  public:
     Compiler(const std::string& sourceFile,
              const std::string& outputFile,
+             const OptimizationOptions& options = OptimizationOptions(),
              bool debug = false);
 
     void compile();
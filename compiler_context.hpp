@@ -1,14 +1,36 @@
 #ifndef COMPILER_CONTEXT_HPP
 #define COMPILER_CONTEXT_HPP
 
+#include <memory>
 #include <string>
+#include <vector>
 #include "astnode.hpp"
+#include "ir.hpp"
+
+// Settings for the optimization stage, filled in from the command line.
+struct OptimizationOptions {
+    std::string level = "O0";            // named pipeline: O0, O1, O2, O3 or Os
+    std::vector<std::string> passes;     // --passes=a,b,c overrides the level
+    bool customPipeline = false;
+    bool timePasses = false;             // --time-passes: report per-pass timing
+    bool dumpIR = false;                 // --dump-ir: print the final IR to stderr
+    int inlineThreshold = -1;            // --inline-threshold=N, -1: default for the level
+    int unrollFactor = -1;               // --unroll-factor=N, -1: default
+    std::vector<std::string> disabledPeepholes;  // --disable-peephole=a,b (or all)
+    bool peepholeStats = false;          // --peephole-stats: report rule counts to stderr
+    bool memoize = false;                // --memoize: cache pure recursive functions' results
+    std::string profileGenerate;         // -fprofile-generate[=file]: count blocks and calls
+    std::string profileUse;              // -fprofile-use[=file]: optimize with those counts
+};
 
 struct CompilerContext {
     std::string inputFile;
     std::string outputFile;
 
     ASTNode* ast = nullptr;
+    std::unique_ptr<ir::Module> ir;      // lowered program, set by optimization
+
+    OptimizationOptions optOptions;
 };
 
-#endif /* COMPILER_CONTEXT_HPP */
\ No newline at end of file
+#endif /* COMPILER_CONTEXT_HPP */
@@ -0,0 +1,294 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "astnode.hpp"
+#include "ir.hpp"
+#include "ir_lowering.hpp"
+
+// ===============================
+// AST constant folding
+// ===============================
+// Evaluates operators whose operands are literals and replaces every use of
+// a `let` whose initializer folds to a literal by that literal, converted to
+// the declared type. The folded `let` declarations are then dropped, so they
+// no longer occupy a register, stack slot or global word. Arithmetic goes
+// through ir::foldConstant, which evaluates exactly like the generated code
+// and refuses divisions that trap at run time (so `x / 0` still reaches
+// div_by_zero).
+//
+// Scoping follows the lowering: block items are visited in textual order,
+// and a nested function sees the names declared before it.
+
+namespace {
+
+using ir::Operand;
+
+DataType dataTypeOf(ir::Type t) {
+    switch (t) {
+        case ir::Type::Int: return DataType::INT;
+        case ir::Type::Float: return DataType::FLOAT;
+        case ir::Type::Bool: return DataType::BOOL;
+        default: return DataType::IOTA;
+    }
+}
+
+// Literal value of `e`, or an operand of kind None.
+Operand literalValue(ExpNode* e) {
+    if (auto* i = dynamic_cast<IntLitNode*>(e)) {
+        return Operand::ofInt(i->value);
+    }
+    if (auto* f = dynamic_cast<FloatLitNode*>(e)) {
+        return Operand::ofFloat(static_cast<float>(f->value));
+    }
+    if (auto* b = dynamic_cast<BoolLitNode*>(e)) {
+        return Operand::ofBool(b->value);
+    }
+    return Operand();
+}
+
+ExpNode* makeLiteral(const Operand& value) {
+    ExpNode* lit = nullptr;
+    switch (value.type) {
+        case ir::Type::Float:
+            lit = new FloatLitNode(value.floatValue);
+            break;
+        case ir::Type::Bool:
+            lit = new BoolLitNode(value.intValue != 0);
+            break;
+        default:
+            lit = new IntLitNode(value.intValue);
+            break;
+    }
+    lit->dataType = dataTypeOf(value.type);
+    return lit;
+}
+
+// Same conversions the lowering applies to immediates.
+Operand convertLiteral(const Operand& value, ir::Type to) {
+    if (value.type == to) {
+        return value;
+    }
+    if (to == ir::Type::Float) {
+        return Operand::ofFloat(static_cast<float>(value.intValue));
+    }
+    if (to == ir::Type::Bool) {
+        return Operand::ofBool(value.intValue != 0);
+    }
+    return Operand::ofInt(value.intValue);
+}
+
+ir::Opcode opcodeFor(BinOp op) {
+    switch (op) {
+        case BinOp::Add: return ir::Opcode::Add;
+        case BinOp::Sub: return ir::Opcode::Sub;
+        case BinOp::Mul: return ir::Opcode::Mul;
+        case BinOp::Div: return ir::Opcode::Div;
+        case BinOp::Eq: return ir::Opcode::CmpEq;
+        case BinOp::Neq: return ir::Opcode::CmpNe;
+        case BinOp::Lt: return ir::Opcode::CmpLt;
+        case BinOp::Gt: return ir::Opcode::CmpGt;
+        case BinOp::Le: return ir::Opcode::CmpLe;
+        case BinOp::Ge: return ir::Opcode::CmpGe;
+    }
+    return ir::Opcode::Add;
+}
+
+class ConstantFolder {
+ private:
+    // Innermost scope last. A name bound to an operand of kind None is a
+    // variable (or non-constant let) shadowing any outer constant.
+    std::vector<std::map<std::string, Operand>> scopes;
+    bool changed = false;
+
+    Operand lookup(const std::string& name) const {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) {
+                return found->second;
+            }
+        }
+        return Operand();
+    }
+
+    // Returns the folded replacement for `e`, deleting `e` if it changed.
+    ExpNode* fold(ExpNode* e) {
+        if (auto* id = dynamic_cast<IdNode*>(e)) {
+            Operand value = lookup(id->name);
+            if (!value.isImm()) {
+                return e;
+            }
+            delete e;
+            changed = true;
+            return makeLiteral(value);
+        }
+
+        if (auto* un = dynamic_cast<UnaryOpNode*>(e)) {
+            un->expr = fold(un->expr);
+            Operand value = literalValue(un->expr);
+            Operand folded;
+            if (!value.isImm() ||
+                !ir::foldConstant(ir::Opcode::Neg, value.type, {value}, folded)) {
+                return e;
+            }
+            delete e;
+            changed = true;
+            return makeLiteral(folded);
+        }
+
+        if (auto* bin = dynamic_cast<BinaryOpNode*>(e)) {
+            bin->left = fold(bin->left);
+            bin->right = fold(bin->right);
+            Operand lhs = literalValue(bin->left);
+            Operand rhs = literalValue(bin->right);
+            if (!lhs.isImm() || !rhs.isImm()) {
+                return e;
+            }
+
+            // Mixed int/float operands are promoted to float.
+            ir::Type operandType = lhs.type;
+            if (lhs.type == ir::Type::Float || rhs.type == ir::Type::Float) {
+                operandType = ir::Type::Float;
+            }
+            lhs = convertLiteral(lhs, operandType);
+            rhs = convertLiteral(rhs, operandType);
+
+            ir::Opcode op = opcodeFor(bin->op);
+            ir::Type resultType = ir::isCompare(op) ? ir::Type::Bool : operandType;
+            Operand folded;
+            if (!ir::foldConstant(op, resultType, {lhs, rhs}, folded)) {
+                return e;
+            }
+            delete e;
+            changed = true;
+            return makeLiteral(folded);
+        }
+
+        if (auto* call = dynamic_cast<CallNode*>(e)) {
+            for (ExpNode*& arg : call->args) {
+                arg = fold(arg);
+            }
+        }
+        return e;
+    }
+
+    // Folds the initializer and binds the name; returns true if the
+    // declaration is a `let` that can be dropped.
+    bool foldDecl(DeclNode* decl) {
+        if (auto* var = dynamic_cast<VarDeclNode*>(decl)) {
+            var->init = fold(var->init);
+            scopes.back()[var->name] = Operand();
+            return false;
+        }
+        if (auto* let = dynamic_cast<LetDeclNode*>(decl)) {
+            let->init = fold(let->init);
+            Operand value = literalValue(let->init);
+            if (!value.isImm()) {
+                scopes.back()[let->name] = Operand();
+                return false;
+            }
+            scopes.back()[let->name] =
+                convertLiteral(value, irTypeOf(let->type->kind));
+            return true;
+        }
+        if (auto* func = dynamic_cast<FuncDeclNode*>(decl)) {
+            foldFunction(func);
+        }
+        return false;
+    }
+
+    void foldBlock(BlockNode* block) {
+        scopes.emplace_back();
+
+        std::vector<ASTNode*> kept;
+        kept.reserve(block->orderedItems.size());
+        for (ASTNode* item : block->orderedItems) {
+            if (auto* decl = dynamic_cast<DeclNode*>(item)) {
+                if (foldDecl(decl)) {
+                    eraseDecl(block->decls, decl);
+                    changed = true;
+                    continue;
+                }
+            } else if (auto* stmt = dynamic_cast<StmtNode*>(item)) {
+                foldStmt(stmt);
+            }
+            kept.push_back(item);
+        }
+        block->orderedItems = std::move(kept);
+
+        scopes.pop_back();
+    }
+
+    void foldStmt(StmtNode* stmt) {
+        if (auto* assign = dynamic_cast<AssignStmtNode*>(stmt)) {
+            assign->rhs = fold(assign->rhs);
+        } else if (auto* print = dynamic_cast<PrintStmtNode*>(stmt)) {
+            print->expr = fold(print->expr);
+        } else if (auto* ret = dynamic_cast<ReturnStmtNode*>(stmt)) {
+            ret->expr = fold(ret->expr);
+        } else if (auto* ifStmt = dynamic_cast<IfStmtNode*>(stmt)) {
+            ifStmt->cond = fold(ifStmt->cond);
+            foldBlock(ifStmt->thenBlk);
+            if (ifStmt->elseBlk) {
+                foldBlock(ifStmt->elseBlk);
+            }
+        } else if (auto* loop = dynamic_cast<WhileStmtNode*>(stmt)) {
+            loop->cond = fold(loop->cond);
+            foldBlock(loop->body);
+        }
+    }
+
+    void foldFunction(FuncDeclNode* func) {
+        scopes.emplace_back();
+        for (ParamNode* p : func->params) {
+            scopes.back()[p->name] = Operand();
+        }
+        foldBlock(func->body);
+        scopes.pop_back();
+    }
+
+    static void eraseDecl(std::vector<DeclNode*>& decls, DeclNode* decl) {
+        for (auto it = decls.begin(); it != decls.end(); ++it) {
+            if (*it == decl) {
+                decls.erase(it);
+                break;
+            }
+        }
+        delete decl;
+    }
+
+ public:
+    bool run(ProgramNode* program) {
+        changed = false;
+        scopes.assign(1, {});
+        std::vector<DeclNode*> kept;
+        kept.reserve(program->declarations.size());
+        for (DeclNode* decl : program->declarations) {
+            if (foldDecl(decl)) {
+                delete decl;
+                changed = true;
+                continue;
+            }
+            kept.push_back(decl);
+        }
+        program->declarations = std::move(kept);
+        return changed;
+    }
+};
+
+class ConstantFoldPass : public ModulePass {
+ public:
+    const char* name() const override { return "constfold"; }
+
+    bool runOnModule(ProgramNode* program, AnalysisManager&) override {
+        ConstantFolder folder;
+        return folder.run(program);
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createConstantFoldPass() {
+    return std::make_unique<ConstantFoldPass>();
+}
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Dead code elimination
+// ===============================
+// dce walks every block backwards from its live-out set and deletes
+// instructions whose result is never read: dead temporaries, unused local
+// variables and stores to a variable that is overwritten before any read.
+// Instructions with side effects stay; a call whose result is unused keeps
+// running but no longer stores the result. In SSA form every register has
+// one definition, so it instead marks what the side-effecting instructions
+// need and deletes the rest, which also catches dead phi cycles.
+//
+// globaldce removes the functions main cannot reach through the call graph
+// and the globals that no remaining function reads.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+
+class DeadCodeEliminationPass : public IRFunctionPass {
+ private:
+    // One backward sweep over every block; returns true if anything was
+    // removed.
+    static bool sweep(ir::Function& fn, const ir::Liveness& live) {
+        bool changed = false;
+        std::vector<char> isLive(fn.vregs.size(), 0);
+        std::vector<int> touched;
+        auto markLive = [&](int r) {
+            if (!isLive[r]) {
+                isLive[r] = 1;
+                touched.push_back(r);
+            }
+        };
+
+        for (auto& block : fn.blocks) {
+            for (int r : touched) {
+                isLive[r] = 0;
+            }
+            touched.clear();
+            live.liveOut[block->id].forEach([&](size_t bit) {
+                markLive(live.tracked[bit]);
+            });
+
+            auto& instrs = block->instrs;
+            std::vector<bool> dead(instrs.size(), false);
+            bool removed = false;
+            for (size_t i = instrs.size(); i-- > 0;) {
+                Instr& instr = instrs[i];
+                if (instr.dst >= 0 && !isLive[instr.dst]) {
+                    if (!instr.hasSideEffects()) {
+                        dead[i] = true;
+                        removed = true;
+                        continue;
+                    }
+                    if (instr.op == Opcode::Call) {
+                        instr.dst = -1;
+                        changed = true;
+                    }
+                }
+                if (instr.dst >= 0) {
+                    isLive[instr.dst] = 0;
+                }
+                // Phi inputs are read at the end of the predecessors.
+                if (instr.op != Opcode::Phi) {
+                    ir::forEachUse(instr, markLive);
+                }
+            }
+
+            if (removed) {
+                changed = true;
+                size_t out = 0;
+                for (size_t i = 0; i < instrs.size(); ++i) {
+                    if (!dead[i]) {
+                        if (out != i) {
+                            instrs[out] = std::move(instrs[i]);
+                        }
+                        ++out;
+                    }
+                }
+                instrs.erase(instrs.begin() + out, instrs.end());
+            }
+        }
+        return changed;
+    }
+
+    static bool sweepSSA(ir::Function& fn) {
+        std::vector<const Instr*> def(fn.vregs.size(), nullptr);
+        std::vector<char> needed(fn.vregs.size(), 0);
+        std::vector<int> work;
+        auto need = [&](int r) {
+            if (!needed[r]) {
+                needed[r] = 1;
+                work.push_back(r);
+            }
+        };
+        for (const auto& block : fn.blocks) {
+            for (const Instr& instr : block->instrs) {
+                if (instr.dst >= 0) {
+                    def[instr.dst] = &instr;
+                }
+                if (instr.hasSideEffects()) {
+                    ir::forEachUse(instr, need);
+                }
+            }
+        }
+        while (!work.empty()) {
+            int r = work.back();
+            work.pop_back();
+            if (def[r]) {
+                ir::forEachUse(*def[r], need);
+            }
+        }
+
+        bool changed = false;
+        for (auto& block : fn.blocks) {
+            auto& instrs = block->instrs;
+            size_t out = 0;
+            for (size_t i = 0; i < instrs.size(); ++i) {
+                Instr& instr = instrs[i];
+                if (instr.dst >= 0 && !needed[instr.dst]) {
+                    if (!instr.hasSideEffects()) {
+                        changed = true;
+                        continue;
+                    }
+                    if (instr.op == Opcode::Call) {
+                        instr.dst = -1;
+                        changed = true;
+                    }
+                }
+                if (out != i) {
+                    instrs[out] = std::move(instr);
+                }
+                ++out;
+            }
+            instrs.erase(instrs.begin() + out, instrs.end());
+        }
+        return changed;
+    }
+
+ public:
+    const char* name() const override { return "dce"; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        // Removing a use can make definitions in other blocks dead, which
+        // the next round's liveness picks up.
+        if (fn.ssa) {
+            return sweepSSA(fn);
+        }
+        bool changed = false;
+        while (sweep(fn, am.get<ir::Liveness>(fn))) {
+            changed = true;
+            am.invalidate(&fn, preserved());
+        }
+        return changed;
+    }
+};
+
+class GlobalDeadCodeEliminationPass : public IRModulePass {
+ public:
+    const char* name() const override { return "globaldce"; }
+
+    bool runOnModule(ir::Module& module, AnalysisManager& am) override {
+        auto& cg = am.get<ir::CallGraph>(module);
+        int mainFn = cg.find("main");
+        if (mainFn < 0) {
+            return false;
+        }
+
+        bool changed = false;
+        std::vector<bool> reachable = cg.reachableFrom(mainFn);
+        std::vector<std::unique_ptr<ir::Function>> kept;
+        for (size_t f = 0; f < module.functions.size(); ++f) {
+            if (reachable[f]) {
+                kept.push_back(std::move(module.functions[f]));
+            } else {
+                changed = true;
+            }
+        }
+        module.functions = std::move(kept);
+
+        // Globals nobody reads only need their stores removed.
+        std::set<std::string> read;
+        for (const auto& fn : module.functions) {
+            for (const auto& block : fn->blocks) {
+                for (const Instr& instr : block->instrs) {
+                    if (instr.op == Opcode::LoadGlobal) {
+                        read.insert(instr.symbol);
+                    }
+                }
+            }
+        }
+        std::vector<ir::Global> globals;
+        for (const ir::Global& g : module.globals) {
+            if (read.count(g.name)) {
+                globals.push_back(g);
+            } else {
+                changed = true;
+            }
+        }
+        module.globals = std::move(globals);
+        for (const auto& fn : module.functions) {
+            for (auto& block : fn->blocks) {
+                auto& instrs = block->instrs;
+                auto unread = [&](const Instr& instr) {
+                    return instr.op == Opcode::StoreGlobal &&
+                           !read.count(instr.symbol);
+                };
+                instrs.erase(std::remove_if(instrs.begin(), instrs.end(), unread),
+                             instrs.end());
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createDCEPass() {
+    return std::make_unique<DeadCodeEliminationPass>();
+}
+
+std::unique_ptr<Pass> createGlobalDCEPass() {
+    return std::make_unique<GlobalDeadCodeEliminationPass>();
+}
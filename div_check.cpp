@@ -0,0 +1,63 @@
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "ssa.hpp"
+#include "value_range.hpp"
+
+// ===============================
+// Division-by-zero check elimination
+// ===============================
+// Marks integer divisions whose divisor ir::ValueRanges proves non-zero
+// where the division runs, e.g. a loop counter that starts at 1 and only
+// grows, or a value tested by an enclosing `if (d != 0)`. The backend then
+// emits the division without the branch to div_by_zero. Immediate
+// divisors need no proof; the backend already knows them.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+
+class DivCheckPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "divcheck"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses::allAnalyses();
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        ir::ValueRanges* ranges = nullptr;
+        for (auto& block : fn.blocks) {
+            for (Instr& instr : block->instrs) {
+                if (instr.op != Opcode::Div || instr.type != ir::Type::Int ||
+                    !instr.args[1].isReg() || instr.divisorNonZero) {
+                    continue;
+                }
+                if (!ranges) {
+                    ranges = &am.get<ir::ValueRanges>(fn);
+                }
+                if (ranges->isNonZeroAt(instr.args[1], block->id)) {
+                    instr.divisorNonZero = true;
+                    changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createDivCheckPass() {
+    return std::make_unique<DivCheckPass>();
+}
@@ -23,6 +23,18 @@ class ParserException : public std::runtime_error {
         ", column " + std::to_string(col)) {}
 };
 
+class OptimizationException : public std::runtime_error {
+ public:
+    explicit OptimizationException(const std::string& msg)
+        : std::runtime_error(msg) {}
+};
+
+class CodeGenException : public std::runtime_error {
+ public:
+    explicit CodeGenException(const std::string& msg)
+        : std::runtime_error(msg) {}
+};
+
 struct SemanticErrorContext {
     std::string identifier;
     DataType expectedType;
@@ -0,0 +1,221 @@
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Global value numbering
+// ===============================
+// Dominator-based value numbering over SSA form. Walking the dominator
+// tree, every pure instruction is keyed on its opcode, type and (already
+// numbered) operands; an instruction whose key was computed in a
+// dominating block is deleted and its uses read the earlier result.
+// Commutative operands are put in a canonical order first, and copies
+// simply forward their source. A division is only removed when an
+// identical one dominates it, which would have trapped first.
+//
+// Loads of globals are numbered locally: a load is reused, and a store
+// forwarded, until the next store to the same global or call, and the
+// available loads carry over into a dominated block whose only
+// predecessor is its immediate dominator.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+struct ExprKey {
+    Opcode op;
+    ir::Type type;
+    std::vector<std::tuple<int, int, int, int32_t, uint32_t>> args;
+
+    bool operator<(const ExprKey& other) const {
+        return std::tie(op, type, args) <
+               std::tie(other.op, other.type, other.args);
+    }
+};
+
+std::tuple<int, int, int, int32_t, uint32_t> operandKey(const Operand& a) {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &a.floatValue, sizeof(bits));
+    return {static_cast<int>(a.kind), static_cast<int>(a.type), a.reg,
+            a.intValue, bits};
+}
+
+bool isCommutative(Opcode op) {
+    return op == Opcode::Add || op == Opcode::Mul ||
+           op == Opcode::CmpEq || op == Opcode::CmpNe;
+}
+
+bool isNumberable(const Instr& instr) {
+    switch (instr.op) {
+        case Opcode::Neg:
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+        case Opcode::CmpEq:
+        case Opcode::CmpNe:
+        case Opcode::CmpLt:
+        case Opcode::CmpGt:
+        case Opcode::CmpLe:
+        case Opcode::CmpGe:
+        case Opcode::IntToFloat:
+        case Opcode::IntToBool:
+            return instr.dst >= 0;
+        default:
+            return false;
+    }
+}
+
+class GVNPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "gvn"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& dt = am.get<ir::DominatorTree>(fn);
+
+        // replacement[r] is the operand every use of r reads instead.
+        std::vector<Operand> replacement(fn.vregs.size());
+        auto resolve = [&](Operand& a) {
+            if (a.isReg() && replacement[a.reg].kind != Operand::Kind::None) {
+                a = replacement[a.reg];
+            }
+        };
+
+        std::map<ExprKey, Operand> available;
+        using LoadMap = std::map<std::string, Operand>;
+
+        struct Frame {
+            int block;
+            size_t next;
+            std::vector<ExprKey> added;
+            LoadMap loads;   // available at the end of the block
+        };
+        std::vector<Frame> walk;
+        walk.push_back({0, 0, {}, {}});
+        bool entering = true;
+        while (!walk.empty()) {
+            Frame& frame = walk.back();
+            if (entering) {
+                auto& instrs = fn.blocks[frame.block]->instrs;
+                size_t out = 0;
+                for (size_t i = 0; i < instrs.size(); ++i) {
+                    Instr& instr = instrs[i];
+                    bool redundant = false;
+                    if (instr.op != Opcode::Phi) {
+                        for (Operand& a : instr.args) {
+                            resolve(a);
+                        }
+                    }
+
+                    if (instr.op == Opcode::Copy && instr.dst >= 0 &&
+                        instr.args[0].type == fn.regType(instr.dst)) {
+                        replacement[instr.dst] = instr.args[0];
+                        redundant = true;
+                    } else if (instr.op == Opcode::LoadGlobal) {
+                        auto it = frame.loads.find(instr.symbol);
+                        if (it != frame.loads.end()) {
+                            replacement[instr.dst] = it->second;
+                            redundant = true;
+                        } else {
+                            frame.loads[instr.symbol] =
+                                Operand::ofReg(instr.dst, instr.type);
+                        }
+                    } else if (instr.op == Opcode::StoreGlobal) {
+                        frame.loads[instr.symbol] = instr.args[0];
+                    } else if (instr.op == Opcode::Call) {
+                        frame.loads.clear();
+                    } else if (isNumberable(instr)) {
+                        ExprKey key{instr.op, instr.type, {}};
+                        std::vector<Operand> args = instr.args;
+                        if (isCommutative(instr.op) &&
+                            operandKey(args[1]) < operandKey(args[0])) {
+                            std::swap(args[0], args[1]);
+                        }
+                        for (const Operand& a : args) {
+                            key.args.push_back(operandKey(a));
+                        }
+                        auto it = available.find(key);
+                        if (it != available.end()) {
+                            replacement[instr.dst] = it->second;
+                            redundant = true;
+                        } else {
+                            available.emplace(key, Operand::ofReg(instr.dst, instr.type));
+                            frame.added.push_back(std::move(key));
+                        }
+                    }
+
+                    if (redundant) {
+                        changed = true;
+                        continue;
+                    }
+                    if (out != i) {
+                        instrs[out] = std::move(instr);
+                    }
+                    ++out;
+                }
+                instrs.erase(instrs.begin() + out, instrs.end());
+            }
+
+            const std::vector<int>& kids = dt.children(frame.block);
+            if (frame.next < kids.size()) {
+                int child = kids[frame.next++];
+                LoadMap inherited;
+                if (cfg.preds[child].size() == 1) {
+                    inherited = frame.loads;
+                }
+                walk.push_back({child, 0, {}, std::move(inherited)});
+                entering = true;
+                continue;
+            }
+            for (const ExprKey& key : frame.added) {
+                available.erase(key);
+            }
+            walk.pop_back();
+            entering = false;
+        }
+
+        // Phi inputs can come from blocks visited after the phi.
+        for (auto& block : fn.blocks) {
+            for (Instr& instr : block->instrs) {
+                if (instr.op != Opcode::Phi) {
+                    break;
+                }
+                for (Operand& a : instr.args) {
+                    resolve(a);
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createGVNPass() {
+    return std::make_unique<GVNPass>();
+}
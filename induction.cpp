@@ -0,0 +1,175 @@
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "loop_utils.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Induction-variable strength reduction
+// ===============================
+// A product of a basic induction variable and a loop-invariant factor,
+//     j = i * c    with i advanced by s every iteration,
+// is itself advanced by c * s every iteration, so it becomes a header phi
+// that starts at start(i) * c and gets one add on the back edge, and the
+// multiplication disappears from the loop. Integer products wrap the same
+// way the repeated adds do, so the values are identical.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+class IVStrengthReductionPass : public IRFunctionPass {
+ private:
+    // Emits `a * b` before the terminator of `block` (folded when both
+    // are constants or one is 0 or 1) and returns its value.
+    static Operand multiply(ir::Function& fn, ir::BasicBlock& block,
+                            const Operand& a, const Operand& b) {
+        Operand folded;
+        if (ir::foldConstant(Opcode::Mul, ir::Type::Int, {a, b}, folded)) {
+            return folded;
+        }
+        if ((a.isImm() && a.intValue == 0) || (b.isImm() && b.intValue == 1)) {
+            return a;
+        }
+        if ((b.isImm() && b.intValue == 0) || (a.isImm() && a.intValue == 1)) {
+            return b;
+        }
+        int reg = fn.newVReg(ir::Type::Int);
+        block.instrs.insert(block.instrs.end() - 1,
+                            Instr(Opcode::Mul, ir::Type::Int, reg, {a, b}));
+        return Operand::ofReg(reg, ir::Type::Int);
+    }
+
+ public:
+    const char* name() const override { return "ivsr"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        if (am.get<ir::LoopInfo>(fn).loops.empty()) {
+            return changed;
+        }
+        changed = ir::insertPreheaders(fn, am) || changed;
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& li = am.get<ir::LoopInfo>(fn);
+
+        std::vector<int> defBlock(fn.vregs.size(), -1);
+        for (const auto& block : fn.blocks) {
+            for (const Instr& instr : block->instrs) {
+                if (instr.dst >= 0) {
+                    defBlock[instr.dst] = block->id;
+                }
+            }
+        }
+        // Uses of a replaced product are redirected to its phi.
+        std::vector<Operand> replacement(fn.vregs.size());
+
+        for (size_t l = 0; l < li.loops.size(); ++l) {
+            int loop = static_cast<int>(l);
+            std::vector<ir::InductionVariable> ivs =
+                ir::findInductionVariables(fn, li, loop, cfg);
+            if (ivs.empty()) {
+                continue;
+            }
+            const ir::Loop& info = li.loops[loop];
+            ir::BasicBlock& preheader = *fn.blocks[ir::preheaderOf(li, loop, cfg)];
+            ir::BasicBlock& header = *fn.blocks[info.header];
+            ir::BasicBlock& latch = *fn.blocks[info.latches[0]];
+            auto invariant = [&](const Operand& a) {
+                return a.isImm() ||
+                       (defBlock[a.reg] < 0 || !li.contains(loop, defBlock[a.reg]));
+            };
+
+            for (int b : info.blocks) {
+                // Only the loop's own blocks; nested loops were handled
+                // with their own induction variables.
+                if (li.innermost[b] != loop) {
+                    continue;
+                }
+                auto& instrs = fn.blocks[b]->instrs;
+                for (size_t i = 0; i < instrs.size(); ++i) {
+                    const Instr& mul = instrs[i];
+                    if (mul.op != Opcode::Mul || mul.type != ir::Type::Int) {
+                        continue;
+                    }
+                    const ir::InductionVariable* iv = nullptr;
+                    Operand factor;
+                    for (const auto& candidate : ivs) {
+                        for (int side = 0; side < 2 && !iv; ++side) {
+                            const Operand& a = mul.args[side];
+                            if (a.isReg() && a.reg == candidate.phi &&
+                                invariant(mul.args[1 - side])) {
+                                iv = &candidate;
+                                factor = mul.args[1 - side];
+                            }
+                        }
+                    }
+                    if (!iv || (factor.isImm() && (factor.intValue == 0 ||
+                                                   factor.intValue == 1))) {
+                        continue;
+                    }
+
+                    int dst = mul.dst;
+                    Operand start = multiply(fn, preheader, iv->start, factor);
+                    Operand step = multiply(fn, preheader, factor,
+                                            Operand::ofInt(iv->step));
+                    int phi = fn.newVReg(ir::Type::Int, fn.vregs[dst].name);
+                    int next = fn.newVReg(ir::Type::Int);
+                    Instr join(Opcode::Phi, ir::Type::Int, phi,
+                               {start, Operand::ofReg(next, ir::Type::Int)});
+                    join.targets = {preheader.id, latch.id};
+                    latch.instrs.insert(latch.instrs.end() - 1,
+                                        Instr(Opcode::Add, ir::Type::Int, next,
+                                              {Operand::ofReg(phi, ir::Type::Int), step}));
+                    // The latch insert lands after position i; the header
+                    // insert before it when this block is the header.
+                    instrs.erase(instrs.begin() + i);
+                    header.instrs.insert(header.instrs.begin(), std::move(join));
+                    if (b != info.header) {
+                        --i;
+                    }
+                    defBlock.resize(fn.vregs.size(), -1);
+                    replacement.resize(fn.vregs.size());
+                    defBlock[phi] = info.header;
+                    defBlock[next] = latch.id;
+                    replacement[dst] = Operand::ofReg(phi, ir::Type::Int);
+                    changed = true;
+                }
+            }
+        }
+
+        for (auto& block : fn.blocks) {
+            for (Instr& instr : block->instrs) {
+                for (Operand& a : instr.args) {
+                    if (a.isReg() && replacement[a.reg].isReg()) {
+                        a = replacement[a.reg];
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createIVStrengthReductionPass() {
+    return std::make_unique<IVStrengthReductionPass>();
+}
@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Function inlining
+// ===============================
+// Replaces calls by a copy of the callee's body, walking the call graph
+// bottom-up so a callee has already absorbed its own small callees when
+// its callers are considered. Functions that are part of a recursive cycle
+// are never inlined.
+//
+// A call is inlined when its cost stays within the threshold:
+//     cost = size(callee) - call overhead - bonuses
+// The call overhead covers the argument pushes, jal, prologue and epilogue
+// the call would execute; each constant argument earns a bonus since it
+// lets later passes fold the inlined body, and a callee with a single call
+// site earns its whole size because globaldce deletes the original. The
+// threshold depends on the -O level (--inline-threshold=N overrides it):
+// -Os only accepts calls whose inlining does not grow the code.
+//
+// With a profile (-fprofile-use), call sites that ran at least a tenth as
+// often as the hottest one get kHotCallBonus more, while sites that never
+// ran are held to the -Os rule. The inlined blocks take the callee's
+// counts scaled to the share of its calls this site made.
+//
+// Inlining works outside SSA form: parameters become copies of the
+// arguments, every `ret` stores the result and branches to the code that
+// followed the call, so early returns need no special handling.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const int kCallOverhead = 6;
+const int kConstantArgBonus = 3;
+// Callers stop growing once they reach this many instructions.
+const int kMaxCallerSize = 3000;
+// Threshold added for hot call sites, and how much less often than the
+// hottest site a site may run to count as hot.
+const int kHotCallBonus = 40;
+const int64_t kHotCallFraction = 10;
+
+int thresholdForLevel(const std::string& level) {
+    if (level == "O1") {
+        return 10;
+    }
+    if (level == "O2" || level == "O3") {
+        return 50;
+    }
+    if (level == "Os") {
+        return 0;
+    }
+    return 25;
+}
+
+int sizeOf(const ir::Function& fn) {
+    int size = 0;
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            if (instr.op != Opcode::Br) {
+                ++size;
+            }
+        }
+    }
+    return size;
+}
+
+class InlinerPass : public IRModulePass {
+ private:
+    int threshold = 25;
+
+    struct Site {
+        int block;
+        size_t index;
+    };
+
+    // Blocks created while inlining into one function get ids past the
+    // existing ones; `after[b]` lists what is laid out after block b.
+    struct Layout {
+        std::vector<std::unique_ptr<ir::BasicBlock>> created;
+        std::map<int, std::vector<ir::BasicBlock*>> after;
+    };
+
+    static ir::BasicBlock* addBlock(Layout& layout, int id, const std::string& hint) {
+        auto block = std::make_unique<ir::BasicBlock>();
+        block->id = id;
+        block->hint = hint;
+        layout.created.push_back(std::move(block));
+        return layout.created.back().get();
+    }
+
+    // Inlines the call at `block->instrs[index]` of `caller`.
+    static void inlineCall(ir::Function& caller, ir::BasicBlock* block,
+                           size_t index, const ir::Function& callee,
+                           Layout& layout, int& nextId) {
+        Instr call = std::move(block->instrs[index]);
+
+        // Code after the call continues in a block of its own.
+        ir::BasicBlock* cont = addBlock(layout, nextId++, "inline.cont");
+        cont->instrs.assign(std::make_move_iterator(block->instrs.begin() + index + 1),
+                            std::make_move_iterator(block->instrs.end()));
+        block->instrs.erase(block->instrs.begin() + index, block->instrs.end());
+
+        std::vector<int> reg(callee.vregs.size());
+        for (size_t r = 0; r < callee.vregs.size(); ++r) {
+            const ir::VReg& v = callee.vregs[r];
+            reg[r] = caller.newVReg(v.type, v.name);
+        }
+        auto mapOperand = [&](Operand a) {
+            if (a.isReg()) {
+                a.reg = reg[a.reg];
+            }
+            return a;
+        };
+
+        for (size_t i = 0; i < callee.params.size(); ++i) {
+            int p = reg[callee.params[i]];
+            block->instrs.emplace_back(Opcode::Copy, caller.regType(p), p,
+                                       std::vector<Operand>{call.args[i]});
+        }
+
+        cont->count = block->count;
+
+        // Profile counts of the callee, scaled to this call's share and
+        // rounded up, so only what never ran counts 0.
+        int64_t calls = callee.entry()->count;
+        auto scale = [&](int64_t count) {
+            return count < 0 || call.count < 0 || calls <= 0
+                ? int64_t(-1)
+                : (count * call.count + calls - 1) / calls;
+        };
+
+        std::vector<ir::BasicBlock*> body;
+        std::vector<int> blockId(callee.blocks.size());
+        for (size_t b = 0; b < callee.blocks.size(); ++b) {
+            body.push_back(addBlock(layout, nextId++,
+                                    callee.name + "." + callee.blocks[b]->hint));
+            body.back()->count = scale(callee.blocks[b]->count);
+            blockId[b] = body.back()->id;
+        }
+        for (size_t b = 0; b < callee.blocks.size(); ++b) {
+            for (const Instr& src : callee.blocks[b]->instrs) {
+                if (src.op == Opcode::Ret) {
+                    if (call.dst >= 0 && !src.args.empty()) {
+                        body[b]->instrs.emplace_back(
+                            Opcode::Copy, call.type, call.dst,
+                            std::vector<Operand>{mapOperand(src.args[0])});
+                    }
+                    body[b]->instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+                    body[b]->instrs.back().targets = {cont->id};
+                    continue;
+                }
+                Instr copy = src;
+                if (copy.dst >= 0) {
+                    copy.dst = reg[copy.dst];
+                }
+                for (Operand& a : copy.args) {
+                    a = mapOperand(a);
+                }
+                for (int& t : copy.targets) {
+                    t = blockId[t];
+                }
+                if (copy.op == Opcode::Call) {
+                    copy.count = scale(copy.count);
+                }
+                body[b]->instrs.push_back(std::move(copy));
+            }
+        }
+
+        block->instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+        block->instrs.back().targets = {blockId[0]};
+
+        std::vector<ir::BasicBlock*>& next = layout.after[block->id];
+        body.push_back(cont);
+        next.insert(next.begin(), body.begin(), body.end());
+    }
+
+    static void applyLayout(ir::Function& fn, Layout& layout) {
+        std::map<ir::BasicBlock*, std::unique_ptr<ir::BasicBlock>> owned;
+        for (auto& b : layout.created) {
+            owned[b.get()] = std::move(b);
+        }
+        std::vector<std::unique_ptr<ir::BasicBlock>> ordered;
+        for (auto& b : fn.blocks) {
+            auto found = layout.after.find(b->id);
+            ordered.push_back(std::move(b));
+            if (found != layout.after.end()) {
+                for (ir::BasicBlock* next : found->second) {
+                    ordered.push_back(std::move(owned[next]));
+                }
+            }
+        }
+        fn.blocks = std::move(ordered);
+        fn.renumberBlocks();
+    }
+
+ public:
+    const char* name() const override { return "inline"; }
+
+    void setOptions(const OptimizationOptions& options) override {
+        threshold = options.inlineThreshold >= 0
+            ? options.inlineThreshold
+            : thresholdForLevel(options.level);
+    }
+
+    bool runOnModule(ir::Module& module, AnalysisManager& am) override {
+        for (auto& fn : module.functions) {
+            if (ir::destroySSA(*fn)) {
+                am.invalidate(fn.get(), PreservedAnalyses::none());
+            }
+        }
+        auto& cg = am.get<ir::CallGraph>(module);
+        std::vector<int> sizes;
+        for (ir::Function* fn : cg.functions) {
+            sizes.push_back(sizeOf(*fn));
+        }
+        std::vector<int> remainingSites = cg.callSites;
+        int64_t hottest = 0;
+        for (ir::Function* fn : cg.functions) {
+            for (const auto& block : fn->blocks) {
+                for (const Instr& instr : block->instrs) {
+                    if (instr.op == Opcode::Call && instr.count > hottest) {
+                        hottest = instr.count;
+                    }
+                }
+            }
+        }
+
+        bool changed = false;
+        for (const auto& scc : cg.sccs) {
+            for (int f : scc) {
+                ir::Function& caller = *cg.functions[f];
+                std::vector<Site> sites;
+                for (const auto& block : caller.blocks) {
+                    for (size_t i = 0; i < block->instrs.size(); ++i) {
+                        if (block->instrs[i].op == Opcode::Call) {
+                            sites.push_back({block->id, i});
+                        }
+                    }
+                }
+
+                Layout layout;
+                int nextId = static_cast<int>(caller.blocks.size());
+                std::vector<ir::BasicBlock*> byId;
+                for (auto& b : caller.blocks) {
+                    byId.push_back(b.get());
+                }
+                // Later sites first, so earlier indices stay valid.
+                for (auto it = sites.rbegin(); it != sites.rend(); ++it) {
+                    ir::BasicBlock* block = byId[it->block];
+                    const Instr& call = block->instrs[it->index];
+                    int g = cg.find(call.symbol);
+                    if (g < 0 || cg.sccOf[g] == cg.sccOf[f] || cg.isRecursive(g)) {
+                        continue;
+                    }
+                    int cost = sizes[g] - kCallOverhead - static_cast<int>(call.args.size());
+                    for (const Operand& a : call.args) {
+                        if (a.isImm()) {
+                            cost -= kConstantArgBonus;
+                        }
+                    }
+                    if (remainingSites[g] == 1 && cg.functions[g]->label != "main") {
+                        cost -= sizes[g];
+                    }
+                    int limit = threshold;
+                    if (call.count == 0) {
+                        limit = std::min(limit, 0);
+                    } else if (call.count > 0 && call.count * kHotCallFraction >= hottest) {
+                        limit += kHotCallBonus;
+                    }
+                    if (cost > limit || sizes[f] + sizes[g] > kMaxCallerSize) {
+                        continue;
+                    }
+
+                    inlineCall(caller, block, it->index, *cg.functions[g], layout, nextId);
+                    sizes[f] += sizes[g] + static_cast<int>(cg.functions[g]->params.size());
+                    remainingSites[g] -= 1;
+                    // The copied body brings its own call sites along.
+                    for (const auto& b : cg.functions[g]->blocks) {
+                        for (const Instr& instr : b->instrs) {
+                            int h = instr.op == Opcode::Call ? cg.find(instr.symbol) : -1;
+                            if (h >= 0) {
+                                remainingSites[h] += 1;
+                            }
+                        }
+                    }
+                    changed = true;
+                }
+                // Cached analyses go stale, but the call graph is still
+                // needed; the pass manager drops them all afterwards.
+                if (!layout.after.empty()) {
+                    applyLayout(caller, layout);
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createInlinerPass() {
+    return std::make_unique<InlinerPass>();
+}
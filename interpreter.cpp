@@ -0,0 +1,150 @@
+#include <utility>
+
+#include "interpreter.hpp"
+
+namespace ir {
+
+namespace {
+
+// Calls nested deeper than this give up instead of exhausting the
+// compiler's own stack.
+const int kMaxDepth = 1000;
+
+Operand zeroOf(Type t) {
+    if (t == Type::Float) {
+        return Operand::ofFloat(0.0f);
+    }
+    return t == Type::Bool ? Operand::ofBool(false) : Operand::ofInt(0);
+}
+
+// Copies between int and bool keep the 0/1 representation.
+Operand retype(Operand value, Type t) {
+    if (t != Type::Void && t != Type::Float && value.type != Type::Float) {
+        value.type = t;
+    }
+    return value;
+}
+
+bool isZero(const Operand& value) {
+    return value.type == Type::Float ? value.floatValue == 0.0f : value.intValue == 0;
+}
+
+}  // anonymous namespace
+
+Interpreter::Interpreter(const Module& m, int64_t f) : module(m), fuel(f) {
+    for (const Global& g : module.globals) {
+        globals[g.name] = zeroOf(g.type);
+    }
+}
+
+ExecStatus Interpreter::call(const Function& fn, const std::vector<Operand>& args,
+                             Operand& result) {
+    if (depth >= kMaxDepth || args.size() != fn.params.size()) {
+        return ExecStatus::Unsupported;
+    }
+    std::vector<Operand> regs(fn.vregs.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+        regs[fn.params[i]] = retype(args[i], fn.regType(fn.params[i]));
+    }
+    auto value = [&](const Operand& a) { return a.isReg() ? regs[a.reg] : a; };
+
+    // Operand values of the current instruction, reused to keep the
+    // interpreter from allocating for every instruction it runs.
+    std::vector<Operand> in;
+    std::vector<std::pair<int, Operand>> incoming;
+    ++depth;
+    ExecStatus status = ExecStatus::Unsupported;
+    int prev = -1;
+    int b = 0;
+    while (b >= 0) {
+        const BasicBlock& block = *fn.blocks[b];
+        int next = -1;
+        size_t i = 0;
+
+        // Phis read their inputs before any of them is assigned.
+        incoming.clear();
+        for (; i < block.instrs.size() && block.instrs[i].op == Opcode::Phi; ++i) {
+            const Instr& phi = block.instrs[i];
+            for (size_t k = 0; k < phi.targets.size(); ++k) {
+                if (phi.targets[k] == prev) {
+                    incoming.emplace_back(phi.dst, value(phi.args[k]));
+                }
+            }
+        }
+        for (auto& assign : incoming) {
+            regs[assign.first] = std::move(assign.second);
+        }
+
+        for (; i < block.instrs.size(); ++i) {
+            const Instr& instr = block.instrs[i];
+            if (--fuel < 0) {
+                fuel = 0;
+                --depth;
+                return ExecStatus::OutOfFuel;
+            }
+            in.clear();
+            for (const Operand& a : instr.args) {
+                in.push_back(value(a));
+                if (!in.back().isImm()) {
+                    --depth;
+                    return ExecStatus::Unsupported;
+                }
+            }
+
+            switch (instr.op) {
+                case Opcode::LoadGlobal:
+                    regs[instr.dst] = retype(globals[instr.symbol], instr.type);
+                    break;
+                case Opcode::StoreGlobal:
+                    globals[instr.symbol] = retype(in[0], instr.type);
+                    break;
+                case Opcode::Print:
+                    printed.push_back(retype(in[0], instr.type));
+                    break;
+                case Opcode::Count:
+                    break;
+                case Opcode::Call: {
+                    const Function* callee = module.findFunction(instr.symbol);
+                    Operand returned;
+                    ExecStatus inner = callee ? call(*callee, in, returned)
+                                              : ExecStatus::Unsupported;
+                    if (inner != ExecStatus::Returned) {
+                        --depth;
+                        return inner;
+                    }
+                    if (instr.dst >= 0) {
+                        regs[instr.dst] = retype(returned, instr.type);
+                    }
+                    break;
+                }
+                case Opcode::Br:
+                    next = instr.targets[0];
+                    break;
+                case Opcode::CondBr:
+                    next = in[0].intValue != 0 ? instr.targets[0] : instr.targets[1];
+                    break;
+                case Opcode::Ret:
+                    result = in.empty() ? Operand() : retype(in[0], fn.retType);
+                    status = ExecStatus::Returned;
+                    break;
+                default: {
+                    Operand folded;
+                    if (!foldConstant(instr.op, instr.type, in, folded)) {
+                        --depth;
+                        return instr.op == Opcode::Div && isZero(in[1])
+                            ? ExecStatus::DivByZero
+                            : ExecStatus::Unsupported;
+                    }
+                    regs[instr.dst] = retype(folded, instr.type);
+                    break;
+                }
+            }
+        }
+        prev = b;
+        b = next;
+    }
+    --depth;
+    return status;
+}
+
+}  // namespace ir
@@ -0,0 +1,55 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+// ===============================
+// Compile-time interpreter
+// ===============================
+// Runs IR functions on constant operands with the semantics of the
+// generated code: arithmetic goes through ir::foldConstant (wrapping ints,
+// single-precision floats), bools are 0/1 and a division by zero stops the
+// program the way div_by_zero does. Phis are taken along the edge the
+// block was entered from, so functions may be in SSA form or not.
+//
+// Every executed instruction costs one unit of fuel; running out stops
+// the interpreter, which is how callers bound the work spent on a program
+// that loops for too long (or forever). Globals and printed values are
+// kept in the interpreter, so a whole program can be run from main.
+
+namespace ir {
+
+enum class ExecStatus {
+    Returned,     // the function returned normally
+    DivByZero,    // a division by zero stopped the program
+    OutOfFuel,    // the fuel ran out first
+    Unsupported   // something without a compile-time value, e.g. INT_MIN / -1
+};
+
+class Interpreter {
+ public:
+    Interpreter(const Module& module, int64_t fuel);
+
+    // Runs `fn` on `args` (immediates of the parameter types); `result`
+    // holds the returned value, if any, when Returned.
+    ExecStatus call(const Function& fn, const std::vector<Operand>& args, Operand& result);
+
+    int64_t fuelLeft() const { return fuel; }
+    // Values printed so far, in order, typed as the print instruction.
+    const std::vector<Operand>& output() const { return printed; }
+
+ private:
+    const Module& module;
+    int64_t fuel;
+    int depth = 0;
+    std::map<std::string, Operand> globals;
+    std::vector<Operand> printed;
+};
+
+}  // namespace ir
+
+#endif /* INTERPRETER_HPP */
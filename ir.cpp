@@ -0,0 +1,557 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "ir.hpp"
+
+namespace ir {
+
+const char* typeName(Type t) {
+    switch (t) {
+        case Type::Void: return "void";
+        case Type::Int: return "int";
+        case Type::Float: return "float";
+        case Type::Bool: return "bool";
+    }
+    return "?";
+}
+
+const char* opcodeName(Opcode op) {
+    switch (op) {
+        case Opcode::Copy: return "copy";
+        case Opcode::Neg: return "neg";
+        case Opcode::Add: return "add";
+        case Opcode::Sub: return "sub";
+        case Opcode::Mul: return "mul";
+        case Opcode::Div: return "div";
+        case Opcode::CmpEq: return "eq";
+        case Opcode::CmpNe: return "ne";
+        case Opcode::CmpLt: return "lt";
+        case Opcode::CmpGt: return "gt";
+        case Opcode::CmpLe: return "le";
+        case Opcode::CmpGe: return "ge";
+        case Opcode::IntToFloat: return "itof";
+        case Opcode::IntToBool: return "itob";
+        case Opcode::LoadGlobal: return "load";
+        case Opcode::StoreGlobal: return "store";
+        case Opcode::Call: return "call";
+        case Opcode::Print: return "print";
+        case Opcode::Br: return "br";
+        case Opcode::CondBr: return "condbr";
+        case Opcode::Ret: return "ret";
+        case Opcode::Phi: return "phi";
+        case Opcode::Count: return "count";
+    }
+    return "?";
+}
+
+bool isTerminator(Opcode op) {
+    return op == Opcode::Br || op == Opcode::CondBr || op == Opcode::Ret;
+}
+
+bool isCompare(Opcode op) {
+    switch (op) {
+        case Opcode::CmpEq:
+        case Opcode::CmpNe:
+        case Opcode::CmpLt:
+        case Opcode::CmpGt:
+        case Opcode::CmpLe:
+        case Opcode::CmpGe:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Opcode swapCompare(Opcode op) {
+    switch (op) {
+        case Opcode::CmpLt: return Opcode::CmpGt;
+        case Opcode::CmpGt: return Opcode::CmpLt;
+        case Opcode::CmpLe: return Opcode::CmpGe;
+        case Opcode::CmpGe: return Opcode::CmpLe;
+        default: return op;
+    }
+}
+
+Opcode invertCompare(Opcode op) {
+    switch (op) {
+        case Opcode::CmpEq: return Opcode::CmpNe;
+        case Opcode::CmpNe: return Opcode::CmpEq;
+        case Opcode::CmpLt: return Opcode::CmpGe;
+        case Opcode::CmpGt: return Opcode::CmpLe;
+        case Opcode::CmpLe: return Opcode::CmpGt;
+        default: return Opcode::CmpLt;
+    }
+}
+
+bool isBinary(Opcode op) {
+    switch (op) {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+            return true;
+        default:
+            return isCompare(op);
+    }
+}
+
+// ===============================
+// Operand
+// ===============================
+
+Operand Operand::ofReg(int r, Type t) {
+    Operand o;
+    o.kind = Kind::Reg;
+    o.reg = r;
+    o.type = t;
+    return o;
+}
+
+Operand Operand::ofInt(int32_t v) {
+    Operand o;
+    o.kind = Kind::Imm;
+    o.type = Type::Int;
+    o.intValue = v;
+    return o;
+}
+
+Operand Operand::ofBool(bool v) {
+    Operand o;
+    o.kind = Kind::Imm;
+    o.type = Type::Bool;
+    o.intValue = v ? 1 : 0;
+    return o;
+}
+
+Operand Operand::ofFloat(float v) {
+    Operand o;
+    o.kind = Kind::Imm;
+    o.type = Type::Float;
+    o.floatValue = v;
+    return o;
+}
+
+bool Operand::operator==(const Operand& other) const {
+    if (kind != other.kind || type != other.type) {
+        return false;
+    }
+    if (kind == Kind::Reg) {
+        return reg == other.reg;
+    }
+    if (kind == Kind::Imm) {
+        if (type == Type::Float) {
+            // Compare bit patterns so that 0.0 and -0.0 stay distinct.
+            uint32_t a = 0;
+            uint32_t b = 0;
+            std::memcpy(&a, &floatValue, sizeof(a));
+            std::memcpy(&b, &other.floatValue, sizeof(b));
+            return a == b;
+        }
+        return intValue == other.intValue;
+    }
+    return true;
+}
+
+// ===============================
+// Instr / BasicBlock / Function
+// ===============================
+
+bool Instr::hasSideEffects() const {
+    switch (op) {
+        case Opcode::StoreGlobal:
+        case Opcode::Call:
+        case Opcode::Print:
+        case Opcode::Count:
+        case Opcode::Br:
+        case Opcode::CondBr:
+        case Opcode::Ret:
+            return true;
+        case Opcode::Div: {
+            // Division may jump to the div_by_zero handler unless the
+            // divisor is a non-zero constant. divisorNonZero does not
+            // count: it may rest on a branch the division must stay under.
+            const Operand& d = args[1];
+            bool nonZero = d.isImm() && (d.type == Type::Float
+                                             ? d.floatValue != 0.0f
+                                             : d.intValue != 0);
+            return !nonZero;
+        }
+        default:
+            return false;
+    }
+}
+
+std::vector<int> BasicBlock::successors() const {
+    if (!terminated()) {
+        return {};
+    }
+    return terminator().targets;
+}
+
+void BasicBlock::removeIncoming(int pred) {
+    for (Instr& instr : instrs) {
+        if (instr.op != Opcode::Phi) {
+            break;
+        }
+        for (size_t i = 0; i < instr.targets.size();) {
+            if (instr.targets[i] == pred) {
+                instr.targets.erase(instr.targets.begin() + i);
+                instr.args.erase(instr.args.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+void BasicBlock::replaceIncoming(int oldPred, int newPred) {
+    for (Instr& instr : instrs) {
+        if (instr.op != Opcode::Phi) {
+            break;
+        }
+        for (int& t : instr.targets) {
+            if (t == oldPred) {
+                t = newPred;
+            }
+        }
+    }
+}
+
+int Function::newVReg(Type t, const std::string& regName) {
+    vregs.push_back({t, regName});
+    return static_cast<int>(vregs.size()) - 1;
+}
+
+BasicBlock* Function::newBlock(const std::string& hint) {
+    auto block = std::make_unique<BasicBlock>();
+    block->id = static_cast<int>(blocks.size());
+    block->hint = hint;
+    blocks.push_back(std::move(block));
+    return blocks.back().get();
+}
+
+void Function::renumberBlocks() {
+    // Old id -> new id, -1 for erased blocks.
+    int maxId = 0;
+    for (const auto& b : blocks) {
+        maxId = std::max(maxId, b->id);
+    }
+    std::vector<int> remap(maxId + 1, -1);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        remap[blocks[i]->id] = static_cast<int>(i);
+    }
+    for (auto& b : blocks) {
+        b->id = remap[b->id];
+        for (Instr& instr : b->instrs) {
+            for (int& t : instr.targets) {
+                t = remap[t];
+            }
+        }
+    }
+}
+
+bool Function::removeUnreachableBlocks() {
+    std::vector<bool> reachable(blocks.size(), false);
+    std::vector<int> worklist = {0};
+    reachable[0] = true;
+    while (!worklist.empty()) {
+        int b = worklist.back();
+        worklist.pop_back();
+        for (int s : blocks[b]->successors()) {
+            if (!reachable[s]) {
+                reachable[s] = true;
+                worklist.push_back(s);
+            }
+        }
+    }
+
+    if (std::find(reachable.begin(), reachable.end(), false) == reachable.end()) {
+        return false;
+    }
+    std::vector<std::unique_ptr<BasicBlock>> kept;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (!reachable[i]) {
+            for (int s : blocks[i]->successors()) {
+                blocks[s]->removeIncoming(static_cast<int>(i));
+            }
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (reachable[i]) {
+            kept.push_back(std::move(blocks[i]));
+        }
+    }
+    blocks = std::move(kept);
+    renumberBlocks();
+    return true;
+}
+
+Function* Module::findFunction(const std::string& label) const {
+    for (const auto& fn : functions) {
+        if (fn->label == label) {
+            return fn.get();
+        }
+    }
+    return nullptr;
+}
+
+const Global* Module::findGlobal(const std::string& name) const {
+    for (const auto& g : globals) {
+        if (g.name == name) {
+            return &g;
+        }
+    }
+    return nullptr;
+}
+
+// ===============================
+// Constant folding
+// ===============================
+
+static bool compareValues(Opcode op, const Operand& a, const Operand& b) {
+    if (a.type == Type::Float) {
+        float x = a.floatValue;
+        float y = b.floatValue;
+        switch (op) {
+            case Opcode::CmpEq: return x == y;
+            case Opcode::CmpNe: return x != y;
+            case Opcode::CmpLt: return x < y;
+            case Opcode::CmpGt: return x > y;
+            case Opcode::CmpLe: return x <= y;
+            default: return x >= y;
+        }
+    }
+    int32_t x = a.intValue;
+    int32_t y = b.intValue;
+    switch (op) {
+        case Opcode::CmpEq: return x == y;
+        case Opcode::CmpNe: return x != y;
+        case Opcode::CmpLt: return x < y;
+        case Opcode::CmpGt: return x > y;
+        case Opcode::CmpLe: return x <= y;
+        default: return x >= y;
+    }
+}
+
+bool foldConstant(Opcode op, Type type, const std::vector<Operand>& args,
+                  Operand& result) {
+    for (const Operand& a : args) {
+        if (!a.isImm()) {
+            return false;
+        }
+    }
+
+    if (isCompare(op)) {
+        result = Operand::ofBool(compareValues(op, args[0], args[1]));
+        return true;
+    }
+
+    switch (op) {
+        case Opcode::Copy:
+            result = args[0];
+            return true;
+        case Opcode::IntToFloat:
+            result = Operand::ofFloat(static_cast<float>(args[0].intValue));
+            return true;
+        case Opcode::IntToBool:
+            result = Operand::ofBool(args[0].intValue != 0);
+            return true;
+        case Opcode::Neg:
+            if (type == Type::Float) {
+                result = Operand::ofFloat(-args[0].floatValue);
+            } else {
+                result = Operand::ofInt(static_cast<int32_t>(
+                    0u - static_cast<uint32_t>(args[0].intValue)));
+            }
+            return true;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+            break;
+        default:
+            return false;
+    }
+
+    if (type == Type::Float) {
+        float x = args[0].floatValue;
+        float y = args[1].floatValue;
+        switch (op) {
+            case Opcode::Add: result = Operand::ofFloat(x + y); return true;
+            case Opcode::Sub: result = Operand::ofFloat(x - y); return true;
+            case Opcode::Mul: result = Operand::ofFloat(x * y); return true;
+            default:
+                if (y == 0.0f) {
+                    return false;
+                }
+                result = Operand::ofFloat(x / y);
+                return true;
+        }
+    }
+
+    uint32_t x = static_cast<uint32_t>(args[0].intValue);
+    uint32_t y = static_cast<uint32_t>(args[1].intValue);
+    switch (op) {
+        case Opcode::Add:
+            result = Operand::ofInt(static_cast<int32_t>(x + y));
+            return true;
+        case Opcode::Sub:
+            result = Operand::ofInt(static_cast<int32_t>(x - y));
+            return true;
+        case Opcode::Mul:
+            result = Operand::ofInt(static_cast<int32_t>(x * y));
+            return true;
+        default:
+            // INT_MIN / -1 overflows; leave it to the hardware.
+            if (args[1].intValue == 0 ||
+                (args[0].intValue == INT32_MIN && args[1].intValue == -1)) {
+                return false;
+            }
+            result = Operand::ofInt(args[0].intValue / args[1].intValue);
+            return true;
+    }
+}
+
+// ===============================
+// Printing
+// ===============================
+
+void printOperand(std::ostream& os, const Function& fn, const Operand& op) {
+    switch (op.kind) {
+        case Operand::Kind::None:
+            os << "_";
+            break;
+        case Operand::Kind::Reg:
+            os << "%";
+            if (op.reg < static_cast<int>(fn.vregs.size()) &&
+                !fn.vregs[op.reg].name.empty()) {
+                os << fn.vregs[op.reg].name << ".";
+            }
+            os << op.reg;
+            break;
+        case Operand::Kind::Imm:
+            if (op.type == Type::Float) {
+                std::ostringstream f;
+                f << std::setprecision(9) << op.floatValue;
+                std::string s = f.str();
+                if (s.find_first_of(".eni") == std::string::npos) {
+                    s += ".0";
+                }
+                os << s;
+            } else if (op.type == Type::Bool) {
+                os << (op.intValue ? "true" : "false");
+            } else {
+                os << op.intValue;
+            }
+            break;
+    }
+}
+
+void printInstr(std::ostream& os, const Function& fn, const Instr& instr) {
+    if (instr.dst >= 0) {
+        printOperand(os, fn, Operand::ofReg(instr.dst, instr.type));
+        os << ":" << typeName(instr.type) << " = ";
+    }
+    os << opcodeName(instr.op);
+
+    switch (instr.op) {
+        case Opcode::LoadGlobal:
+            os << " @" << instr.symbol;
+            return;
+        case Opcode::StoreGlobal:
+            os << " @" << instr.symbol << ", ";
+            printOperand(os, fn, instr.args[0]);
+            return;
+        case Opcode::Call:
+            os << " " << instr.symbol << "(";
+            for (size_t i = 0; i < instr.args.size(); ++i) {
+                if (i) {
+                    os << ", ";
+                }
+                printOperand(os, fn, instr.args[i]);
+            }
+            os << ")";
+            if (instr.count >= 0) {
+                os << "  ; count " << instr.count;
+            }
+            return;
+        case Opcode::Br:
+            os << " bb" << instr.targets[0];
+            return;
+        case Opcode::CondBr:
+            os << " ";
+            printOperand(os, fn, instr.args[0]);
+            os << ", bb" << instr.targets[0] << ", bb" << instr.targets[1];
+            return;
+        case Opcode::Phi:
+            for (size_t i = 0; i < instr.args.size(); ++i) {
+                os << (i ? ", [" : " [");
+                printOperand(os, fn, instr.args[i]);
+                os << ", bb" << instr.targets[i] << "]";
+            }
+            return;
+        default:
+            break;
+    }
+
+    for (size_t i = 0; i < instr.args.size(); ++i) {
+        os << (i ? ", " : " ");
+        printOperand(os, fn, instr.args[i]);
+    }
+    if (instr.divisorNonZero) {
+        os << "  ; divisor != 0";
+    }
+}
+
+void printFunction(std::ostream& os, const Function& fn) {
+    os << "func " << fn.label << "(";
+    for (size_t i = 0; i < fn.params.size(); ++i) {
+        if (i) {
+            os << ", ";
+        }
+        int r = fn.params[i];
+        printOperand(os, fn, Operand::ofReg(r, fn.regType(r)));
+        os << ":" << typeName(fn.regType(r));
+    }
+    os << ") -> " << typeName(fn.retType);
+    if (fn.memoEntries > 0) {
+        os << " memoized(" << fn.memoEntries << ")";
+    }
+    os << " {\n";
+    for (const auto& block : fn.blocks) {
+        os << "bb" << block->id << ":";
+        if (!block->hint.empty()) {
+            os << "  ; " << block->hint;
+        }
+        if (block->count >= 0) {
+            os << (block->hint.empty() ? "  ; " : ", ") << "count " << block->count;
+        }
+        os << "\n";
+        for (const Instr& instr : block->instrs) {
+            os << "    ";
+            printInstr(os, fn, instr);
+            os << "\n";
+        }
+    }
+    os << "}\n";
+}
+
+void printModule(std::ostream& os, const Module& module) {
+    for (const auto& g : module.globals) {
+        os << "global @" << g.name << ": " << typeName(g.type) << "\n";
+    }
+    if (!module.globals.empty()) {
+        os << "\n";
+    }
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+        if (i) {
+            os << "\n";
+        }
+        printFunction(os, *module.functions[i]);
+    }
+}
+
+}  // namespace ir
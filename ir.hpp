@@ -0,0 +1,185 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ===============================
+// Three-address intermediate representation
+// ===============================
+// A function is a list of basic blocks; blocks[0] is the entry. Every
+// block ends in exactly one terminator (Br, CondBr or Ret). Values live in
+// typed virtual registers; source variables get one register each and are
+// re-assigned with Copy, temporaries are assigned once. The ssa pass
+// rewrites a function so that every register has a single definition,
+// joining values at merge points with Phi; phis are replaced by copies
+// again before code generation.
+
+namespace ir {
+
+enum class Type {
+    Void,
+    Int,
+    Float,
+    Bool
+};
+
+const char* typeName(Type t);
+
+enum class Opcode {
+    Copy,         // dst = a
+    Neg,          // dst = -a
+    Add,          // dst = a + b
+    Sub,          // dst = a - b
+    Mul,          // dst = a * b
+    Div,          // dst = a / b, traps to div_by_zero when b == 0
+    CmpEq,        // dst:bool = a == b
+    CmpNe,        // dst:bool = a != b
+    CmpLt,        // dst:bool = a < b
+    CmpGt,        // dst:bool = a > b
+    CmpLe,        // dst:bool = a <= b
+    CmpGe,        // dst:bool = a >= b
+    IntToFloat,   // dst:float = a
+    IntToBool,    // dst:bool = a != 0
+    LoadGlobal,   // dst = @symbol
+    StoreGlobal,  // @symbol = a
+    Call,         // dst = call symbol(args...)
+    Print,        // print a
+    Br,           // br targets[0]
+    CondBr,       // condbr a, targets[0], targets[1]
+    Ret,          // ret [a]
+    Phi,          // dst = args[i] when entered from block targets[i]
+    Count         // profile counter a += 1 (-fprofile-generate, see profile.hpp)
+};
+
+const char* opcodeName(Opcode op);
+bool isTerminator(Opcode op);
+bool isCompare(Opcode op);
+// `a pred b` written as `b pred' a`.
+Opcode swapCompare(Opcode op);
+// The predicate that holds exactly when `op` does not (on ints; NaN makes
+// every float comparison but CmpNe false).
+Opcode invertCompare(Opcode op);
+bool isBinary(Opcode op);
+
+// An instruction operand: a virtual register or an immediate constant.
+struct Operand {
+    enum class Kind { None, Reg, Imm };
+
+    Kind kind = Kind::None;
+    Type type = Type::Void;
+    int reg = -1;
+    int32_t intValue = 0;   // Int and Bool immediates
+    float floatValue = 0.0f;
+
+    static Operand ofReg(int r, Type t);
+    static Operand ofInt(int32_t v);
+    static Operand ofBool(bool v);
+    static Operand ofFloat(float v);
+
+    bool isReg() const { return kind == Kind::Reg; }
+    bool isImm() const { return kind == Kind::Imm; }
+    bool operator==(const Operand& other) const;
+    bool operator!=(const Operand& other) const { return !(*this == other); }
+};
+
+struct Instr {
+    Opcode op;
+    Type type = Type::Void;      // result type, or type of the value used
+    int dst = -1;                // destination register, -1 if none
+    std::vector<Operand> args;
+    std::string symbol;          // callee label or global name
+    std::vector<int> targets;    // successor block ids of Br/CondBr, incoming blocks of Phi
+    bool divisorNonZero = false; // Div: the divisor was proven non-zero, no run-time check
+    int64_t count = -1;          // Call: times it ran in the profile (-fprofile-use), -1 unknown
+
+    Instr(Opcode o, Type t, int d, std::vector<Operand> a = {})
+        : op(o), type(t), dst(d), args(std::move(a)) {}
+
+    bool hasSideEffects() const;
+};
+
+struct BasicBlock {
+    int id = 0;
+    std::string hint;            // origin in the source, e.g. "while.body"
+    std::vector<Instr> instrs;
+    int64_t count = -1;          // times it ran in the profile (-fprofile-use), -1 unknown
+
+    bool terminated() const {
+        return !instrs.empty() && isTerminator(instrs.back().op);
+    }
+    Instr& terminator() { return instrs.back(); }
+    const Instr& terminator() const { return instrs.back(); }
+    std::vector<int> successors() const;
+
+    // Phis sit at the top of a block; these keep them in step with edits
+    // to the edge coming from `pred`.
+    void removeIncoming(int pred);
+    void replaceIncoming(int oldPred, int newPred);
+};
+
+struct VReg {
+    Type type;
+    std::string name;            // source variable name, empty for temporaries
+};
+
+struct Function {
+    std::string name;            // source-level name
+    std::string label;           // assembly label
+    Type retType = Type::Int;
+    std::vector<int> params;     // registers bound to the arguments
+    std::vector<VReg> vregs;
+    std::vector<std::unique_ptr<BasicBlock>> blocks;
+    bool ssa = false;            // registers are single-assignment, phis allowed
+    int memoEntries = 0;         // > 0: results cached in a table of this size (memoize)
+
+    int newVReg(Type t, const std::string& name = "");
+    BasicBlock* newBlock(const std::string& hint = "");
+    BasicBlock* entry() const { return blocks.front().get(); }
+    Type regType(int r) const { return vregs[r].type; }
+
+    // Deletes blocks not reachable from the entry (and phi inputs coming
+    // from them) and renumbers the rest. Returns true if anything was
+    // removed.
+    bool removeUnreachableBlocks();
+    // Renumbers blocks after the caller reordered or erased entries.
+    void renumberBlocks();
+};
+
+struct Global {
+    std::string name;
+    Type type;
+};
+
+struct Module {
+    std::vector<Global> globals;
+    std::vector<std::unique_ptr<Function>> functions;
+    // -fprofile-generate: the Count instructions address counters
+    // 0..profileCounters-1, written to profileFile at exit.
+    int profileCounters = 0;
+    uint32_t profileChecksum = 0;
+    std::string profileFile;
+
+    Function* findFunction(const std::string& label) const;
+    const Global* findGlobal(const std::string& name) const;
+};
+
+// Evaluates `op` on constant operands the way the generated code would
+// (wrapping int arithmetic, single-precision floats). Returns false when
+// the result is not a compile-time constant, including every division
+// that would trap at run time.
+bool foldConstant(Opcode op, Type type, const std::vector<Operand>& args,
+                  Operand& result);
+
+// Text dump used by --dump-ir.
+void printOperand(std::ostream& os, const Function& fn, const Operand& op);
+void printInstr(std::ostream& os, const Function& fn, const Instr& instr);
+void printFunction(std::ostream& os, const Function& fn);
+void printModule(std::ostream& os, const Module& module);
+
+}  // namespace ir
+
+#endif /* IR_HPP */
@@ -0,0 +1,774 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include "ir_analysis.hpp"
+
+namespace ir {
+
+// ===============================
+// BitSet
+// ===============================
+
+BitSet::BitSet(size_t n, bool full) : words((n + 63) / 64, 0), bits(n) {
+    if (full) {
+        setAll();
+    }
+}
+
+void BitSet::setAll() {
+    std::fill(words.begin(), words.end(), ~uint64_t(0));
+    if (bits % 64 != 0 && !words.empty()) {
+        words.back() = (uint64_t(1) << (bits % 64)) - 1;
+    }
+}
+
+void BitSet::clearAll() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+bool BitSet::unionWith(const BitSet& other) {
+    bool changed = false;
+    for (size_t i = 0; i < words.size(); ++i) {
+        uint64_t merged = words[i] | other.words[i];
+        changed = changed || merged != words[i];
+        words[i] = merged;
+    }
+    return changed;
+}
+
+bool BitSet::intersectWith(const BitSet& other) {
+    bool changed = false;
+    for (size_t i = 0; i < words.size(); ++i) {
+        uint64_t merged = words[i] & other.words[i];
+        changed = changed || merged != words[i];
+        words[i] = merged;
+    }
+    return changed;
+}
+
+void BitSet::subtract(const BitSet& other) {
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] &= ~other.words[i];
+    }
+}
+
+bool BitSet::any() const {
+    for (uint64_t w : words) {
+        if (w) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t BitSet::count() const {
+    size_t n = 0;
+    for (uint64_t w : words) {
+        n += __builtin_popcountll(w);
+    }
+    return n;
+}
+
+// ===============================
+// CFG
+// ===============================
+
+// Iterative depth-first search; recursion would overflow the stack on the
+// very long block chains some generated programs produce. Successors are
+// explored last to first: lowering lists a loop's body before its exit, so
+// the body ends up ahead of the code after the loop. Otherwise every back
+// edge would make the dataflow solver sweep the rest of the function again.
+static std::vector<int> reversePostOrder(int n, int root,
+                                         const std::vector<std::vector<int>>& out) {
+    std::vector<int> order;
+    std::vector<char> seen(n, 0);
+    std::vector<std::pair<int, size_t>> stack;
+    stack.emplace_back(root, 0);
+    seen[root] = 1;
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next < out[node].size()) {
+            int succ = out[node][out[node].size() - 1 - next++];
+            if (!seen[succ]) {
+                seen[succ] = 1;
+                stack.emplace_back(succ, 0);
+            }
+        } else {
+            order.push_back(node);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+CFG::CFG(Function& fn, AnalysisManager&) {
+    int n = static_cast<int>(fn.blocks.size());
+    succs.resize(n);
+    preds.resize(n);
+    for (const auto& block : fn.blocks) {
+        for (int s : block->successors()) {
+            // condbr with identical targets is a single edge
+            if (std::find(succs[block->id].begin(), succs[block->id].end(), s) ==
+                succs[block->id].end()) {
+                succs[block->id].push_back(s);
+                preds[s].push_back(block->id);
+            }
+        }
+        if (block->terminated() && block->terminator().op == Opcode::Ret) {
+            exits.push_back(block->id);
+        }
+    }
+
+    rpo = reversePostOrder(n, 0, succs);
+    rpoIndex.assign(n, -1);
+    for (size_t i = 0; i < rpo.size(); ++i) {
+        rpoIndex[rpo[i]] = static_cast<int>(i);
+    }
+}
+
+// ===============================
+// Dominator trees
+// ===============================
+
+void DomTreeBase::build(int n, const std::vector<int>& order,
+                        const std::vector<std::vector<int>>& in) {
+    std::vector<int> index(n, -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        index[order[i]] = static_cast<int>(i);
+    }
+
+    idom.assign(n, -1);
+    int root = order[0];
+    idom[root] = root;
+
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (index[a] > index[b]) {
+                a = idom[a];
+            }
+            while (index[b] > index[a]) {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); ++i) {
+            int b = order[i];
+            int newIdom = -1;
+            for (int p : in[b]) {
+                if (index[p] < 0 || idom[p] < 0) {
+                    continue;
+                }
+                newIdom = newIdom < 0 ? p : intersect(p, newIdom);
+            }
+            if (newIdom != idom[b]) {
+                idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    idom[root] = -1;
+
+    kids.assign(n, {});
+    for (int b : order) {
+        if (idom[b] >= 0) {
+            kids[idom[b]].push_back(b);
+        }
+    }
+
+    // Pre/post numbering of the tree answers dominance queries in O(1).
+    pre.assign(n, -1);
+    post.assign(n, -1);
+    level.assign(n, 0);
+    int counter = 0;
+    std::vector<std::pair<int, size_t>> stack;
+    stack.emplace_back(root, 0);
+    pre[root] = counter++;
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next < kids[node].size()) {
+            int child = kids[node][next++];
+            pre[child] = counter++;
+            level[child] = level[node] + 1;
+            stack.emplace_back(child, 0);
+        } else {
+            post[node] = counter++;
+            stack.pop_back();
+        }
+    }
+}
+
+bool DomTreeBase::dominates(int a, int b) const {
+    if (pre[a] < 0 || pre[b] < 0) {
+        return false;
+    }
+    return pre[a] <= pre[b] && post[b] <= post[a];
+}
+
+DominatorTree::DominatorTree(Function& fn, AnalysisManager& am) {
+    CFG& cfg = am.get<CFG>(fn);
+    int n = cfg.numBlocks();
+    build(n, cfg.rpo, cfg.preds);
+
+    // Cooper-Harvey-Kennedy frontiers: walk up from each predecessor of a
+    // join point until reaching the join's immediate dominator.
+    df.assign(n, {});
+    for (int b : cfg.rpo) {
+        if (cfg.preds[b].size() < 2) {
+            continue;
+        }
+        for (int p : cfg.preds[b]) {
+            if (!cfg.reachable(p)) {
+                continue;
+            }
+            for (int runner = p; runner >= 0 && runner != idom[b];
+                 runner = idom[runner]) {
+                if (df[runner].empty() || df[runner].back() != b) {
+                    df[runner].push_back(b);
+                }
+            }
+        }
+    }
+}
+
+PostDominatorTree::PostDominatorTree(Function& fn, AnalysisManager& am) {
+    CFG& cfg = am.get<CFG>(fn);
+    int n = cfg.numBlocks();
+    int exit = n;
+
+    // Walk the reversed graph from a virtual exit node.
+    std::vector<std::vector<int>> reversed(n + 1);
+    std::vector<std::vector<int>> in(n + 1);
+    for (int b = 0; b < n; ++b) {
+        if (!cfg.reachable(b)) {
+            continue;
+        }
+        reversed[b] = cfg.preds[b];
+        in[b] = cfg.succs[b];
+    }
+    for (int b : cfg.exits) {
+        if (cfg.reachable(b)) {
+            reversed[exit].push_back(b);
+            in[b].push_back(exit);
+        }
+    }
+    build(n + 1, reversePostOrder(n + 1, exit, reversed), in);
+
+    for (int b = 0; b < n; ++b) {
+        if (idom[b] == exit) {
+            idom[b] = -1;
+        }
+    }
+}
+
+// ===============================
+// Loops
+// ===============================
+
+LoopInfo::LoopInfo(Function& fn, AnalysisManager& am) {
+    CFG& cfg = am.get<CFG>(fn);
+    DominatorTree& dt = am.get<DominatorTree>(fn);
+    int n = cfg.numBlocks();
+    innermost.assign(n, -1);
+
+    auto outermost = [&](int loop) {
+        while (loops[loop].parent >= 0) {
+            loop = loops[loop].parent;
+        }
+        return loop;
+    };
+
+    // Headers are visited bottom-up in reverse RPO so inner loops exist
+    // before their parents; a parent's walk then hops over each inner loop
+    // through its header instead of revisiting its blocks.
+    for (auto it = cfg.rpo.rbegin(); it != cfg.rpo.rend(); ++it) {
+        int header = *it;
+        std::vector<int> latches;
+        for (int p : cfg.preds[header]) {
+            if (cfg.reachable(p) && dt.dominates(header, p)) {
+                latches.push_back(p);
+            }
+        }
+        if (latches.empty()) {
+            continue;
+        }
+
+        int id = static_cast<int>(loops.size());
+        loops.emplace_back();
+        loops[id].header = header;
+        loops[id].latches = latches;
+        innermost[header] = id;
+
+        std::vector<int> work = latches;
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            if (b == header) {
+                continue;
+            }
+            if (innermost[b] < 0) {
+                innermost[b] = id;
+                for (int p : cfg.preds[b]) {
+                    if (cfg.reachable(p)) {
+                        work.push_back(p);
+                    }
+                }
+                continue;
+            }
+            int sub = outermost(innermost[b]);
+            if (sub == id) {
+                continue;
+            }
+            loops[sub].parent = id;
+            for (int p : cfg.preds[loops[sub].header]) {
+                if (cfg.reachable(p)) {
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+
+    // Parents are created after their children.
+    for (int i = static_cast<int>(loops.size()) - 1; i >= 0; --i) {
+        int parent = loops[i].parent;
+        if (parent >= 0) {
+            loops[i].depth = loops[parent].depth + 1;
+            loops[parent].children.push_back(i);
+        }
+    }
+    for (int b : cfg.rpo) {
+        for (int l = innermost[b]; l >= 0; l = loops[l].parent) {
+            loops[l].blocks.push_back(b);
+        }
+    }
+}
+
+bool LoopInfo::contains(int loop, int block) const {
+    for (int l = innermost[block]; l >= 0; l = loops[l].parent) {
+        if (l == loop) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<int> LoopInfo::exitBlocks(int loop, const CFG& cfg) const {
+    std::vector<int> exits;
+    for (int b : loops[loop].blocks) {
+        for (int s : cfg.succs[b]) {
+            if (!contains(loop, s) &&
+                std::find(exits.begin(), exits.end(), s) == exits.end()) {
+                exits.push_back(s);
+            }
+        }
+    }
+    return exits;
+}
+
+// ===============================
+// Dataflow
+// ===============================
+
+DataflowResult solveDataflow(const CFG& cfg, const DataflowProblem& problem) {
+    int n = cfg.numBlocks();
+    bool forward = problem.direction == Direction::Forward;
+    bool unionMeet = problem.meet == Meet::Union;
+
+    DataflowResult result;
+    result.in.assign(n, BitSet(problem.width));
+    result.out.assign(n, BitSet(problem.width));
+
+    // `before` is the value flowing into a block in the direction of the
+    // analysis, `after` the value it produces.
+    std::vector<BitSet>& before = forward ? result.in : result.out;
+    std::vector<BitSet>& after = forward ? result.out : result.in;
+    const std::vector<std::vector<int>>& sources = forward ? cfg.preds : cfg.succs;
+    const std::vector<std::vector<int>>& sinks = forward ? cfg.succs : cfg.preds;
+
+    if (!unionMeet) {
+        for (int b : cfg.rpo) {
+            after[b].setAll();
+        }
+    }
+
+    // Blocks are prioritized by their position in the visiting order.
+    std::vector<int> order = cfg.rpo;
+    if (!forward) {
+        std::reverse(order.begin(), order.end());
+    }
+    std::vector<int> position(n, -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        position[order[i]] = static_cast<int>(i);
+    }
+    std::priority_queue<int, std::vector<int>, std::greater<int>> work;
+    std::vector<char> queued(n, 0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        work.push(static_cast<int>(i));
+        queued[order[i]] = 1;
+    }
+
+    const std::vector<int> noGroups;
+    BitSet value(problem.width);
+    while (!work.empty()) {
+        int b = order[work.top()];
+        work.pop();
+        queued[b] = 0;
+
+        bool boundary = forward ? b == cfg.rpo[0] : sources[b].empty();
+        if (boundary) {
+            value = problem.boundary;
+        } else if (unionMeet) {
+            value.clearAll();
+        } else {
+            value.setAll();
+        }
+        for (int s : sources[b]) {
+            if (!cfg.reachable(s)) {
+                continue;
+            }
+            if (unionMeet) {
+                value.unionWith(after[s]);
+            } else {
+                value.intersectWith(after[s]);
+            }
+        }
+        before[b] = value;
+
+        if (!problem.kill.empty()) {
+            value.subtract(problem.kill[b]);
+        }
+        for (int g : problem.killGroups.empty() ? noGroups : problem.killGroups[b]) {
+            value.subtract(problem.groups[g]);
+        }
+        value.unionWith(problem.gen[b]);
+        if (value != after[b]) {
+            after[b] = value;
+            for (int s : sinks[b]) {
+                if (cfg.reachable(s) && !queued[s]) {
+                    queued[s] = 1;
+                    work.push(position[s]);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Registers read in some block before being written there. Only these can
+// be live at, or defined across, a block boundary; everything else (most
+// temporaries) is produced and consumed inside one block.
+static std::vector<int> crossBlockRegisters(const Function& fn) {
+    std::vector<char> crosses(fn.vregs.size(), 0);
+    std::vector<int> definedIn(fn.vregs.size(), -1);
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            // Phi operands are read on the incoming edge, in another block.
+            bool phi = instr.op == Opcode::Phi;
+            forEachUse(instr, [&](int r) {
+                if (phi || definedIn[r] != block->id) {
+                    crosses[r] = 1;
+                }
+            });
+            if (instr.dst >= 0) {
+                definedIn[instr.dst] = block->id;
+            }
+        }
+    }
+    std::vector<int> regs;
+    for (size_t r = 0; r < crosses.size(); ++r) {
+        if (crosses[r]) {
+            regs.push_back(static_cast<int>(r));
+        }
+    }
+    return regs;
+}
+
+Liveness::Liveness(Function& fn, AnalysisManager& am) {
+    CFG& cfg = am.get<CFG>(fn);
+    int n = cfg.numBlocks();
+
+    tracked = crossBlockRegisters(fn);
+    index.assign(fn.vregs.size(), -1);
+    for (size_t i = 0; i < tracked.size(); ++i) {
+        index[tracked[i]] = static_cast<int>(i);
+    }
+
+    DataflowProblem problem;
+    problem.direction = Direction::Backward;
+    problem.meet = Meet::Union;
+    problem.width = tracked.size();
+    problem.gen.assign(n, BitSet(problem.width));
+    problem.kill.assign(n, BitSet(problem.width));
+    problem.boundary = BitSet(problem.width);
+
+    for (const auto& block : fn.blocks) {
+        BitSet& uses = problem.gen[block->id];
+        BitSet& defs = problem.kill[block->id];
+        for (const Instr& instr : block->instrs) {
+            if (instr.op != Opcode::Phi) {
+                forEachUse(instr, [&](int r) {
+                    if (index[r] >= 0 && !defs.test(index[r])) {
+                        uses.set(index[r]);
+                    }
+                });
+            }
+            if (instr.dst >= 0 && index[instr.dst] >= 0) {
+                defs.set(index[instr.dst]);
+            }
+        }
+    }
+
+    // A phi reads its operand at the end of the incoming block.
+    std::vector<std::pair<int, int>> phiUses;
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            if (instr.op != Opcode::Phi) {
+                break;
+            }
+            for (size_t i = 0; i < instr.args.size(); ++i) {
+                if (instr.args[i].isReg()) {
+                    int pred = instr.targets[i];
+                    int bit = index[instr.args[i].reg];
+                    phiUses.emplace_back(pred, bit);
+                    if (!problem.kill[pred].test(bit)) {
+                        problem.gen[pred].set(bit);
+                    }
+                }
+            }
+        }
+    }
+
+    DataflowResult result = solveDataflow(cfg, problem);
+    liveIn = std::move(result.in);
+    liveOut = std::move(result.out);
+    for (const auto& [pred, bit] : phiUses) {
+        liveOut[pred].set(bit);
+    }
+}
+
+bool Liveness::isLiveIn(int block, int reg) const {
+    return index[reg] >= 0 && liveIn[block].test(index[reg]);
+}
+
+bool Liveness::isLiveOut(int block, int reg) const {
+    return index[reg] >= 0 && liveOut[block].test(index[reg]);
+}
+
+ReachingDefinitions::ReachingDefinitions(Function& fn, AnalysisManager& am) {
+    CFG& cfg = am.get<CFG>(fn);
+    int n = cfg.numBlocks();
+
+    std::vector<char> tracked(fn.vregs.size(), 0);
+    for (int r : crossBlockRegisters(fn)) {
+        tracked[r] = 1;
+    }
+
+    // Number the last definition of every tracked register in each block;
+    // earlier ones are overwritten before the block ends.
+    DataflowProblem problem;
+    problem.direction = Direction::Forward;
+    problem.meet = Meet::Union;
+    defsOfReg.assign(fn.vregs.size(), {});
+    std::vector<std::vector<int>> definedRegs(n);
+    for (int p : fn.params) {
+        if (tracked[p]) {
+            defsOfReg[p].push_back(static_cast<int>(defs.size()));
+            defs.push_back({0, -1, p});
+        }
+    }
+    size_t paramDefs = defs.size();
+    std::vector<int> lastIn(fn.vregs.size(), -1);
+    for (const auto& block : fn.blocks) {
+        std::vector<int>& regs = definedRegs[block->id];
+        for (size_t i = 0; i < block->instrs.size(); ++i) {
+            int dst = block->instrs[i].dst;
+            if (dst < 0 || !tracked[dst]) {
+                continue;
+            }
+            if (lastIn[dst] >= 0 && defs[lastIn[dst]].block == block->id) {
+                defs[lastIn[dst]].index = static_cast<int>(i);
+                continue;
+            }
+            lastIn[dst] = static_cast<int>(defs.size());
+            defsOfReg[dst].push_back(static_cast<int>(defs.size()));
+            defs.push_back({block->id, static_cast<int>(i), dst});
+            regs.push_back(dst);
+        }
+    }
+
+    problem.width = defs.size();
+    problem.gen.assign(n, BitSet(problem.width));
+    problem.boundary = BitSet(problem.width);
+    for (size_t d = 0; d < paramDefs; ++d) {
+        problem.boundary.set(d);
+    }
+    for (size_t d = paramDefs; d < defs.size(); ++d) {
+        problem.gen[defs[d].block].set(d);
+    }
+
+    // A definition kills every other definition of its register; one
+    // shared mask per register keeps the kill sets from growing with the
+    // number of blocks times the number of definitions.
+    std::vector<int> group(fn.vregs.size(), -1);
+    problem.killGroups.assign(n, {});
+    for (int b = 0; b < n; ++b) {
+        for (int r : definedRegs[b]) {
+            if (group[r] < 0) {
+                group[r] = static_cast<int>(problem.groups.size());
+                problem.groups.emplace_back(problem.width);
+                for (int d : defsOfReg[r]) {
+                    problem.groups.back().set(d);
+                }
+            }
+            problem.killGroups[b].push_back(group[r]);
+        }
+    }
+
+    DataflowResult result = solveDataflow(cfg, problem);
+    in = std::move(result.in);
+    out = std::move(result.out);
+}
+
+// ===============================
+// Call graph
+// ===============================
+
+CallGraph::CallGraph(Module& module, AnalysisManager&) {
+    int n = static_cast<int>(module.functions.size());
+    for (int f = 0; f < n; ++f) {
+        functions.push_back(module.functions[f].get());
+        byLabel[functions[f]->label] = f;
+    }
+    callees.assign(n, {});
+    callers.assign(n, {});
+    callSites.assign(n, 0);
+    for (int f = 0; f < n; ++f) {
+        for (const auto& block : functions[f]->blocks) {
+            for (const Instr& instr : block->instrs) {
+                if (instr.op != Opcode::Call) {
+                    continue;
+                }
+                int g = find(instr.symbol);
+                if (g < 0) {
+                    continue;
+                }
+                callSites[g] += 1;
+                if (std::find(callees[f].begin(), callees[f].end(), g) ==
+                    callees[f].end()) {
+                    callees[f].push_back(g);
+                    callers[g].push_back(f);
+                }
+            }
+        }
+    }
+
+    // Tarjan's algorithm, iteratively; components are completed callees
+    // first.
+    std::vector<int> index(n, -1), low(n, 0), stack;
+    std::vector<bool> onStack(n, false);
+    sccOf.assign(n, -1);
+    int counter = 0;
+    for (int root = 0; root < n; ++root) {
+        if (index[root] >= 0) {
+            continue;
+        }
+        std::vector<std::pair<int, size_t>> work = {{root, 0}};
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        onStack[root] = true;
+        while (!work.empty()) {
+            auto& [f, next] = work.back();
+            if (next < callees[f].size()) {
+                int g = callees[f][next++];
+                if (index[g] < 0) {
+                    index[g] = low[g] = counter++;
+                    stack.push_back(g);
+                    onStack[g] = true;
+                    work.emplace_back(g, 0);
+                } else if (onStack[g]) {
+                    low[f] = std::min(low[f], index[g]);
+                }
+                continue;
+            }
+            int done = f;
+            work.pop_back();
+            if (!work.empty()) {
+                int parent = work.back().first;
+                low[parent] = std::min(low[parent], low[done]);
+            }
+            if (low[done] == index[done]) {
+                std::vector<int> scc;
+                int g;
+                do {
+                    g = stack.back();
+                    stack.pop_back();
+                    onStack[g] = false;
+                    sccOf[g] = static_cast<int>(sccs.size());
+                    scc.push_back(g);
+                } while (g != done);
+                sccs.push_back(std::move(scc));
+            }
+        }
+    }
+}
+
+int CallGraph::find(const std::string& label) const {
+    auto it = byLabel.find(label);
+    return it == byLabel.end() ? -1 : it->second;
+}
+
+bool CallGraph::isRecursive(int f) const {
+    if (sccs[sccOf[f]].size() > 1) {
+        return true;
+    }
+    return std::find(callees[f].begin(), callees[f].end(), f) != callees[f].end();
+}
+
+std::vector<bool> CallGraph::reachableFrom(int root) const {
+    std::vector<bool> seen(functions.size(), false);
+    std::vector<int> work = {root};
+    seen[root] = true;
+    while (!work.empty()) {
+        int f = work.back();
+        work.pop_back();
+        for (int g : callees[f]) {
+            if (!seen[g]) {
+                seen[g] = true;
+                work.push_back(g);
+            }
+        }
+    }
+    return seen;
+}
+
+std::vector<bool> CallGraph::pureFunctions() const {
+    // Bottom-up, so callees outside the cycle are already decided.
+    std::vector<bool> pure(functions.size(), false);
+    for (const auto& scc : sccs) {
+        bool ok = true;
+        for (int f : scc) {
+            for (const auto& block : functions[f]->blocks) {
+                for (const Instr& instr : block->instrs) {
+                    ok = ok && instr.op != Opcode::Print && instr.op != Opcode::LoadGlobal &&
+                         instr.op != Opcode::StoreGlobal;
+                }
+            }
+            for (int g : callees[f]) {
+                ok = ok && (pure[g] || sccOf[g] == sccOf[f]);
+            }
+        }
+        for (int f : scc) {
+            pure[f] = ok;
+        }
+    }
+    return pure;
+}
+
+}  // namespace ir
@@ -0,0 +1,279 @@
+#ifndef IR_ANALYSIS_HPP
+#define IR_ANALYSIS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+#include "pass_manager.hpp"
+
+// ===============================
+// IR analyses
+// ===============================
+// Function-level analyses over the control-flow graph of an ir::Function.
+// They are cached by the AnalysisManager and keyed on the function, e.g.
+//     auto& dt = am.get<ir::DominatorTree>(fn);
+// Block ids index every per-block vector; passes that add, remove or
+// reorder blocks must not declare these analyses preserved.
+
+namespace ir {
+
+// Fixed-size set of small integers stored as 64-bit words.
+class BitSet {
+ private:
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+
+ public:
+    BitSet() = default;
+    explicit BitSet(size_t n, bool full = false);
+
+    size_t size() const { return bits; }
+    bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+    void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+    void reset(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+    void setAll();
+    void clearAll();
+
+    // Each returns true if this set changed.
+    bool unionWith(const BitSet& other);
+    bool intersectWith(const BitSet& other);
+    void subtract(const BitSet& other);
+
+    bool any() const;
+    size_t count() const;
+    bool operator==(const BitSet& other) const { return words == other.words; }
+    bool operator!=(const BitSet& other) const { return words != other.words; }
+
+    // Calls f(i) for every member in increasing order.
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t word = words[w];
+            while (word) {
+                int bit = __builtin_ctzll(word);
+                f(w * 64 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+// Successor and predecessor lists plus a reverse post-order of the blocks
+// reachable from the entry.
+class CFG : public AnalysisResult {
+ public:
+    static constexpr const char* name = "cfg";
+
+    std::vector<std::vector<int>> succs;
+    std::vector<std::vector<int>> preds;
+    std::vector<int> rpo;         // reachable blocks, entry first
+    std::vector<int> rpoIndex;    // position in rpo, -1 if unreachable
+    std::vector<int> exits;       // blocks ending in ret
+
+    CFG(Function& fn, AnalysisManager& am);
+
+    int numBlocks() const { return static_cast<int>(succs.size()); }
+    bool reachable(int block) const { return rpoIndex[block] >= 0; }
+};
+
+// Immediate dominators computed with the Cooper-Harvey-Kennedy iteration,
+// which converges in a couple of passes over structured control flow.
+class DomTreeBase : public AnalysisResult {
+ protected:
+    std::vector<int> idom;
+    std::vector<std::vector<int>> kids;
+    std::vector<int> pre, post, level;
+
+    // `order` lists nodes reachable from order[0] in reverse post-order of
+    // the graph described by `in` edges (predecessors in the direction of
+    // the walk); `n` is the node count.
+    void build(int n, const std::vector<int>& order,
+               const std::vector<std::vector<int>>& in);
+
+ public:
+    // -1 for the root, for unreachable blocks and (post-dominators) for
+    // blocks whose only post-dominator is the virtual exit.
+    int immediate(int block) const { return idom[block]; }
+    const std::vector<int>& children(int block) const { return kids[block]; }
+    int depth(int block) const { return level[block]; }
+    bool covers(int block) const { return pre[block] >= 0; }
+
+    // True if every path from the root to `b` goes through `a`
+    // (reflexive). Constant time.
+    bool dominates(int a, int b) const;
+};
+
+class DominatorTree : public DomTreeBase {
+ public:
+    static constexpr const char* name = "domtree";
+
+    DominatorTree(Function& fn, AnalysisManager& am);
+
+    // Blocks where a definition in `block` stops dominating, used for phi
+    // placement.
+    const std::vector<int>& frontier(int block) const { return df[block]; }
+
+ private:
+    std::vector<std::vector<int>> df;
+};
+
+// Post-dominators relative to a virtual exit joined to every ret block.
+// Blocks that cannot reach a ret (endless loops) are not covered.
+class PostDominatorTree : public DomTreeBase {
+ public:
+    static constexpr const char* name = "postdomtree";
+
+    PostDominatorTree(Function& fn, AnalysisManager& am);
+};
+
+struct Loop {
+    int header = -1;
+    int parent = -1;              // index of the enclosing loop, -1 if outermost
+    int depth = 1;                // 1 for outermost loops
+    std::vector<int> latches;     // blocks with a back edge to the header
+    std::vector<int> blocks;      // every block of the loop, nested ones included
+    std::vector<int> children;
+};
+
+// Natural loops found from back edges (edges whose target dominates their
+// source). Loops sharing a header are merged.
+class LoopInfo : public AnalysisResult {
+ public:
+    static constexpr const char* name = "loops";
+
+    std::vector<Loop> loops;
+    std::vector<int> innermost;   // per block: innermost loop index, or -1
+
+    LoopInfo(Function& fn, AnalysisManager& am);
+
+    int depthOf(int block) const {
+        return innermost[block] < 0 ? 0 : loops[innermost[block]].depth;
+    }
+    bool contains(int loop, int block) const;
+    // Blocks outside `loop` that are targets of edges leaving it.
+    std::vector<int> exitBlocks(int loop, const CFG& cfg) const;
+};
+
+// ===============================
+// Dataflow framework
+// ===============================
+// Solves out[b] = gen[b] | (in[b] - kill[b]) with the confluence operator
+// applied over predecessors (forward) or successors (backward). The
+// worklist visits blocks in reverse post-order (post-order when going
+// backwards) and only requeues the neighbours of blocks whose value
+// changed, so acyclic code settles in a single sweep.
+
+enum class Direction { Forward, Backward };
+enum class Meet { Union, Intersection };
+
+struct DataflowProblem {
+    Direction direction = Direction::Forward;
+    Meet meet = Meet::Union;
+    size_t width = 0;
+    std::vector<BitSet> gen;      // per block
+    std::vector<BitSet> kill;     // per block, may be left empty
+    BitSet boundary;              // value entering the entry (forward) or leaving the exits (backward)
+
+    // Kill sets that repeat across blocks (all definitions of one variable)
+    // can be given once in `groups` and referenced per block instead.
+    std::vector<BitSet> groups;
+    std::vector<std::vector<int>> killGroups;
+};
+
+struct DataflowResult {
+    // Always in program order: in[b] holds at the top of b, out[b] at the
+    // bottom, whatever the direction of the problem.
+    std::vector<BitSet> in;
+    std::vector<BitSet> out;
+};
+
+DataflowResult solveDataflow(const CFG& cfg, const DataflowProblem& problem);
+
+// Registers live at the boundaries of every block. Only registers read in
+// a block before being written there can be live across blocks, so the
+// sets cover just those: bit i stands for register tracked[i].
+class Liveness : public AnalysisResult {
+ public:
+    static constexpr const char* name = "liveness";
+
+    std::vector<int> tracked;     // bit -> register
+    std::vector<int> index;       // register -> bit, -1 if never live across blocks
+    std::vector<BitSet> liveIn;
+    std::vector<BitSet> liveOut;
+
+    Liveness(Function& fn, AnalysisManager& am);
+
+    bool isLiveIn(int block, int reg) const;
+    bool isLiveOut(int block, int reg) const;
+};
+
+// Definitions reaching the top and bottom of every block. Definition i is
+// defs[i]; parameters count as definitions at the entry with index -1.
+// Only definitions that can leave their block are numbered: the last one
+// of each register per block, for registers that are read in another
+// block. Uses inside the defining block are found by scanning it.
+class ReachingDefinitions : public AnalysisResult {
+ public:
+    static constexpr const char* name = "reaching-defs";
+
+    struct Def {
+        int block;
+        int index;
+        int reg;
+    };
+
+    std::vector<Def> defs;
+    std::vector<std::vector<int>> defsOfReg;
+    std::vector<BitSet> in;
+    std::vector<BitSet> out;
+
+    ReachingDefinitions(Function& fn, AnalysisManager& am);
+};
+
+// Direct calls between the functions of a module, keyed on the module.
+// Functions are numbered by their position in module.functions. sccs lists
+// the strongly connected components callees first, so walking it visits
+// every function after the functions it calls (outside of recursion).
+class CallGraph : public AnalysisResult {
+ public:
+    static constexpr const char* name = "callgraph";
+
+    std::vector<Function*> functions;
+    std::vector<std::vector<int>> callees;   // deduplicated
+    std::vector<std::vector<int>> callers;   // deduplicated
+    std::vector<int> callSites;              // call instructions targeting each function
+    std::vector<std::vector<int>> sccs;      // bottom-up
+    std::vector<int> sccOf;
+
+    CallGraph(Module& module, AnalysisManager& am);
+
+    // Index of the function with assembly label `label`, or -1.
+    int find(const std::string& label) const;
+    // True if `f` can call itself, directly or through other functions.
+    bool isRecursive(int f) const;
+    std::vector<bool> reachableFrom(int root) const;
+    // Per function: true if it neither prints nor touches a global and
+    // only calls such functions (a recursive cycle may call itself).
+    std::vector<bool> pureFunctions() const;
+
+ private:
+    std::map<std::string, int> byLabel;
+};
+
+// Registers read and written by an instruction, shared by the analyses
+// and the transformations built on them.
+template <typename F>
+void forEachUse(const Instr& instr, F f) {
+    for (const Operand& a : instr.args) {
+        if (a.isReg()) {
+            f(a.reg);
+        }
+    }
+}
+
+}  // namespace ir
+
+#endif /* IR_ANALYSIS_HPP */
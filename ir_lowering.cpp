@@ -0,0 +1,798 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ir_lowering.hpp"
+#include "exception.hpp"
+#include "visitor.hpp"
+
+using ir::Opcode;
+using ir::Operand;
+using ir::Type;
+
+ir::Type irTypeOf(DataType t) {
+    switch (t) {
+        case DataType::INT: return Type::Int;
+        case DataType::FLOAT: return Type::Float;
+        case DataType::BOOL: return Type::Bool;
+        default: return Type::Void;
+    }
+}
+
+ir::Type irTypeOf(BaseType t) {
+    switch (t) {
+        case BaseType::Int: return Type::Int;
+        case BaseType::Float: return Type::Float;
+        case BaseType::Bool: return Type::Bool;
+    }
+    return Type::Void;
+}
+
+namespace {
+
+const char* kInitGlobals = "_init_globals";
+
+struct Symbol {
+    enum class Kind { Local, Global, Function };
+
+    Kind kind = Kind::Local;
+    Type type = Type::Void;
+    int reg = -1;                  // Local: register holding the variable
+    int owner = -1;                // Local: id of the declaring function
+    const ASTNode* decl = nullptr; // Local: declaring VarDecl/LetDecl/Param node
+    std::string label;             // Global name or function label
+    std::vector<Type> paramTypes;  // Function
+};
+
+using ScopeMap = std::map<std::string, Symbol>;
+
+struct PendingFunction {
+    FuncDeclNode* decl;
+    std::string label;
+    std::vector<ScopeMap> scopes;  // scopes visible at the declaration
+};
+
+class LoweringVisitor : public Visitor {
+ public:
+    explicit LoweringVisitor(ir::Module& m) : module(m) {}
+
+    void finish() {
+        liftCaptures();
+
+        // main initializes the globals before running its body.
+        ir::Function* mainFn = module.findFunction("main");
+        if (initFn && mainFn) {
+            ir::Instr call(Opcode::Call, Type::Void, -1);
+            call.symbol = initFn->label;
+            auto& entry = mainFn->entry()->instrs;
+            entry.insert(entry.begin(), call);
+        }
+        if (initFn) {
+            initCur->instrs.emplace_back(Opcode::Ret, Type::Void, -1);
+            module.functions.push_back(std::move(initOwned));
+        }
+    }
+
+    // ===== Declarations =====
+
+    void visit(ProgramNode* node) override {
+        scopes.emplace_back();  // global scope
+
+        for (DeclNode* decl : node->declarations) {
+            if (auto* func = dynamic_cast<FuncDeclNode*>(decl)) {
+                Symbol sym = functionSymbol(func, func->name);
+                scopes.front()[func->name] = sym;
+                lowerFunction(func, sym.label, scopes);
+
+                // Nested functions are lowered as functions of their own.
+                while (!pending.empty()) {
+                    PendingFunction p = pending.front();
+                    pending.erase(pending.begin());
+                    lowerFunction(p.decl, p.label, p.scopes);
+                }
+            } else {
+                decl->accept(*this);
+            }
+        }
+        finish();
+    }
+
+    void visit(VarDeclNode* node) override {
+        declareVariable(node, node->name, irTypeOf(node->type->kind), node->init);
+    }
+
+    void visit(LetDeclNode* node) override {
+        // Same code as a var; the semantic analyzer rejects reassignment.
+        declareVariable(node, node->name, irTypeOf(node->type->kind), node->init);
+    }
+
+    void visit(FuncDeclNode* node) override {
+        // Reached in block order: queue the body with the scopes it sees.
+        Symbol* sym = lookup(node->name);
+        pending.push_back({node, sym ? sym->label : node->name, scopes});
+    }
+
+    void visit(BlockNode* node) override {
+        scopes.emplace_back();
+
+        // Functions declared in a block are callable from the whole block.
+        for (ASTNode* item : node->orderedItems) {
+            if (auto* func = dynamic_cast<FuncDeclNode*>(item)) {
+                scopes.back()[func->name] =
+                    functionSymbol(func, fn->label + "__" + func->name);
+            }
+        }
+
+        for (ASTNode* item : node->orderedItems) {
+            if (item) {
+                item->accept(*this);
+            }
+        }
+
+        scopes.pop_back();
+    }
+
+    // ===== Statements =====
+
+    void visit(AssignStmtNode* node) override {
+        Symbol* sym = lookup(node->name);
+        if (!sym) {
+            throw CodeGenException("assignment to unknown variable '" +
+                                   node->name + "'");
+        }
+        Operand value = convert(lowerExpr(node->rhs), sym->type);
+
+        if (sym->kind == Symbol::Kind::Global) {
+            ir::Instr store(Opcode::StoreGlobal, sym->type, -1, {value});
+            store.symbol = sym->label;
+            emit(store);
+        } else {
+            if (sym->owner != currentOwner &&
+                std::find(assignedOutside.begin(), assignedOutside.end(), sym->decl) ==
+                    assignedOutside.end()) {
+                assignedOutside.push_back(sym->decl);
+            }
+            emit(ir::Instr(Opcode::Copy, sym->type, localReg(*sym), {value}));
+        }
+    }
+
+    void visit(PrintStmtNode* node) override {
+        Operand value = lowerExpr(node->expr);
+        emit(ir::Instr(Opcode::Print, value.type, -1, {value}));
+    }
+
+    void visit(ReturnStmtNode* node) override {
+        Operand value = convert(lowerExpr(node->expr), fn->retType);
+        emit(ir::Instr(Opcode::Ret, fn->retType, -1, {value}));
+        cur = nullptr;
+    }
+
+    void visit(IfStmtNode* node) override {
+        Operand cond = lowerExpr(node->cond);
+        ir::BasicBlock* condBlock = current();
+        ir::Instr br(Opcode::CondBr, Type::Void, -1, {cond});
+
+        ir::BasicBlock* thenBlock = fn->newBlock("if.then");
+        br.targets = {thenBlock->id, -1};
+        condBlock->instrs.push_back(br);
+
+        cur = thenBlock;
+        node->thenBlk->accept(*this);
+        ir::BasicBlock* thenEnd = cur;
+
+        ir::BasicBlock* elseEnd = nullptr;
+        if (node->elseBlk) {
+            ir::BasicBlock* elseBlock = fn->newBlock("if.else");
+            condBlock->terminator().targets[1] = elseBlock->id;
+            cur = elseBlock;
+            node->elseBlk->accept(*this);
+            elseEnd = cur;
+        }
+
+        ir::BasicBlock* join = fn->newBlock("if.end");
+        if (!node->elseBlk) {
+            condBlock->terminator().targets[1] = join->id;
+        }
+        branchTo(thenEnd, join);
+        branchTo(elseEnd, join);
+        cur = join;
+    }
+
+    void visit(WhileStmtNode* node) override {
+        ir::BasicBlock* header = fn->newBlock("while.cond");
+        branchTo(current(), header);
+
+        cur = header;
+        Operand cond = lowerExpr(node->cond);
+        ir::BasicBlock* condEnd = current();
+        ir::BasicBlock* body = fn->newBlock("while.body");
+        ir::Instr br(Opcode::CondBr, Type::Void, -1, {cond});
+        br.targets = {body->id, -1};
+        condEnd->instrs.push_back(br);
+
+        cur = body;
+        node->body->accept(*this);
+        branchTo(cur, header);
+
+        ir::BasicBlock* exit = fn->newBlock("while.end");
+        condEnd->terminator().targets[1] = exit->id;
+        cur = exit;
+    }
+
+    // ===== Expressions: result holds the operand =====
+
+    void visit(IntLitNode* node) override {
+        result = Operand::ofInt(node->value);
+    }
+
+    void visit(FloatLitNode* node) override {
+        result = Operand::ofFloat(static_cast<float>(node->value));
+    }
+
+    void visit(BoolLitNode* node) override {
+        result = Operand::ofBool(node->value);
+    }
+
+    void visit(IdNode* node) override {
+        Symbol* sym = lookup(node->name);
+        if (!sym || sym->kind == Symbol::Kind::Function) {
+            throw CodeGenException("use of unknown variable '" + node->name +
+                                   "'");
+        }
+        if (sym->kind == Symbol::Kind::Global) {
+            // Globals can change across calls, so read them at the use.
+            int tmp = fn->newVReg(sym->type);
+            ir::Instr load(Opcode::LoadGlobal, sym->type, tmp);
+            load.symbol = sym->label;
+            emit(load);
+            result = Operand::ofReg(tmp, sym->type);
+            return;
+        }
+        // A nested function assigning the variable moves it to a global
+        // (liftCaptures()), which must be read here, before any call later
+        // in the expression; the copy goes again if it stays a register.
+        int reg = localReg(*sym);
+        int tmp = fn->newVReg(sym->type);
+        emit(ir::Instr(Opcode::Copy, sym->type, tmp, {Operand::ofReg(reg, sym->type)}));
+        localReads.push_back({fn, tmp, reg, sym->decl});
+        result = Operand::ofReg(tmp, sym->type);
+    }
+
+    void visit(UnaryOpNode* node) override {
+        Operand value = lowerExpr(node->expr);
+        int tmp = fn->newVReg(value.type);
+        emit(ir::Instr(Opcode::Neg, value.type, tmp, {value}));
+        result = Operand::ofReg(tmp, value.type);
+    }
+
+    void visit(BinaryOpNode* node) override {
+        // The operand needing more temporaries is evaluated first, so the
+        // other one's value is not held while it runs (Sethi-Ullman).
+        // Operands with calls keep the source order their prints and
+        // globals depend on; anything else has no effect to reorder.
+        bool calls = false;
+        int leftNeed = registerNeed(node->left, calls);
+        int rightNeed = registerNeed(node->right, calls);
+        Operand lhs;
+        Operand rhs;
+        if (rightNeed > leftNeed && !calls) {
+            rhs = lowerExpr(node->right);
+            lhs = lowerExpr(node->left);
+        } else {
+            lhs = lowerExpr(node->left);
+            rhs = lowerExpr(node->right);
+        }
+
+        // Mixed int/float operands are promoted to float.
+        Type operandType = lhs.type;
+        if (lhs.type == Type::Float || rhs.type == Type::Float) {
+            operandType = Type::Float;
+        }
+        lhs = convert(lhs, operandType);
+        rhs = convert(rhs, operandType);
+
+        Opcode op = Opcode::Add;
+        switch (node->op) {
+            case BinOp::Add: op = Opcode::Add; break;
+            case BinOp::Sub: op = Opcode::Sub; break;
+            case BinOp::Mul: op = Opcode::Mul; break;
+            case BinOp::Div: op = Opcode::Div; break;
+            case BinOp::Eq: op = Opcode::CmpEq; break;
+            case BinOp::Neq: op = Opcode::CmpNe; break;
+            case BinOp::Lt: op = Opcode::CmpLt; break;
+            case BinOp::Gt: op = Opcode::CmpGt; break;
+            case BinOp::Le: op = Opcode::CmpLe; break;
+            case BinOp::Ge: op = Opcode::CmpGe; break;
+        }
+
+        Type resultType = ir::isCompare(op) ? Type::Bool : operandType;
+        int tmp = fn->newVReg(resultType);
+        emit(ir::Instr(op, resultType, tmp, {lhs, rhs}));
+        result = Operand::ofReg(tmp, resultType);
+    }
+
+    void visit(CallNode* node) override {
+        Symbol* sym = lookup(node->callee);
+        if (!sym || sym->kind != Symbol::Kind::Function) {
+            throw CodeGenException("call to unknown function '" +
+                                   node->callee + "'");
+        }
+        std::string label = sym->label;
+        Type retType = sym->type;
+        std::vector<Type> paramTypes = sym->paramTypes;
+
+        // Arguments are evaluated left to right.
+        std::vector<Operand> args;
+        for (size_t i = 0; i < node->args.size(); ++i) {
+            args.push_back(convert(lowerExpr(node->args[i]), paramTypes[i]));
+        }
+
+        int tmp = fn->newVReg(retType);
+        ir::Instr call(Opcode::Call, retType, tmp, args);
+        call.symbol = label;
+        emit(call);
+        result = Operand::ofReg(tmp, retType);
+    }
+
+    void visit(TypeNode*) override {}
+    void visit(ParamNode*) override {}
+
+ private:
+    ir::Module& module;
+    ir::Function* fn = nullptr;
+    ir::BasicBlock* cur = nullptr;
+    std::vector<ScopeMap> scopes;  // innermost last, scopes[0] is global
+    int currentOwner = -1;
+    int nextOwner = 0;
+    Operand result;
+    std::vector<PendingFunction> pending;
+    std::set<std::string> usedLabels;
+
+    // Every local variable and parameter, by its declaration.
+    struct Variable {
+        ir::Function* owner;
+        int reg;
+        Type type;
+        std::string name;
+    };
+    // Variables of enclosing functions a function uses, in first-use order,
+    // with the register standing for each of them.
+    struct Captures {
+        std::vector<const ASTNode*> order;
+        std::map<const ASTNode*, int> reg;
+    };
+    std::map<const ASTNode*, Variable> variables;
+    std::map<std::string, Captures> captures;       // by function label
+    std::vector<const ASTNode*> assignedOutside;    // captured and assigned
+    // Reads of locals, each copied to a temporary where it happens.
+    struct LocalRead {
+        ir::Function* fn;
+        int tmp;
+        int reg;
+        const ASTNode* decl;
+    };
+    std::vector<LocalRead> localReads;
+
+    // Global initializers are collected into their own function.
+    std::unique_ptr<ir::Function> initOwned;
+    ir::Function* initFn = nullptr;
+    ir::BasicBlock* initCur = nullptr;
+
+    Operand lowerExpr(ExpNode* e) {
+        e->accept(*this);
+        return result;
+    }
+
+    // Sethi-Ullman number of `e`: how many temporaries its evaluation
+    // keeps live at once. Literals and locals are used in place and need
+    // none, a global is loaded into one. Sets `calls` if `e` has a call.
+    int registerNeed(const ExpNode* e, bool& calls) {
+        if (auto* id = dynamic_cast<const IdNode*>(e)) {
+            Symbol* sym = lookup(id->name);
+            return sym && sym->kind == Symbol::Kind::Global ? 1 : 0;
+        }
+        if (auto* un = dynamic_cast<const UnaryOpNode*>(e)) {
+            return std::max(registerNeed(un->expr, calls), 1);
+        }
+        if (auto* bin = dynamic_cast<const BinaryOpNode*>(e)) {
+            int left = registerNeed(bin->left, calls);
+            int right = registerNeed(bin->right, calls);
+            return left == right ? left + 1 : std::max(left, right);
+        }
+        if (dynamic_cast<const CallNode*>(e)) {
+            calls = true;
+            return 1;
+        }
+        return 0;
+    }
+
+    ir::BasicBlock* current() {
+        // Code after a return lands in a fresh block that
+        // removeUnreachableBlocks() drops again.
+        if (!cur) {
+            cur = fn->newBlock("unreachable");
+        }
+        return cur;
+    }
+
+    void emit(const ir::Instr& instr) {
+        current()->instrs.push_back(instr);
+    }
+
+    void branchTo(ir::BasicBlock* from, ir::BasicBlock* to) {
+        if (!from || from->terminated()) {
+            return;
+        }
+        ir::Instr br(Opcode::Br, Type::Void, -1);
+        br.targets = {to->id};
+        from->instrs.push_back(br);
+    }
+
+    Symbol* lookup(const std::string& name) {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) {
+                return &found->second;
+            }
+        }
+        return nullptr;
+    }
+
+    // Register of a local in the function being lowered. A variable of an
+    // enclosing function is captured: it gets a register of its own here,
+    // which liftCaptures() later turns into an extra parameter.
+    int localReg(const Symbol& sym) {
+        if (sym.owner == currentOwner) {
+            return sym.reg;
+        }
+        return captureReg(fn, sym.decl);
+    }
+
+    int captureReg(ir::Function* f, const ASTNode* decl) {
+        Captures& c = captures[f->label];
+        auto found = c.reg.find(decl);
+        if (found != c.reg.end()) {
+            return found->second;
+        }
+        const Variable& v = variables.at(decl);
+        int reg = f->newVReg(v.type, v.name);
+        c.order.push_back(decl);
+        c.reg[decl] = reg;
+        return reg;
+    }
+
+    // Lambda lifting: every nested function takes the variables it
+    // captures as extra parameters after its own, and every call passes
+    // their current values. A call also passes on what its callee
+    // captures, so a caller captures those of the callee's variables it
+    // does not own itself.
+    //
+    // A variable some nested function assigns to cannot travel by value;
+    // it lives in a global instead, which every function using it loads
+    // and stores. Its owner saves the global on entry and restores it on
+    // return, so each activation of a recursive owner has its own value
+    // while it runs (nested functions cannot outlive the owner's call).
+    void liftCaptures() {
+        if (captures.empty()) {
+            settleReads({});
+            return;
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto& f : module.functions) {
+                forEachCaptureCall(*f, [&](ir::Instr&, const Captures& callee) {
+                    std::vector<const ASTNode*> needed = callee.order;
+                    for (const ASTNode* decl : needed) {
+                        if (variables.at(decl).owner != f.get() &&
+                            !captures[f->label].reg.count(decl)) {
+                            captureReg(f.get(), decl);
+                            changed = true;
+                        }
+                    }
+                });
+            }
+        }
+
+        std::map<const ASTNode*, std::string> shared;
+        for (const ASTNode* decl : assignedOutside) {
+            const Variable& v = variables.at(decl);
+            std::string name = v.owner->label + "__" + v.name;
+            for (int n = 1; module.findGlobal(name); ++n) {
+                name = v.owner->label + "__" + v.name + "_" + std::to_string(n);
+            }
+            module.globals.push_back({name, v.type});
+            shared[decl] = name;
+        }
+
+        for (auto& f : module.functions) {
+            forEachCaptureCall(*f, [&](ir::Instr& call, const Captures& callee) {
+                for (const ASTNode* decl : callee.order) {
+                    if (shared.count(decl)) {
+                        continue;
+                    }
+                    const Variable& v = variables.at(decl);
+                    int reg = v.owner == f.get() ? v.reg : captures[f->label].reg.at(decl);
+                    call.args.push_back(Operand::ofReg(reg, v.type));
+                }
+            });
+        }
+        for (auto& entry : captures) {
+            ir::Function* f = module.findFunction(entry.first);
+            for (const ASTNode* decl : entry.second.order) {
+                int reg = entry.second.reg.at(decl);
+                if (shared.count(decl)) {
+                    demoteToGlobal(*f, reg, shared[decl]);
+                } else {
+                    f->params.push_back(reg);
+                }
+            }
+        }
+        for (const ASTNode* decl : assignedOutside) {
+            const Variable& v = variables.at(decl);
+            const std::string& name = shared[decl];
+            demoteToGlobal(*v.owner, v.reg, name);
+
+            int saved = v.owner->newVReg(v.type);
+            ir::Instr save(Opcode::LoadGlobal, v.type, saved);
+            save.symbol = name;
+            auto& entry = v.owner->entry()->instrs;
+            entry.insert(entry.begin(), save);
+            if (std::find(v.owner->params.begin(), v.owner->params.end(), v.reg) !=
+                v.owner->params.end()) {
+                ir::Instr init(Opcode::StoreGlobal, v.type, -1,
+                               {Operand::ofReg(v.reg, v.type)});
+                init.symbol = name;
+                entry.insert(entry.begin() + 1, init);
+            }
+            for (auto& block : v.owner->blocks) {
+                if (block->terminator().op == Opcode::Ret) {
+                    ir::Instr restore(Opcode::StoreGlobal, v.type, -1,
+                                      {Operand::ofReg(saved, v.type)});
+                    restore.symbol = name;
+                    block->instrs.insert(block->instrs.end() - 1, restore);
+                }
+            }
+        }
+        settleReads(shared);
+    }
+
+    // The reads of variables left in registers use the register again:
+    // only a nested function's assignment could change it between the
+    // read and the use, and those variables are in `shared` globals.
+    void settleReads(const std::map<const ASTNode*, std::string>& shared) {
+        std::map<ir::Function*, std::vector<int>> source;   // per temporary
+        for (const LocalRead& read : localReads) {
+            if (!shared.count(read.decl)) {
+                std::vector<int>& s = source[read.fn];
+                s.resize(read.fn->vregs.size(), -1);
+                s[read.tmp] = read.reg;
+            }
+        }
+        for (auto& entry : source) {
+            const std::vector<int>& s = entry.second;
+            auto read = [&](int r) { return r < static_cast<int>(s.size()) ? s[r] : -1; };
+            for (auto& block : entry.first->blocks) {
+                auto& instrs = block->instrs;
+                instrs.erase(std::remove_if(instrs.begin(), instrs.end(),
+                                            [&](const ir::Instr& instr) {
+                                                return instr.op == Opcode::Copy &&
+                                                       read(instr.dst) >= 0;
+                                            }),
+                             instrs.end());
+                for (ir::Instr& instr : instrs) {
+                    for (Operand& a : instr.args) {
+                        if (a.isReg() && read(a.reg) >= 0) {
+                            a.reg = read(a.reg);
+                        }
+                    }
+                }
+            }
+        }
+        localReads.clear();
+    }
+
+    template <typename F>
+    void forEachCaptureCall(ir::Function& f, F visit) {
+        for (auto& block : f.blocks) {
+            for (ir::Instr& instr : block->instrs) {
+                auto callee = instr.op == Opcode::Call ? captures.find(instr.symbol)
+                                                       : captures.end();
+                if (callee != captures.end()) {
+                    visit(instr, callee->second);
+                }
+            }
+        }
+    }
+
+    // Moves register `reg` of `f` into global `name`: every read loads the
+    // global first and every write is stored to it right away.
+    static void demoteToGlobal(ir::Function& f, int reg, const std::string& name) {
+        Type type = f.regType(reg);
+        for (auto& block : f.blocks) {
+            std::vector<ir::Instr> instrs;
+            for (ir::Instr& instr : block->instrs) {
+                int loaded = -1;
+                for (Operand& a : instr.args) {
+                    if (a.isReg() && a.reg == reg) {
+                        if (loaded < 0) {
+                            loaded = f.newVReg(type);
+                            ir::Instr load(Opcode::LoadGlobal, type, loaded);
+                            load.symbol = name;
+                            instrs.push_back(load);
+                        }
+                        a.reg = loaded;
+                    }
+                }
+                int stored = -1;
+                if (instr.dst == reg) {
+                    stored = f.newVReg(type);
+                    instr.dst = stored;
+                }
+                instrs.push_back(std::move(instr));
+                if (stored >= 0) {
+                    ir::Instr store(Opcode::StoreGlobal, type, -1,
+                                    {Operand::ofReg(stored, type)});
+                    store.symbol = name;
+                    instrs.push_back(store);
+                }
+            }
+            block->instrs = std::move(instrs);
+        }
+    }
+
+    std::string uniqueLabel(const std::string& base) {
+        std::string label = base;
+        int n = 1;
+        while (usedLabels.count(label)) {
+            label = base + "_" + std::to_string(n++);
+        }
+        usedLabels.insert(label);
+        return label;
+    }
+
+    Symbol functionSymbol(FuncDeclNode* func, const std::string& label) {
+        Symbol sym;
+        sym.kind = Symbol::Kind::Function;
+        sym.type = irTypeOf(func->retType->kind);
+        sym.label = uniqueLabel(label);
+        for (ParamNode* p : func->params) {
+            sym.paramTypes.push_back(irTypeOf(p->type->kind));
+        }
+        return sym;
+    }
+
+    Operand convert(Operand value, Type to) {
+        if (value.type == to || to == Type::Void) {
+            return value;
+        }
+        if (value.isImm()) {
+            if (to == Type::Float) {
+                return Operand::ofFloat(static_cast<float>(value.intValue));
+            }
+            if (to == Type::Bool) {
+                return Operand::ofBool(value.intValue != 0);
+            }
+            return Operand::ofInt(value.intValue);
+        }
+
+        int tmp = fn->newVReg(to);
+        if (to == Type::Float) {
+            emit(ir::Instr(Opcode::IntToFloat, to, tmp, {value}));
+        } else if (to == Type::Bool) {
+            emit(ir::Instr(Opcode::IntToBool, to, tmp, {value}));
+        } else {
+            // bool -> int keeps the 0/1 representation.
+            emit(ir::Instr(Opcode::Copy, to, tmp, {value}));
+        }
+        return Operand::ofReg(tmp, to);
+    }
+
+    void declareVariable(const ASTNode* decl, const std::string& name, Type type,
+                         ExpNode* init) {
+        if (scopes.size() == 1) {
+            declareGlobal(name, type, init);
+            return;
+        }
+        Operand value = convert(lowerExpr(init), type);
+        int reg = fn->newVReg(type, name);
+        emit(ir::Instr(Opcode::Copy, type, reg, {value}));
+
+        Symbol sym;
+        sym.kind = Symbol::Kind::Local;
+        sym.type = type;
+        sym.reg = reg;
+        sym.owner = currentOwner;
+        sym.decl = decl;
+        scopes.back()[name] = sym;
+        variables[decl] = {fn, reg, type, name};
+    }
+
+    void declareGlobal(const std::string& name, Type type, ExpNode* init) {
+        if (!initFn) {
+            initOwned = std::make_unique<ir::Function>();
+            initFn = initOwned.get();
+            initFn->name = kInitGlobals;
+            initFn->label = uniqueLabel(kInitGlobals);
+            initFn->retType = Type::Void;
+            initCur = initFn->newBlock("entry");
+        }
+
+        fn = initFn;
+        cur = initCur;
+        currentOwner = -1;
+        Operand value = convert(lowerExpr(init), type);
+        ir::Instr store(Opcode::StoreGlobal, type, -1, {value});
+        store.symbol = name;
+        emit(store);
+        initCur = cur;
+        fn = nullptr;
+        cur = nullptr;
+
+        module.globals.push_back({name, type});
+        Symbol sym;
+        sym.kind = Symbol::Kind::Global;
+        sym.type = type;
+        sym.label = name;
+        scopes.front()[name] = sym;
+    }
+
+    void lowerFunction(FuncDeclNode* decl, const std::string& label,
+                       const std::vector<ScopeMap>& visible) {
+        auto owned = std::make_unique<ir::Function>();
+        fn = owned.get();
+        fn->name = decl->name;
+        fn->label = label;
+        fn->retType = irTypeOf(decl->retType->kind);
+
+        std::vector<ScopeMap> savedScopes = scopes;
+        scopes = visible;
+        currentOwner = nextOwner++;
+
+        ScopeMap params;
+        for (ParamNode* p : decl->params) {
+            Type t = irTypeOf(p->type->kind);
+            int reg = fn->newVReg(t, p->name);
+            fn->params.push_back(reg);
+
+            Symbol sym;
+            sym.kind = Symbol::Kind::Local;
+            sym.type = t;
+            sym.reg = reg;
+            sym.owner = currentOwner;
+            sym.decl = p;
+            params[p->name] = sym;
+            variables[p] = {fn, reg, t, p->name};
+        }
+        scopes.push_back(params);
+
+        cur = fn->newBlock("entry");
+        decl->body->accept(*this);
+
+        // Falling off the end returns the type's zero value; the semantic
+        // analyzer already rejects functions that can do this.
+        if (cur && !cur->terminated()) {
+            Operand zero = fn->retType == Type::Float
+                ? Operand::ofFloat(0.0f)
+                : fn->retType == Type::Bool ? Operand::ofBool(false)
+                                            : Operand::ofInt(0);
+            emit(ir::Instr(Opcode::Ret, fn->retType, -1, {zero}));
+        }
+        fn->removeUnreachableBlocks();
+
+        module.functions.push_back(std::move(owned));
+        scopes = savedScopes;
+        fn = nullptr;
+        cur = nullptr;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<ir::Module> lowerProgram(ProgramNode* program) {
+    auto module = std::make_unique<ir::Module>();
+    LoweringVisitor lowering(*module);
+    program->accept(lowering);
+    return module;
+}
@@ -0,0 +1,16 @@
+#ifndef IR_LOWERING_HPP
+#define IR_LOWERING_HPP
+
+#include <memory>
+#include "astnode.hpp"
+#include "ir.hpp"
+
+// Translates the analyzed AST into IR. Top-level var/let declarations
+// become globals initialized by _init_globals, which main calls first.
+// Throws CodeGenException for constructs the IR cannot express.
+std::unique_ptr<ir::Module> lowerProgram(ProgramNode* program);
+
+ir::Type irTypeOf(DataType t);
+ir::Type irTypeOf(BaseType t);
+
+#endif /* IR_LOWERING_HPP */
@@ -0,0 +1,147 @@
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "loop_utils.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Loop-invariant code motion
+// ===============================
+// Moves pure instructions whose operands are all defined outside a loop
+// into the loop's preheader, inner loops first so that code hoisted out of
+// an inner loop can keep moving outwards. Hoisting runs the instruction
+// even when the loop body (or the arm it sat in) would not, so only
+// instructions that cannot trap qualify: a division moves only when its
+// divisor is a non-zero constant. Loads of a global move when the loop
+// neither stores to it nor calls anything.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+
+bool isHoistable(const Instr& instr) {
+    if (instr.dst < 0 || instr.hasSideEffects()) {
+        return false;
+    }
+    switch (instr.op) {
+        case Opcode::Phi:
+        case Opcode::LoadGlobal:
+        case Opcode::Call:
+            return false;
+        default:
+            return true;
+    }
+}
+
+class LICMPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "licm"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        if (am.get<ir::LoopInfo>(fn).loops.empty()) {
+            return changed;
+        }
+        changed = ir::insertPreheaders(fn, am) || changed;
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& li = am.get<ir::LoopInfo>(fn);
+
+        // Block defining each register; parameters are defined before
+        // the entry.
+        std::vector<int> defBlock(fn.vregs.size(), -1);
+        for (const auto& block : fn.blocks) {
+            for (const Instr& instr : block->instrs) {
+                if (instr.dst >= 0) {
+                    defBlock[instr.dst] = block->id;
+                }
+            }
+        }
+
+        // Inner loops have lower indices than the loops containing them.
+        for (size_t l = 0; l < li.loops.size(); ++l) {
+            int loop = static_cast<int>(l);
+            int preheader = ir::preheaderOf(li, loop, cfg);
+            if (preheader < 0) {
+                continue;
+            }
+            std::vector<char> inLoop(fn.blocks.size(), 0);
+            std::set<std::string> stored;
+            bool calls = false;
+            for (int b : li.loops[loop].blocks) {
+                inLoop[b] = 1;
+                for (const Instr& instr : fn.blocks[b]->instrs) {
+                    if (instr.op == Opcode::StoreGlobal) {
+                        stored.insert(instr.symbol);
+                    } else if (instr.op == Opcode::Call) {
+                        calls = true;
+                    }
+                }
+            }
+            auto invariant = [&](const Instr& instr) {
+                if (instr.op == Opcode::LoadGlobal) {
+                    if (calls || stored.count(instr.symbol)) {
+                        return false;
+                    }
+                } else if (!isHoistable(instr)) {
+                    return false;
+                }
+                for (const ir::Operand& a : instr.args) {
+                    if (a.isReg() && defBlock[a.reg] >= 0 && inLoop[defBlock[a.reg]]) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            // Loop blocks are in reverse post-order, so operands defined in
+            // the loop are seen (and possibly hoisted) before their uses.
+            std::vector<Instr> hoisted;
+            for (int b : li.loops[loop].blocks) {
+                auto& instrs = fn.blocks[b]->instrs;
+                size_t out = 0;
+                for (size_t i = 0; i < instrs.size(); ++i) {
+                    if (invariant(instrs[i])) {
+                        defBlock[instrs[i].dst] = preheader;
+                        hoisted.push_back(std::move(instrs[i]));
+                        continue;
+                    }
+                    if (out != i) {
+                        instrs[out] = std::move(instrs[i]);
+                    }
+                    ++out;
+                }
+                instrs.erase(instrs.begin() + out, instrs.end());
+            }
+            if (!hoisted.empty()) {
+                auto& target = fn.blocks[preheader]->instrs;
+                target.insert(target.end() - 1, hoisted.begin(), hoisted.end());
+                changed = true;
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createLICMPass() {
+    return std::make_unique<LICMPass>();
+}
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "loop_utils.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Loop rotation
+// ===============================
+// A while loop is lowered with its test at the top, so every iteration
+// runs the test, falls into the body and jumps back from the latch:
+//
+//     preheader -> header (test) -> body ... latch -> header
+//                     |
+//                    exit
+//
+// Rotation copies the test into the preheader, where it guards the loop
+// once, and into the latch, which branches back to the header while it
+// holds. The header keeps its phis and falls straight into the body (or
+// absorbs it, when it is the body's only predecessor), so an iteration
+// ends in one taken branch instead of a jump and a test.
+// Values of the header that are read after the loop get a phi in the exit
+// block merging the guard's and the latch's copies.
+//
+// Only loops with a preheader, a single latch and the header as their
+// only exit are rotated, and only when the test is at most kMaxTestSize
+// instructions without side effects, as it now runs twice per entry into
+// the header block's code.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const size_t kMaxTestSize = 8;
+
+// A header register read after its loop, replaced there by the phi of the
+// loop's exit block merging the guard's and the latch's copies.
+struct Rename {
+    int loop;
+    int exit;
+    Operand merged;
+};
+
+// Loops rotated from one snapshot of the analyses. None of them contains
+// another, so rotating one leaves the others' blocks as they were.
+struct Round {
+    std::vector<std::vector<int>> readIn;   // per register: blocks reading it
+    std::map<int, Rename> renames;
+    std::vector<bool> taken;                // blocks of the loops rotated
+    bool joined = false;                    // a body joined its header
+
+    explicit Round(const ir::Function& fn) : taken(fn.blocks.size(), false) {
+        readIn.resize(fn.vregs.size());
+        for (size_t b = 0; b < fn.blocks.size(); ++b) {
+            for (const Instr& instr : fn.blocks[b]->instrs) {
+                ir::forEachUse(instr, [&](int r) { readIn[r].push_back(static_cast<int>(b)); });
+            }
+        }
+    }
+};
+
+class LoopRotationPass : public IRFunctionPass {
+ private:
+    static Operand mapped(const std::map<int, Operand>& value, const Operand& a) {
+        auto found = a.isReg() ? value.find(a.reg) : value.end();
+        return found != value.end() ? found->second : a;
+    }
+
+    // Copies of the header's instructions evaluated on `value` (header phis
+    // replaced by their incoming values on one edge), appended to `out`;
+    // `value` maps every header register to its copy. Copies with constant
+    // operands are folded, which typically decides the guard of a loop
+    // starting from constants.
+    static void copyTest(ir::Function& fn, const std::vector<Instr>& test,
+                         std::map<int, Operand>& value, std::vector<Instr>& out) {
+        for (const Instr& instr : test) {
+            Instr copy = instr;
+            bool constant = true;
+            for (Operand& a : copy.args) {
+                a = mapped(value, a);
+                constant = constant && a.isImm();
+            }
+            Operand folded;
+            if (constant && instr.dst >= 0 &&
+                ir::foldConstant(instr.op, instr.type, copy.args, folded)) {
+                value[instr.dst] = folded;
+                continue;
+            }
+            if (instr.dst >= 0) {
+                ir::Type type = fn.regType(instr.dst);
+                std::string name = fn.vregs[instr.dst].name;
+                copy.dst = fn.newVReg(type, name);
+                value[instr.dst] = Operand::ofReg(copy.dst, type);
+            }
+            out.push_back(copy);
+        }
+    }
+
+    static bool rotate(ir::Function& fn, const ir::LoopInfo& li, int l, const ir::CFG& cfg,
+                       Round& round) {
+        const ir::Loop& loop = li.loops[l];
+        int h = loop.header;
+        if (loop.latches.size() != 1 || loop.latches[0] == h) {
+            return false;
+        }
+        for (int b : loop.blocks) {
+            if (round.taken[b]) {
+                return false;
+            }
+        }
+        int latch = loop.latches[0];
+        int pre = ir::preheaderOf(li, l, cfg);
+        ir::BasicBlock& header = *fn.blocks[h];
+        const Instr& branch = header.terminator();
+        // The remainder loop left by unrolling runs fewer times than the
+        // unroll factor per entry, too few to pay for a second test.
+        if (pre < 0 || fn.blocks[pre]->hint == "unroll.exit" || branch.op != Opcode::CondBr ||
+            fn.blocks[latch]->terminator().op != Opcode::Br) {
+            return false;
+        }
+        int inside = li.contains(l, branch.targets[0]) ? 0 : 1;
+        int exit = branch.targets[1 - inside];
+        if (!li.contains(l, branch.targets[inside]) || li.contains(l, exit) ||
+            cfg.preds[exit].size() != 1 || li.exitBlocks(l, cfg).size() != 1) {
+            return false;
+        }
+
+        // The header's phis and the test after them. A profile counter
+        // moves along with the test: the guard and the bottom test
+        // together run once per run of the header.
+        std::map<int, Operand> fromPre;
+        std::map<int, Operand> fromLatch;
+        std::vector<int> defined;
+        std::vector<Instr> test;
+        for (size_t k = 0; k + 1 < header.instrs.size(); ++k) {
+            const Instr& instr = header.instrs[k];
+            if (instr.op == Opcode::Phi) {
+                for (size_t e = 0; e < instr.targets.size(); ++e) {
+                    (instr.targets[e] == pre ? fromPre : fromLatch)[instr.dst] = instr.args[e];
+                }
+            } else if ((instr.hasSideEffects() && instr.op != Opcode::Count) ||
+                       test.size() == kMaxTestSize) {
+                return false;
+            } else {
+                test.push_back(instr);
+            }
+            if (instr.dst >= 0) {
+                defined.push_back(instr.dst);
+            }
+        }
+
+        std::vector<Instr> guard;
+        std::vector<Instr> bottom;
+        copyTest(fn, test, fromPre, guard);
+        copyTest(fn, test, fromLatch, bottom);
+        auto finish = [&](std::vector<Instr>& code, const std::map<int, Operand>& value) {
+            Instr copy = branch;
+            copy.args[0] = mapped(value, branch.args[0]);
+            copy.targets[inside] = h;
+            code.push_back(copy);
+        };
+        finish(guard, fromPre);
+        finish(bottom, fromLatch);
+        int body = branch.targets[inside];
+        // A guard known to skip the loop leaves a dead loop to sccp; one
+        // known to enter it makes the loop its preheader's only successor.
+        // The loop is entered on the true edge unless it exits there.
+        const Operand& enter = guard.back().args[0];
+        if (enter.isImm() && (enter.intValue != 0) != (inside == 0)) {
+            return false;
+        }
+        bool guarded = !enter.isImm();
+        if (!guarded) {
+            guard.back() = Instr(Opcode::Br, ir::Type::Void, -1);
+            guard.back().targets = {h};
+        }
+        std::vector<int> exitPreds = guarded ? std::vector<int>{pre, latch}
+                                             : std::vector<int>{latch};
+        auto incoming = [&](const Operand& a) {
+            return guarded ? std::vector<Operand>{mapped(fromPre, a), mapped(fromLatch, a)}
+                           : std::vector<Operand>{mapped(fromLatch, a)};
+        };
+
+        auto& preCode = fn.blocks[pre]->instrs;
+        preCode.pop_back();
+        preCode.insert(preCode.end(), guard.begin(), guard.end());
+        auto& latchCode = fn.blocks[latch]->instrs;
+        latchCode.pop_back();
+        latchCode.insert(latchCode.end(), bottom.begin(), bottom.end());
+        Instr& jump = header.terminator();
+        jump = Instr(Opcode::Br, ir::Type::Void, -1);
+        jump.targets = {body};
+        header.instrs.erase(std::remove_if(header.instrs.begin(), header.instrs.end(),
+                                           [](const Instr& instr) {
+                                               return instr.op == Opcode::Count;
+                                           }),
+                            header.instrs.end());
+
+        // The exit is now entered from the guard and from the latch.
+        auto& exitCode = fn.blocks[exit]->instrs;
+        size_t phis = 0;
+        for (; phis < exitCode.size() && exitCode[phis].op == Opcode::Phi; ++phis) {
+            Instr& phi = exitCode[phis];
+            phi.args = incoming(phi.args[0]);
+            phi.targets = exitPreds;
+        }
+
+        // Header values read after the loop come from one of the copies;
+        // the reads are renamed once the round is over (renameReads).
+        auto readOutside = [&](int reg) {
+            for (int b : round.readIn[reg]) {
+                if (!li.contains(l, b)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        std::vector<Instr> newPhis;
+        for (int reg : defined) {
+            if (static_cast<size_t>(reg) >= round.readIn.size() || !readOutside(reg)) {
+                continue;
+            }
+            ir::Type type = fn.regType(reg);
+            std::string name = fn.vregs[reg].name;
+            int dst = fn.newVReg(type, name);
+            Instr phi(Opcode::Phi, type, dst, incoming(Operand::ofReg(reg, type)));
+            phi.targets = exitPreds;
+            newPhis.push_back(phi);
+            round.renames[reg] = {l, exit, Operand::ofReg(dst, type)};
+        }
+        exitCode.insert(exitCode.begin() + phis, newPhis.begin(), newPhis.end());
+
+        // A body entered only from the header joins it, so the header's
+        // code runs straight into the body instead of jumping to it.
+        auto& bodyCode = fn.blocks[body]->instrs;
+        if (cfg.preds[body].size() == 1 && bodyCode.front().op != Opcode::Phi) {
+            header.instrs.pop_back();
+            header.instrs.insert(header.instrs.end(), bodyCode.begin(), bodyCode.end());
+            bodyCode.assign(1, Instr(Opcode::Br, ir::Type::Void, -1));
+            bodyCode[0].targets = {body};
+            for (int s : header.successors()) {
+                for (Instr& instr : fn.blocks[s]->instrs) {
+                    for (int& t : instr.targets) {
+                        if (instr.op == Opcode::Phi && t == body) {
+                            t = h;
+                        }
+                    }
+                }
+            }
+            round.joined = true;
+        }
+        for (int b : loop.blocks) {
+            round.taken[b] = true;
+        }
+        return true;
+    }
+
+    // Replaces the reads of header registers after their loops by the
+    // exit phis; the phis themselves read the registers.
+    static void renameReads(ir::Function& fn, const ir::LoopInfo& li, const Round& round) {
+        for (size_t b = 0; b < fn.blocks.size(); ++b) {
+            for (Instr& instr : fn.blocks[b]->instrs) {
+                for (Operand& a : instr.args) {
+                    auto found = a.isReg() ? round.renames.find(a.reg) : round.renames.end();
+                    if (found == round.renames.end()) {
+                        continue;
+                    }
+                    const Rename& rename = found->second;
+                    bool exitPhi = rename.exit == static_cast<int>(b) && instr.op == Opcode::Phi;
+                    if (!li.contains(rename.loop, static_cast<int>(b)) && !exitPhi) {
+                        a = rename.merged;
+                    }
+                }
+            }
+        }
+    }
+
+ public:
+    const char* name() const override { return "rotate"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+        }
+        if (am.get<ir::LoopInfo>(fn).loops.empty()) {
+            return changed;
+        }
+        changed = ir::insertPreheaders(fn, am) || changed;
+
+        // Rotating a loop turns its preheader into a branch, which the
+        // analyses of the loops around it see. Each round rotates the
+        // loops that do not nest in each other from one snapshot, so
+        // loops one after another take a single round.
+        for (;;) {
+            auto& cfg = am.get<ir::CFG>(fn);
+            auto& li = am.get<ir::LoopInfo>(fn);
+            Round round(fn);
+            bool rotated = false;
+            for (size_t l = 0; l < li.loops.size(); ++l) {
+                rotated = rotate(fn, li, static_cast<int>(l), cfg, round) || rotated;
+            }
+            if (!rotated) {
+                return changed;
+            }
+            renameReads(fn, li, round);
+            if (round.joined) {
+                fn.removeUnreachableBlocks();
+            }
+            changed = true;
+            am.invalidate(&fn, PreservedAnalyses());
+        }
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createLoopRotationPass() {
+    return std::make_unique<LoopRotationPass>();
+}
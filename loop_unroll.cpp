@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "loop_utils.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Loop unrolling
+// ===============================
+// Unrolls counted loops (ir::CountedLoop: the header is the only exit and
+// tests a basic induction variable against an invariant bound) by a
+// factor U. The unrolled loop runs U copies of the body per test, for as
+// long as U more iterations are certain to remain:
+//     iv pred bound - (U - 1) * step
+// The original loop stays behind it as the remainder loop and finishes the
+// last iterations with its own test. When the bound is a register, the
+// preheader checks that the adjusted bound does not wrap around and goes
+// straight to the remainder loop if it does.
+//
+//     preheader -> unroll.header -> copy 0 -> ... -> copy U-1 -> unroll.header
+//                       |
+//                  unroll.exit -> header (remainder loop) -> exit
+//
+// Only innermost loops are unrolled, and only while U copies stay small.
+// The factor is 4 unless --unroll-factor=N says otherwise; N < 2 turns
+// unrolling off. Without N, a profile (-fprofile-use) picks the factor
+// from the iterations per entry into the loop: the largest power of two
+// up to kMaxProfileFactor that they reach and the size allows. Loops
+// running fewer than two iterations per entry are left alone.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const int kDefaultFactor = 4;
+// Largest body (in instructions) U copies may add up to.
+const int kMaxUnrolledSize = 64;
+// Largest factor a profile may pick.
+const int kMaxProfileFactor = 8;
+
+class LoopUnrollPass : public IRFunctionPass {
+ private:
+    int defaultFactor = kDefaultFactor;
+    bool explicitFactor = false;        // --unroll-factor=N, which a profile does not override
+
+    // One copy of the loop: the value every register of the loop has in
+    // it (fresh registers, or the previous copy's values for the header
+    // phis) and the ids of its cloned blocks.
+    struct Copy {
+        std::map<int, Operand> value;
+        std::map<int, int> block;
+    };
+
+    static Operand mapOperand(const Copy& copy, const Operand& a) {
+        auto found = a.isReg() ? copy.value.find(a.reg) : copy.value.end();
+        return found != copy.value.end() ? found->second : a;
+    }
+
+    static int loopSize(const ir::Function& fn, const ir::Loop& loop) {
+        int size = 0;
+        for (int b : loop.blocks) {
+            for (const Instr& instr : fn.blocks[b]->instrs) {
+                if (instr.op != Opcode::Phi && instr.op != Opcode::Br) {
+                    ++size;
+                }
+            }
+        }
+        return size;
+    }
+
+    // The factor for `counted`: the default, or the profile's choice when
+    // it has counts for the header and the latch; 0 to leave it alone.
+    int factorFor(const ir::Function& fn, const ir::Loop& loop,
+                  const ir::CountedLoop& counted) const {
+        int64_t header = fn.blocks[loop.header]->count;
+        int64_t latch = fn.blocks[counted.latch]->count;
+        if (explicitFactor || header < 0 || latch < 0) {
+            return defaultFactor;
+        }
+        // The header runs once more per entry than the latch.
+        int64_t perEntry = latch / std::max<int64_t>(header - latch, 1);
+        int limit = std::min<int64_t>(perEntry, kMaxUnrolledSize / loopSize(fn, loop));
+        int factor = 0;
+        for (int u = 2; u <= std::min(limit, kMaxProfileFactor); u *= 2) {
+            factor = u;
+        }
+        return factor;
+    }
+
+    // Unrolls `counted`, whose new blocks go to `created` with ids from
+    // `nextId` on; the caller places them before the loop's header.
+    bool unroll(ir::Function& fn, const ir::LoopInfo& li, const ir::CountedLoop& counted,
+                int factor, int& nextId,
+                std::vector<std::unique_ptr<ir::BasicBlock>>& created) {
+        const ir::Loop& loop = li.loops[counted.loop];
+        int64_t trips = ir::tripCount(counted);
+        if ((trips >= 0 && trips < factor) ||
+            loopSize(fn, loop) * factor > kMaxUnrolledSize) {
+            return false;
+        }
+        int64_t magnitude = counted.iv.step < 0 ? -int64_t(counted.iv.step)
+                                                : int64_t(counted.iv.step);
+        int64_t distance = (factor - 1) * magnitude;
+        if (distance > INT32_MAX) {
+            return false;
+        }
+        bool upwards = counted.iv.step > 0;
+
+        // Bound for the unrolled loop's test.
+        ir::BasicBlock& preheader = *fn.blocks[counted.preheader];
+        Operand limit;
+        int ok = -1;
+        if (counted.bound.isImm()) {
+            int64_t value = int64_t(counted.bound.intValue) +
+                            (upwards ? -distance : distance);
+            if (value < INT32_MIN || value > INT32_MAX) {
+                return false;
+            }
+            limit = Operand::ofInt(static_cast<int32_t>(value));
+        } else {
+            int reg = fn.newVReg(ir::Type::Int);
+            preheader.instrs.insert(preheader.instrs.end() - 1,
+                                    Instr(upwards ? Opcode::Sub : Opcode::Add,
+                                          ir::Type::Int, reg,
+                                          {counted.bound,
+                                           Operand::ofInt(static_cast<int32_t>(distance))}));
+            limit = Operand::ofReg(reg, ir::Type::Int);
+            ok = fn.newVReg(ir::Type::Bool);
+            preheader.instrs.insert(preheader.instrs.end() - 1,
+                                    Instr(upwards ? Opcode::CmpLe : Opcode::CmpGe,
+                                          ir::Type::Bool, ok, {limit, counted.bound}));
+        }
+
+        int firstId = nextId;
+        auto addBlock = [&](const std::string& hint) {
+            auto block = std::make_unique<ir::BasicBlock>();
+            block->id = nextId++;
+            block->hint = hint;
+            created.push_back(std::move(block));
+            return created.back().get();
+        };
+        ir::BasicBlock* unrolledHeader = addBlock("unroll.header");
+        std::vector<Copy> copies(factor);
+        for (Copy& copy : copies) {
+            for (int b : loop.blocks) {
+                ir::BasicBlock* clone = addBlock("unroll." + fn.blocks[b]->hint);
+                int64_t count = fn.blocks[b]->count;
+                clone->count = count < 0 ? -1 : (count + factor - 1) / factor;
+                copy.block[b] = clone->id;
+            }
+        }
+        ir::BasicBlock* remainderEntry = addBlock("unroll.exit");
+        auto blockById = [&](int id) {
+            return created[id - firstId].get();
+        };
+
+        ir::BasicBlock& header = *fn.blocks[loop.header];
+        std::vector<Instr*> headerPhis;
+        for (Instr& instr : header.instrs) {
+            if (instr.op == Opcode::Phi) {
+                headerPhis.push_back(&instr);
+            }
+        }
+        auto incoming = [&](const Instr& phi, int pred) {
+            for (size_t i = 0; i < phi.targets.size(); ++i) {
+                if (phi.targets[i] == pred) {
+                    return phi.args[i];
+                }
+            }
+            return Operand();
+        };
+
+        // Header phis of the unrolled loop.
+        std::vector<int> unrolledPhi;
+        for (const Instr* phi : headerPhis) {
+            unrolledPhi.push_back(fn.newVReg(phi->type, fn.vregs[phi->dst].name));
+        }
+
+        for (int c = 0; c < factor; ++c) {
+            Copy& copy = copies[c];
+            for (size_t p = 0; p < headerPhis.size(); ++p) {
+                const Instr& phi = *headerPhis[p];
+                copy.value[phi.dst] = c == 0
+                    ? Operand::ofReg(unrolledPhi[p], phi.type)
+                    : mapOperand(copies[c - 1], incoming(phi, counted.latch));
+            }
+            for (int b : loop.blocks) {
+                ir::BasicBlock* clone = blockById(copy.block.at(b));
+                for (const Instr& src : fn.blocks[b]->instrs) {
+                    if (b == loop.header && src.op == Opcode::Phi) {
+                        continue;
+                    }
+                    Instr instr = src;
+                    for (Operand& a : instr.args) {
+                        a = mapOperand(copy, a);
+                    }
+                    if (instr.dst >= 0) {
+                        int reg = fn.newVReg(fn.regType(src.dst), fn.vregs[src.dst].name);
+                        copy.value[src.dst] = Operand::ofReg(reg, fn.regType(reg));
+                        instr.dst = reg;
+                    }
+                    if (instr.op == Opcode::Phi) {
+                        for (int& t : instr.targets) {
+                            t = copy.block.at(t);
+                        }
+                    } else if (b == loop.header && instr.op == Opcode::CondBr) {
+                        // The unrolled header already checked this iteration.
+                        instr = Instr(Opcode::Br, ir::Type::Void, -1);
+                        instr.targets = {copy.block.at(counted.body)};
+                    } else {
+                        for (int& t : instr.targets) {
+                            if (t == loop.header) {
+                                t = c + 1 < factor
+                                    ? copies[c + 1].block.at(loop.header)
+                                    : unrolledHeader->id;
+                            } else {
+                                t = copy.block.at(t);
+                            }
+                        }
+                    }
+                    clone->instrs.push_back(std::move(instr));
+                }
+            }
+        }
+
+        const Copy& last = copies.back();
+        int lastLatch = last.block.at(counted.latch);
+        int ivPhi = -1;
+        for (size_t p = 0; p < headerPhis.size(); ++p) {
+            const Instr& phi = *headerPhis[p];
+            Instr join(Opcode::Phi, phi.type, unrolledPhi[p],
+                       {incoming(phi, counted.preheader),
+                        mapOperand(last, incoming(phi, counted.latch))});
+            join.targets = {counted.preheader, lastLatch};
+            unrolledHeader->instrs.push_back(std::move(join));
+            if (phi.dst == counted.iv.phi) {
+                ivPhi = unrolledPhi[p];
+            }
+        }
+        int test = fn.newVReg(ir::Type::Bool);
+        unrolledHeader->instrs.emplace_back(counted.pred, ir::Type::Bool, test,
+                                            std::vector<Operand>{
+                                                Operand::ofReg(ivPhi, ir::Type::Int), limit});
+        unrolledHeader->instrs.emplace_back(Opcode::CondBr, ir::Type::Void, -1,
+                                            std::vector<Operand>{
+                                                Operand::ofReg(test, ir::Type::Bool)});
+        unrolledHeader->instrs.back().targets = {copies[0].block.at(loop.header),
+                                                 remainderEntry->id};
+
+        // The remainder loop starts from wherever the unrolled one stopped,
+        // or from the preheader's values when the unrolled loop is skipped.
+        for (size_t p = 0; p < headerPhis.size(); ++p) {
+            Instr& phi = *headerPhis[p];
+            Operand value = Operand::ofReg(unrolledPhi[p], phi.type);
+            if (ok >= 0) {
+                int merged = fn.newVReg(phi.type, fn.vregs[phi.dst].name);
+                Instr join(Opcode::Phi, phi.type, merged,
+                           {Operand::ofReg(unrolledPhi[p], phi.type),
+                            incoming(phi, counted.preheader)});
+                join.targets = {unrolledHeader->id, counted.preheader};
+                remainderEntry->instrs.push_back(std::move(join));
+                value = Operand::ofReg(merged, phi.type);
+            }
+            for (size_t i = 0; i < phi.targets.size(); ++i) {
+                if (phi.targets[i] == counted.preheader) {
+                    phi.args[i] = value;
+                    phi.targets[i] = remainderEntry->id;
+                }
+            }
+        }
+        remainderEntry->instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+        remainderEntry->instrs.back().targets = {loop.header};
+
+        Instr& enter = preheader.terminator();
+        if (ok >= 0) {
+            enter = Instr(Opcode::CondBr, ir::Type::Void, -1,
+                          {Operand::ofReg(ok, ir::Type::Bool)});
+            enter.targets = {unrolledHeader->id, remainderEntry->id};
+        } else {
+            enter.targets = {unrolledHeader->id};
+        }
+        return true;
+    }
+
+ public:
+    const char* name() const override { return "unroll"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    void setOptions(const OptimizationOptions& options) override {
+        explicitFactor = options.unrollFactor >= 0;
+        defaultFactor = explicitFactor ? options.unrollFactor : kDefaultFactor;
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        if ((explicitFactor && defaultFactor < 2) || am.get<ir::LoopInfo>(fn).loops.empty()) {
+            return changed;
+        }
+        changed = ir::insertPreheaders(fn, am) || changed;
+
+        // Innermost loops do not share blocks, and unrolling one only adds
+        // blocks and changes its own preheader and header, so all of them
+        // are found from one analysis. The new blocks get ids past the
+        // existing ones and are put in place once every loop is done.
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& li = am.get<ir::LoopInfo>(fn);
+        std::vector<ir::CountedLoop> candidates;
+        for (size_t l = 0; l < li.loops.size(); ++l) {
+            int loop = static_cast<int>(l);
+            ir::CountedLoop counted;
+            if (li.loops[loop].children.empty() &&
+                ir::analyzeCountedLoop(fn, li, loop, cfg, counted)) {
+                candidates.push_back(counted);
+            }
+        }
+        int nextId = static_cast<int>(fn.blocks.size());
+        std::vector<std::vector<std::unique_ptr<ir::BasicBlock>>> before(fn.blocks.size());
+        bool unrolled = false;
+        for (const ir::CountedLoop& counted : candidates) {
+            const ir::Loop& loop = li.loops[counted.loop];
+            int factor = factorFor(fn, loop, counted);
+            if (factor >= 2 && unroll(fn, li, counted, factor, nextId, before[loop.header])) {
+                unrolled = true;
+            }
+        }
+        if (!unrolled) {
+            return changed;
+        }
+
+        // Everything new goes between the preheader and the header.
+        std::vector<std::unique_ptr<ir::BasicBlock>> ordered;
+        for (size_t b = 0; b < fn.blocks.size(); ++b) {
+            for (auto& block : before[b]) {
+                ordered.push_back(std::move(block));
+            }
+            ordered.push_back(std::move(fn.blocks[b]));
+        }
+        fn.blocks = std::move(ordered);
+        fn.renumberBlocks();
+        am.invalidate(&fn, PreservedAnalyses::none());
+        return true;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createLoopUnrollPass() {
+    return std::make_unique<LoopUnrollPass>();
+}
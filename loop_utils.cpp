@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "loop_utils.hpp"
+
+namespace ir {
+
+int preheaderOf(const LoopInfo& li, int loop, const CFG& cfg) {
+    int header = li.loops[loop].header;
+    int found = -1;
+    for (int p : cfg.preds[header]) {
+        if (li.contains(loop, p)) {
+            continue;
+        }
+        if (found >= 0) {
+            return -1;
+        }
+        found = p;
+    }
+    if (found < 0 || cfg.succs[found].size() != 1) {
+        return -1;
+    }
+    return found;
+}
+
+bool insertPreheaders(Function& fn, AnalysisManager& am) {
+    auto& cfg = am.get<CFG>(fn);
+    auto& li = am.get<LoopInfo>(fn);
+
+    // Headers needing a preheader, with their outside predecessors.
+    std::vector<std::vector<int>> outside(fn.blocks.size());
+    std::vector<int> headers;
+    for (size_t l = 0; l < li.loops.size(); ++l) {
+        int loop = static_cast<int>(l);
+        if (preheaderOf(li, loop, cfg) >= 0) {
+            continue;
+        }
+        int header = li.loops[loop].header;
+        for (int p : cfg.preds[header]) {
+            if (!li.contains(loop, p)) {
+                outside[header].push_back(p);
+            }
+        }
+        headers.push_back(header);
+    }
+    if (headers.empty()) {
+        return false;
+    }
+
+    int nextId = static_cast<int>(fn.blocks.size());
+    std::vector<std::unique_ptr<BasicBlock>> preheader(fn.blocks.size());
+    for (int header : headers) {
+        auto block = std::make_unique<BasicBlock>();
+        block->id = nextId++;
+        block->hint = "preheader";
+        BasicBlock* target = fn.blocks[header].get();
+
+        // Outside predecessors now enter through the preheader.
+        for (int p : outside[header]) {
+            for (int& t : fn.blocks[p]->terminator().targets) {
+                if (t == header) {
+                    t = block->id;
+                }
+            }
+        }
+        for (Instr& phi : target->instrs) {
+            if (phi.op != Opcode::Phi) {
+                break;
+            }
+            std::vector<Operand> args;
+            std::vector<int> preds;
+            for (size_t i = 0; i < phi.targets.size();) {
+                if (std::find(outside[header].begin(), outside[header].end(),
+                              phi.targets[i]) != outside[header].end()) {
+                    args.push_back(phi.args[i]);
+                    preds.push_back(phi.targets[i]);
+                    phi.args.erase(phi.args.begin() + i);
+                    phi.targets.erase(phi.targets.begin() + i);
+                } else {
+                    ++i;
+                }
+            }
+            if (args.empty()) {
+                continue;
+            }
+            Operand merged = args[0];
+            bool same = std::all_of(args.begin(), args.end(),
+                                    [&](const Operand& a) { return a == merged; });
+            if (!same) {
+                int reg = fn.newVReg(phi.type, fn.vregs[phi.dst].name);
+                Instr inner(Opcode::Phi, phi.type, reg, args);
+                inner.targets = preds;
+                block->instrs.push_back(std::move(inner));
+                merged = Operand::ofReg(reg, phi.type);
+            }
+            phi.args.push_back(merged);
+            phi.targets.push_back(block->id);
+        }
+        block->instrs.emplace_back(Opcode::Br, Type::Void, -1);
+        block->instrs.back().targets = {header};
+        preheader[header] = std::move(block);
+    }
+
+    std::vector<std::unique_ptr<BasicBlock>> ordered;
+    for (size_t b = 0; b < fn.blocks.size(); ++b) {
+        if (preheader[b]) {
+            ordered.push_back(std::move(preheader[b]));
+        }
+        ordered.push_back(std::move(fn.blocks[b]));
+    }
+    fn.blocks = std::move(ordered);
+    fn.renumberBlocks();
+    am.invalidate(&fn, PreservedAnalyses::none());
+    return true;
+}
+
+namespace {
+
+// The instruction of `loop` defining `reg`, or null if it is defined
+// outside the loop.
+const Instr* definitionIn(const Function& fn, const Loop& loop, int reg) {
+    for (int b : loop.blocks) {
+        for (const Instr& instr : fn.blocks[b]->instrs) {
+            if (instr.dst == reg) {
+                return &instr;
+            }
+        }
+    }
+    return nullptr;
+}
+
+}  // anonymous namespace
+
+std::vector<InductionVariable> findInductionVariables(const Function& fn,
+                                                      const LoopInfo& li,
+                                                      int loop, const CFG& cfg) {
+    std::vector<InductionVariable> ivs;
+    const Loop& l = li.loops[loop];
+    int preheader = preheaderOf(li, loop, cfg);
+    if (preheader < 0 || l.latches.size() != 1) {
+        return ivs;
+    }
+    int latch = l.latches[0];
+
+    for (const Instr& phi : fn.blocks[l.header]->instrs) {
+        if (phi.op != Opcode::Phi) {
+            break;
+        }
+        if (phi.type != Type::Int || phi.targets.size() != 2) {
+            continue;
+        }
+        int fromPre = phi.targets[0] == preheader ? 0 : 1;
+        if (phi.targets[fromPre] != preheader || phi.targets[1 - fromPre] != latch) {
+            continue;
+        }
+        const Operand& next = phi.args[1 - fromPre];
+        const Instr* update = next.isReg() ? definitionIn(fn, l, next.reg) : nullptr;
+        if (!update || (update->op != Opcode::Add && update->op != Opcode::Sub)) {
+            continue;
+        }
+        const Operand& a = update->args[0];
+        const Operand& b = update->args[1];
+        bool aIsPhi = a.isReg() && a.reg == phi.dst;
+        bool bIsPhi = b.isReg() && b.reg == phi.dst;
+        int32_t step = 0;
+        if (aIsPhi && b.isImm()) {
+            if (update->op == Opcode::Sub && b.intValue == INT32_MIN) {
+                continue;
+            }
+            step = update->op == Opcode::Add ? b.intValue : -b.intValue;
+        } else if (bIsPhi && a.isImm() && update->op == Opcode::Add) {
+            step = a.intValue;
+        }
+        if (step == 0) {
+            continue;
+        }
+        ivs.push_back({phi.dst, next.reg, phi.args[fromPre], step});
+    }
+    return ivs;
+}
+
+bool analyzeCountedLoop(const Function& fn, const LoopInfo& li, int loop,
+                        const CFG& cfg, CountedLoop& counted) {
+    const Loop& l = li.loops[loop];
+    int preheader = preheaderOf(li, loop, cfg);
+    if (preheader < 0 || l.latches.size() != 1) {
+        return false;
+    }
+    for (int b : l.blocks) {
+        for (int s : cfg.succs[b]) {
+            if (b != l.header && !li.contains(loop, s)) {
+                return false;
+            }
+        }
+    }
+    const BasicBlock& header = *fn.blocks[l.header];
+    const Instr& br = header.terminator();
+    if (br.op != Opcode::CondBr || !br.args[0].isReg()) {
+        return false;
+    }
+    bool continueOnTrue = li.contains(loop, br.targets[0]);
+    if (continueOnTrue == li.contains(loop, br.targets[1])) {
+        return false;
+    }
+
+    const Instr* cmp = nullptr;
+    for (const Instr& instr : header.instrs) {
+        if (instr.dst >= 0 && instr.dst == br.args[0].reg) {
+            cmp = &instr;
+        }
+    }
+    if (!cmp || !isCompare(cmp->op) || cmp->args[0].type != Type::Int) {
+        return false;
+    }
+
+    for (const InductionVariable& iv : findInductionVariables(fn, li, loop, cfg)) {
+        Opcode pred = cmp->op;
+        Operand bound;
+        if (cmp->args[0].isReg() && cmp->args[0].reg == iv.phi) {
+            bound = cmp->args[1];
+        } else if (cmp->args[1].isReg() && cmp->args[1].reg == iv.phi) {
+            bound = cmp->args[0];
+            pred = swapCompare(pred);
+        } else {
+            continue;
+        }
+        if (!continueOnTrue) {
+            pred = invertCompare(pred);
+        }
+        if (bound.isReg() && definitionIn(fn, l, bound.reg)) {
+            continue;
+        }
+        bool upwards = (pred == Opcode::CmpLt || pred == Opcode::CmpLe) && iv.step > 0;
+        bool downwards = (pred == Opcode::CmpGt || pred == Opcode::CmpGe) && iv.step < 0;
+        if (!upwards && !downwards) {
+            continue;
+        }
+        counted.loop = loop;
+        counted.preheader = preheader;
+        counted.latch = l.latches[0];
+        counted.body = br.targets[continueOnTrue ? 0 : 1];
+        counted.exit = br.targets[continueOnTrue ? 1 : 0];
+        counted.iv = iv;
+        counted.pred = pred;
+        counted.bound = bound;
+        return true;
+    }
+    return false;
+}
+
+int64_t tripCount(const CountedLoop& counted) {
+    if (!counted.iv.start.isImm() || !counted.bound.isImm()) {
+        return -1;
+    }
+    int64_t start = counted.iv.start.intValue;
+    int64_t bound = counted.bound.intValue;
+    int64_t step = counted.iv.step;
+    // Distance to the first value that fails the predicate.
+    int64_t distance = 0;
+    switch (counted.pred) {
+        case Opcode::CmpLt: distance = bound - start; break;
+        case Opcode::CmpLe: distance = bound - start + 1; break;
+        case Opcode::CmpGt: distance = start - bound; break;
+        default: distance = start - bound + 1; break;
+    }
+    if (distance <= 0) {
+        return 0;
+    }
+    int64_t magnitude = step < 0 ? -step : step;
+    int64_t trips = (distance + magnitude - 1) / magnitude;
+    // The value that ends the loop must not have wrapped around.
+    int64_t last = start + trips * step;
+    if (last < INT32_MIN || last > INT32_MAX) {
+        return -1;
+    }
+    return trips;
+}
+
+}  // namespace ir
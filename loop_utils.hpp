@@ -0,0 +1,68 @@
+#ifndef LOOP_UTILS_HPP
+#define LOOP_UTILS_HPP
+
+#include <cstdint>
+#include <vector>
+#include "ir.hpp"
+#include "ir_analysis.hpp"
+#include "pass_manager.hpp"
+
+// ===============================
+// Loop canonicalization helpers
+// ===============================
+
+namespace ir {
+
+// The block every entry into `loop` comes through: its header's only
+// predecessor outside the loop, provided that block branches nowhere else.
+// Returns -1 if the loop has no such block.
+int preheaderOf(const LoopInfo& li, int loop, const CFG& cfg);
+
+// Gives every loop a preheader, laid out right before its header. Phi
+// inputs from several outside predecessors are merged by a phi in the new
+// block. Returns true (and invalidates `am` for `fn`) if blocks were added.
+bool insertPreheaders(Function& fn, AnalysisManager& am);
+
+// A basic induction variable of a loop in SSA form: a header phi that
+// enters with `start` and is advanced by a constant step once per
+// iteration, `phi = [start, preheader], [next, latch]` with
+// `next = phi + step`.
+struct InductionVariable {
+    int phi = -1;
+    int next = -1;
+    Operand start;
+    int32_t step = 0;
+};
+
+// Basic induction variables of `loop`, which needs a preheader and a
+// single latch.
+std::vector<InductionVariable> findInductionVariables(const Function& fn,
+                                                      const LoopInfo& li,
+                                                      int loop, const CFG& cfg);
+
+// A loop that leaves only from its header, once `iv pred bound` stops
+// holding; the bound is an immediate or a register defined outside the
+// loop. Only predicates that move towards the bound are accepted (< and <=
+// for a positive step, > and >= for a negative one).
+struct CountedLoop {
+    int loop = -1;
+    int preheader = -1;
+    int latch = -1;
+    int body = -1;           // header successor inside the loop
+    int exit = -1;           // header successor outside the loop
+    InductionVariable iv;
+    Opcode pred = Opcode::CmpLt;
+    Operand bound;
+};
+
+bool analyzeCountedLoop(const Function& fn, const LoopInfo& li, int loop,
+                        const CFG& cfg, CountedLoop& counted);
+
+// Number of times the body of `counted` runs when its start and bound are
+// constants, or -1 when they are not or the induction variable would wrap
+// around before the loop ends.
+int64_t tripCount(const CountedLoop& counted);
+
+}  // namespace ir
+
+#endif /* LOOP_UTILS_HPP */
@@ -3,25 +3,113 @@
 #endif
 
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 #include "compiler.hpp"
+#include "pass_manager.hpp"
+#include "mips_peephole.hpp"
 
 extern int yydebug;
 
+// Profile written and read when -fprofile-generate/-fprofile-use name none.
+static const char* const kDefaultProfile = "default.profile";
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog
+              << " [-O0|-O1|-O2|-O3|-Os] [--passes=p1,p2,...] [--time-passes]"
+              << " [--dump-ir] [--inline-threshold=N] [--unroll-factor=N]"
+              << " [--disable-peephole=r1,r2,...] [--peephole-stats] [--memoize]"
+              << " [-fprofile-generate[=file]] [-fprofile-use[=file]]"
+              << " <source-file> <output-file>" << std::endl;
+}
+
+static std::vector<std::string> splitPassList(const std::string& list) {
+    std::vector<std::string> names;
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
 int main(int argc, char** argv) {
     yydebug = YYDEBUG;  // Set to 1 to enable parser debug output
 
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0]
-                  << " <source-file> <output-file>" << std::endl;
+    OptimizationOptions options;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'O') {
+            options.level = arg.substr(1);
+            if (!isKnownOptLevel(options.level)) {
+                std::cerr << "Unknown optimization level: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--passes=", 0) == 0) {
+            options.passes = splitPassList(arg.substr(9));
+            options.customPipeline = true;
+        } else if (arg == "--time-passes") {
+            options.timePasses = true;
+        } else if (arg == "--dump-ir") {
+            options.dumpIR = true;
+        } else if (arg.rfind("--inline-threshold=", 0) == 0) {
+            try {
+                options.inlineThreshold = std::stoi(arg.substr(19));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid inline threshold: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--unroll-factor=", 0) == 0) {
+            try {
+                options.unrollFactor = std::stoi(arg.substr(16));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid unroll factor: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--disable-peephole=", 0) == 0) {
+            options.disabledPeepholes = splitPassList(arg.substr(19));
+            for (const std::string& rule : options.disabledPeepholes) {
+                if (!isPeepholeRule(rule)) {
+                    std::cerr << "Unknown peephole rule: " << rule << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--peephole-stats") {
+            options.peepholeStats = true;
+        } else if (arg == "--memoize") {
+            options.memoize = true;
+        } else if (arg == "-fprofile-generate") {
+            options.profileGenerate = kDefaultProfile;
+        } else if (arg.rfind("-fprofile-generate=", 0) == 0 && arg.size() > 19) {
+            options.profileGenerate = arg.substr(19);
+        } else if (arg == "-fprofile-use") {
+            options.profileUse = kDefaultProfile;
+        } else if (arg.rfind("-fprofile-use=", 0) == 0 && arg.size() > 14) {
+            options.profileUse = arg.substr(14);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 2) {
+        printUsage(argv[0]);
         return 1;
     }
 
-    std::string sourceFile = argv[1];
-    std::string outputFile = argv[2];
+    std::string sourceFile = positional[0];
+    std::string outputFile = positional[1];
 
     try {
-        Compiler compiler(sourceFile, outputFile);
+        Compiler compiler(sourceFile, outputFile, options);
         compiler.compile();
     } catch (const std::exception& e) {
         std::cerr << "Unexpected exception: " << e.what() << std::endl;
@@ -0,0 +1,61 @@
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Memoization
+// ===============================
+// A pure recursive function of one int, such as
+//     func fib(n: int): int { ... return fib(n - 1) + fib(n - 2); }
+// computes the same results over and over: the calls of fib(n) make an
+// exponential number of calls of fib(1). This pass marks such functions
+// memoized (ir::Function::memoEntries) and the backend gives each a
+// direct-mapped table in .data: the argument modulo kMemoEntries selects
+// an entry holding an argument and its result, and a bitmap tells which
+// entries were filled. The function first looks its argument up and
+// returns the stored result on a hit; every return stores the result.
+// fib then runs in time linear in n.
+//
+// Only functions that neither print nor touch globals qualify, so a cached
+// result is always the one the call would have computed; a call stopping
+// on a division by zero never returns and caches nothing. The pass is not
+// part of any level: --memoize appends it to the pipeline.
+
+namespace {
+
+// Entries of every table; a power of two, so an entry is a masked argument.
+const int kMemoEntries = 256;
+
+class MemoizePass : public IRModulePass {
+ public:
+    const char* name() const override { return "memoize"; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses::allAnalyses();
+    }
+
+    bool runOnModule(ir::Module& module, AnalysisManager& am) override {
+        auto& cg = am.get<ir::CallGraph>(module);
+        std::vector<bool> pure = cg.pureFunctions();
+        bool changed = false;
+        for (size_t f = 0; f < cg.functions.size(); ++f) {
+            ir::Function& fn = *cg.functions[f];
+            if (!pure[f] || !cg.isRecursive(static_cast<int>(f)) || fn.label == "main" ||
+                fn.retType == ir::Type::Void || fn.params.size() != 1 ||
+                fn.regType(fn.params[0]) != ir::Type::Int || fn.memoEntries > 0) {
+                continue;
+            }
+            fn.memoEntries = kMemoEntries;
+            changed = true;
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createMemoizePass() {
+    return std::make_unique<MemoizePass>();
+}
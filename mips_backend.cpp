@@ -0,0 +1,955 @@
+#include <cstring>
+#include <iomanip>
+#include <utility>
+
+#include "mips_backend.hpp"
+#include "exception.hpp"
+#include "profile.hpp"
+
+using ir::Opcode;
+using ir::Operand;
+using ir::Type;
+
+namespace {
+
+// Return label of every function but main when optimizing for size.
+const char* const kSharedEpilogue = "shared_epilogue";
+
+// open(2) flags O_WRONLY | O_CREAT | O_TRUNC and mode 0644 of the profile
+// file; SPIM passes both on to the host.
+const int kProfileOpenFlags = 577;
+const int kProfileOpenMode = 420;
+
+}  // anonymous namespace
+
+// ===============================
+// Labels and constants
+// ===============================
+
+std::string MipsBackend::newLabel(const std::string& base) {
+    std::ostringstream oss;
+    oss << base << "_" << labelCounter++;
+    return oss.str();
+}
+
+std::string MipsBackend::blockLabel(int id) const {
+    return fn->label + "_bb" + std::to_string(id);
+}
+
+std::string MipsBackend::globalLabel(const std::string& name) const {
+    return "global_" + name;
+}
+
+std::string MipsBackend::floatLabel(float value) {
+    // Constants are emitted by bit pattern so every float round-trips.
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto it = floatConstants.find(bits);
+    if (it != floatConstants.end()) {
+        return it->second;
+    }
+    std::string label = "float_" + std::to_string(floatConstants.size());
+    floatConstants[bits] = label;
+    dataSection << label << ":\n"
+                << "    .word " << bits << "    # "
+                << std::setprecision(9) << value << "\n";
+    return label;
+}
+
+// ===============================
+// Operand access
+// ===============================
+
+std::string MipsBackend::intOperand(const Operand& op, const std::string& scratch) {
+    if (op.isReg() && !physReg[op.reg].empty()) {
+        return physReg[op.reg];
+    }
+    loadInt(scratch, op);
+    return scratch;
+}
+
+std::string MipsBackend::resultReg(const ir::Instr& instr) const {
+    if (instr.dst >= 0 && !physReg[instr.dst].empty()) {
+        return physReg[instr.dst];
+    }
+    return "$t0";
+}
+
+void MipsBackend::loadInt(const std::string& reg, const Operand& op) {
+    if (op.isImm()) {
+        textSection << "    li " << reg << ", " << op.intValue << "\n";
+    } else if (!physReg[op.reg].empty()) {
+        if (physReg[op.reg] != reg) {
+            textSection << "    move " << reg << ", " << physReg[op.reg] << "\n";
+        }
+    } else {
+        textSection << "    lw " << reg << ", " << slotOffset[op.reg] << "($fp)\n";
+    }
+}
+
+void MipsBackend::loadFloat(const std::string& reg, const Operand& op) {
+    if (op.isImm()) {
+        textSection << "    l.s " << reg << ", " << floatLabel(op.floatValue) << "\n";
+    } else {
+        textSection << "    l.s " << reg << ", " << slotOffset[op.reg] << "($fp)\n";
+    }
+}
+
+void MipsBackend::storeResult(const ir::Instr& instr, const std::string& reg) {
+    if (instr.dst < 0) {
+        return;
+    }
+    if (!physReg[instr.dst].empty()) {
+        if (physReg[instr.dst] != reg) {
+            textSection << "    move " << physReg[instr.dst] << ", " << reg << "\n";
+        }
+        return;
+    }
+    const char* op = fn->regType(instr.dst) == Type::Float ? "s.s" : "sw";
+    textSection << "    " << op << " " << reg << ", "
+                << slotOffset[instr.dst] << "($fp)\n";
+}
+
+// ===============================
+// Strength reduction
+// ===============================
+// Multiplications and divisions by an immediate avoid mul and div, which
+// take many cycles on MIPS. A product becomes at most three shifts and
+// adds/subtracts of $t0; a quotient by 2^k becomes an arithmetic shift,
+// rounded toward zero by first adding 2^k - 1 to negative dividends, and
+// any other divisor becomes a multiply-high by its magic number (Hacker's
+// Delight, chapter 10). A non-zero immediate divisor needs no zero check.
+
+namespace {
+
+int log2Exact(uint32_t v) {
+    if (v == 0 || (v & (v - 1)) != 0) {
+        return -1;
+    }
+    int k = 0;
+    while ((v >> k) != 1) {
+        ++k;
+    }
+    return k;
+}
+
+// Instructions computing $t0 * c in place, or false if mul is cheaper.
+bool mulByConstant(int32_t c, std::vector<std::string>& seq) {
+    if (c == 0) {
+        seq.push_back("move $t0, $zero");
+        return true;
+    }
+    bool negate = c < 0 && c != INT32_MIN;
+    uint32_t m = negate ? static_cast<uint32_t>(-c) : static_cast<uint32_t>(c);
+    int k = log2Exact(m);
+    if (k > 0) {
+        seq.push_back("sll $t0, $t0, " + std::to_string(k));
+    } else if (k < 0) {
+        // m = 2^hi + 2^lo or m = 2^hi - 2^lo.
+        uint32_t low = m & (~m + 1);
+        int lo = log2Exact(low);
+        int hi = log2Exact(m - low);
+        bool add = hi >= 0;
+        if (!add) {
+            hi = log2Exact(m + low);
+            if (hi < 0) {
+                return false;
+            }
+        }
+        seq.push_back("sll $t1, $t0, " + std::to_string(hi));
+        if (lo > 0) {
+            seq.push_back("sll $t0, $t0, " + std::to_string(lo));
+        }
+        seq.push_back(add ? "addu $t0, $t1, $t0" : "subu $t0, $t1, $t0");
+    }
+    if (negate) {
+        seq.push_back("subu $t0, $zero, $t0");
+    }
+    return seq.size() <= 3;
+}
+
+struct Magic {
+    int32_t multiplier;
+    int shift;
+};
+
+// Magic number for signed division by d, |d| >= 2 and not a power of two.
+Magic magicNumber(int32_t d) {
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+    uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    int p = 31;
+    uint32_t q1 = two31 / anc;
+    uint32_t r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad;
+    uint32_t r2 = two31 - q2 * ad;
+    uint32_t delta = 0;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    uint32_t m = q2 + 1;
+    if (d < 0) {
+        m = 0u - m;
+    }
+    return {static_cast<int32_t>(m), p - 32};
+}
+
+}  // anonymous namespace
+
+void MipsBackend::emitDivByConstant(int32_t d) {
+    if (d == 1) {
+        return;
+    }
+    if (d == -1) {
+        textSection << "    subu $t0, $zero, $t0\n";
+        return;
+    }
+    uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+    int k = log2Exact(ad);
+    if (k > 0) {
+        // Negative dividends are biased by 2^k - 1 to round toward zero.
+        if (k > 1) {
+            textSection << "    sra $t1, $t0, 31\n";
+            textSection << "    srl $t1, $t1, " << 32 - k << "\n";
+        } else {
+            textSection << "    srl $t1, $t0, 31\n";
+        }
+        textSection << "    addu $t1, $t0, $t1\n";
+        textSection << "    sra $t0, $t1, " << k << "\n";
+        if (d < 0) {
+            textSection << "    subu $t0, $zero, $t0\n";
+        }
+        return;
+    }
+    Magic magic = magicNumber(d);
+    textSection << "    li $t1, " << magic.multiplier << "\n";
+    textSection << "    mult $t0, $t1\n";
+    textSection << "    mfhi $t1\n";
+    if (d > 0 && magic.multiplier < 0) {
+        textSection << "    addu $t1, $t1, $t0\n";
+    } else if (d < 0 && magic.multiplier > 0) {
+        textSection << "    subu $t1, $t1, $t0\n";
+    }
+    if (magic.shift > 0) {
+        textSection << "    sra $t1, $t1, " << magic.shift << "\n";
+    }
+    // Add one to negative quotients.
+    textSection << "    srl $t0, $t1, 31\n";
+    textSection << "    addu $t0, $t1, $t0\n";
+}
+
+// ===============================
+// Functions
+// ===============================
+
+void MipsBackend::emitFunction(const ir::Function& function) {
+    fn = &function;
+    bool isMain = function.label == "main";
+    bool sharedEpilogue = optimizeSize && !isMain;
+
+    // main never returns, so it need not keep the $s registers.
+    RegisterAllocation allocation;
+    if (allocate) {
+        allocation = allocateRegisters(function);
+    } else {
+        allocation.reg.assign(function.vregs.size(), "");
+    }
+    physReg = allocation.reg;
+    std::vector<std::string> saved;
+    if (!isMain) {
+        saved = allocation.calleeSaved;
+    }
+    // With a shared epilogue, a function restoring $s registers returns
+    // through an end of its own that restores them and jumps there.
+    bool ownEnd = !sharedEpilogue || !saved.empty();
+    endLabel = ownEnd ? newLabel(function.label + "_end") : kSharedEpilogue;
+
+    // Arguments sit above the saved $fp/$ra (pushed left to right); below
+    // $fp come the saved $s registers, then a slot for every other
+    // register not kept in a machine register.
+    slotOffset.assign(function.vregs.size(), 0);
+    std::vector<bool> isParam(function.vregs.size(), false);
+    int numParams = static_cast<int>(function.params.size());
+    for (int i = 0; i < numParams; ++i) {
+        slotOffset[function.params[i]] = 8 + 4 * (numParams - 1 - i);
+        isParam[function.params[i]] = true;
+    }
+    // Registers that optimizations left without any reference get no slot.
+    std::vector<bool> used(function.vregs.size(), false);
+    std::vector<int> reads(function.vregs.size(), 0);
+    for (const auto& block : function.blocks) {
+        for (const ir::Instr& instr : block->instrs) {
+            if (instr.dst >= 0) {
+                used[instr.dst] = true;
+            }
+            for (const Operand& a : instr.args) {
+                if (a.isReg()) {
+                    used[a.reg] = true;
+                    ++reads[a.reg];
+                }
+            }
+        }
+    }
+
+    // A comparison whose only reader is the conditional branch ending its
+    // block is never materialized when no instruction between them writes
+    // its operands: the branch compares them itself.
+    fusedBranches.clear();
+    fusedCompares.clear();
+    for (const auto& block : function.blocks) {
+        if (block->instrs.empty()) {
+            continue;
+        }
+        const ir::Instr& branch = block->instrs.back();
+        if (branch.op != Opcode::CondBr || !branch.args[0].isReg() ||
+            reads[branch.args[0].reg] != 1) {
+            continue;
+        }
+        std::set<int> written;
+        for (size_t k = block->instrs.size() - 1; k-- > 0;) {
+            const ir::Instr& instr = block->instrs[k];
+            if (instr.dst != branch.args[0].reg) {
+                written.insert(instr.dst);
+                continue;
+            }
+            bool stable = ir::isCompare(instr.op);
+            for (const Operand& a : instr.args) {
+                stable = stable && !(a.isReg() && written.count(a.reg));
+            }
+            if (stable) {
+                fusedBranches[&branch] = &instr;
+                fusedCompares.insert(&instr);
+            }
+            break;
+        }
+    }
+    int frameSize = 4 * static_cast<int>(saved.size());
+    for (size_t r = 0; r < function.vregs.size(); ++r) {
+        if (!isParam[r] && used[r] && physReg[r].empty()) {
+            frameSize += 4;
+            slotOffset[r] = -frameSize;
+        }
+    }
+    // The parameter's own slot may be assigned by the body, so the memo
+    // key is kept in a slot of its own.
+    if (function.memoEntries > 0) {
+        frameSize += 4;
+        memoKeyOffset = -frameSize;
+    }
+
+    textSection << "\n# Function " << function.name << "\n";
+    if (isMain) {
+        textSection << ".globl main\n";
+    }
+    textSection << function.label << ":\n";
+    textSection << "    addi $sp, $sp, -8\n";
+    textSection << "    sw $fp, 4($sp)\n";
+    textSection << "    sw $ra, 0($sp)\n";
+    textSection << "    move $fp, $sp\n";
+    if (frameSize > 0) {
+        textSection << "    addi $sp, $sp, " << -frameSize << "\n";
+    }
+    for (size_t k = 0; k < saved.size(); ++k) {
+        textSection << "    sw " << saved[k] << ", " << -4 * static_cast<int>(k + 1) << "($fp)\n";
+    }
+    // A memoized function returns a stored result when it has one, and
+    // its returns go through the code storing the result.
+    std::string returnLabel = endLabel;
+    if (function.memoEntries > 0) {
+        emitMemoLookup(returnLabel);
+        endLabel = newLabel(function.label + "_memo_store");
+    }
+    for (int param : function.params) {
+        if (!physReg[param].empty()) {
+            textSection << "    lw " << physReg[param] << ", " << slotOffset[param] << "($fp)\n";
+        }
+    }
+
+    for (size_t i = 0; i < function.blocks.size(); ++i) {
+        const ir::BasicBlock& block = *function.blocks[i];
+        if (i > 0) {
+            textSection << blockLabel(block.id) << ":\n";
+        }
+        int next = i + 1 < function.blocks.size()
+            ? function.blocks[i + 1]->id
+            : -1;
+        for (const ir::Instr& instr : block.instrs) {
+            emitInstr(instr, next);
+        }
+    }
+
+    if (function.memoEntries > 0) {
+        textSection << endLabel << ":\n";
+        emitMemoStore();
+        endLabel = returnLabel;
+        if (!ownEnd) {
+            textSection << "    j " << endLabel << "\n";
+        }
+    }
+    if (!ownEnd) {
+        fn = nullptr;
+        return;
+    }
+    textSection << endLabel << ":\n";
+    for (size_t k = 0; k < saved.size(); ++k) {
+        textSection << "    lw " << saved[k] << ", " << -4 * static_cast<int>(k + 1) << "($fp)\n";
+    }
+    if (sharedEpilogue) {
+        textSection << "    j " << kSharedEpilogue << "\n";
+        fn = nullptr;
+        return;
+    }
+    textSection << "    move $sp, $fp\n";
+    textSection << "    lw $ra, 0($sp)\n";
+    textSection << "    lw $fp, 4($sp)\n";
+    textSection << "    addi $sp, $sp, 8\n";
+    if (isMain) {
+        if (profileCounters > 0) {
+            textSection << "    jal profile_dump\n";
+        }
+        textSection << "    li $v0, 10\n";
+        textSection << "    syscall\n";
+    } else {
+        textSection << "    jr $ra\n";
+    }
+    fn = nullptr;
+}
+
+// ===============================
+// Memo tables
+// ===============================
+// Entry e = n & (memoEntries - 1) of a memoized function of n holds an
+// argument in <label>_memo_keys and its result in <label>_memo_values;
+// bit e of the <label>_memo_valid bitmap is set once it was filled. The
+// argument is the only parameter, at 8($fp); the lookup copies it to the
+// slot at memoKeyOffset, which the store reads after the body ran.
+
+void MipsBackend::emitMemoLookup(const std::string& returnLabel) {
+    std::string memo = fn->label + "_memo";
+    std::string miss = newLabel(fn->label + "_memo_miss");
+    int mask = fn->memoEntries - 1;
+    textSection << "    lw $t0, 8($fp)\n";
+    textSection << "    sw $t0, " << memoKeyOffset << "($fp)\n";
+    textSection << "    andi $t1, $t0, " << mask << "\n";
+    textSection << "    srl $t1, $t1, 5\n";
+    textSection << "    sll $t1, $t1, 2\n";
+    textSection << "    lw $t1, " << memo << "_valid($t1)\n";
+    textSection << "    srlv $t1, $t1, $t0\n";
+    textSection << "    andi $t1, $t1, 1\n";
+    textSection << "    beq $t1, $zero, " << miss << "\n";
+    textSection << "    andi $t1, $t0, " << mask << "\n";
+    textSection << "    sll $t1, $t1, 2\n";
+    textSection << "    lw $v0, " << memo << "_keys($t1)\n";
+    textSection << "    bne $v0, $t0, " << miss << "\n";
+    if (fn->retType == Type::Float) {
+        textSection << "    l.s $f0, " << memo << "_values($t1)\n";
+    } else {
+        textSection << "    lw $v0, " << memo << "_values($t1)\n";
+    }
+    textSection << "    j " << returnLabel << "\n";
+    textSection << miss << ":\n";
+}
+
+void MipsBackend::emitMemoStore() {
+    std::string memo = fn->label + "_memo";
+    textSection << "    lw $t0, " << memoKeyOffset << "($fp)\n";
+    textSection << "    andi $t1, $t0, " << fn->memoEntries - 1 << "\n";
+    textSection << "    sll $t1, $t1, 2\n";
+    textSection << "    sw $t0, " << memo << "_keys($t1)\n";
+    if (fn->retType == Type::Float) {
+        textSection << "    s.s $f0, " << memo << "_values($t1)\n";
+    } else {
+        textSection << "    sw $v0, " << memo << "_values($t1)\n";
+    }
+    // Bit n & 31 of word (e / 32) of the bitmap; sllv shifts by n & 31.
+    textSection << "    srl $t1, $t1, 7\n";
+    textSection << "    sll $t1, $t1, 2\n";
+    textSection << "    li $a0, 1\n";
+    textSection << "    sllv $a0, $a0, $t0\n";
+    textSection << "    lw $t0, " << memo << "_valid($t1)\n";
+    textSection << "    or $t0, $t0, $a0\n";
+    textSection << "    sw $t0, " << memo << "_valid($t1)\n";
+}
+
+// ===============================
+// Instructions
+// ===============================
+
+namespace {
+
+// The c.<cond>.s instruction setting the FP flag for `op` on $f0, $f2;
+// false if the flag is set when the comparison is false (CmpNe).
+bool floatCompare(Opcode op, std::string& cmp) {
+    switch (op) {
+        case Opcode::CmpEq: cmp = "c.eq.s $f0, $f2"; return true;
+        case Opcode::CmpNe: cmp = "c.eq.s $f0, $f2"; return false;
+        case Opcode::CmpLt: cmp = "c.lt.s $f0, $f2"; return true;
+        case Opcode::CmpGt: cmp = "c.lt.s $f2, $f0"; return true;
+        case Opcode::CmpLe: cmp = "c.le.s $f0, $f2"; return true;
+        default: cmp = "c.le.s $f2, $f0"; return true;
+    }
+}
+
+// True if adding c (subtracting it, for Sub) fits addiu's immediate.
+bool immediateAdd(Opcode op, int32_t c) {
+    int64_t value = op == Opcode::Add ? int64_t(c) : -int64_t(c);
+    return value >= -32768 && value <= 32767;
+}
+
+}  // anonymous namespace
+
+void MipsBackend::emitCompareBranch(const ir::Instr& cmp, bool ifTrue,
+                                    const std::string& target) {
+    Operand lhs = cmp.args[0];
+    Operand rhs = cmp.args[1];
+    if (lhs.type == Type::Float) {
+        loadFloat("$f0", lhs);
+        loadFloat("$f2", rhs);
+        std::string test;
+        bool flagIfTrue = floatCompare(cmp.op, test);
+        textSection << "    " << test << "\n";
+        textSection << "    " << (flagIfTrue == ifTrue ? "bc1t " : "bc1f ") << target << "\n";
+        return;
+    }
+
+    Opcode op = ifTrue ? cmp.op : ir::invertCompare(cmp.op);
+    if (lhs.isImm() && !rhs.isImm()) {
+        std::swap(lhs, rhs);
+        op = ir::swapCompare(op);
+    }
+    std::string x = intOperand(lhs, "$t0");
+    if (rhs.isImm() && rhs.intValue == 0) {
+        // Comparisons with zero have branches of their own.
+        const char* branch = op == Opcode::CmpEq ? "beq "
+            : op == Opcode::CmpNe ? "bne "
+            : op == Opcode::CmpLt ? "bltz "
+            : op == Opcode::CmpGt ? "bgtz "
+            : op == Opcode::CmpLe ? "blez " : "bgez ";
+        bool twoOperands = op == Opcode::CmpEq || op == Opcode::CmpNe;
+        textSection << "    " << branch << x << (twoOperands ? ", $zero, " : ", ")
+                    << target << "\n";
+        return;
+    }
+    std::string y = intOperand(rhs, "$t1");
+    const char* mnemonic = op == Opcode::CmpEq ? "beq"
+        : op == Opcode::CmpNe ? "bne"
+        : op == Opcode::CmpLt ? "blt"
+        : op == Opcode::CmpGt ? "bgt"
+        : op == Opcode::CmpLe ? "ble" : "bge";
+    textSection << "    " << mnemonic << " " << x << ", " << y << ", " << target << "\n";
+}
+
+void MipsBackend::emitInstr(const ir::Instr& instr, int nextBlock) {
+    const std::vector<Operand>& a = instr.args;
+    bool isFloat = !a.empty() && a[0].type == Type::Float;
+    std::vector<std::string> sequence;
+
+    switch (instr.op) {
+        case Opcode::Copy:
+            if (isFloat) {
+                loadFloat("$f0", a[0]);
+                storeResult(instr, "$f0");
+            } else {
+                std::string d = resultReg(instr);
+                loadInt(d, a[0]);
+                storeResult(instr, d);
+            }
+            break;
+
+        case Opcode::Neg:
+            if (isFloat) {
+                loadFloat("$f0", a[0]);
+                textSection << "    neg.s $f0, $f0\n";
+                storeResult(instr, "$f0");
+            } else {
+                std::string x = intOperand(a[0], "$t0");
+                std::string d = resultReg(instr);
+                textSection << "    subu " << d << ", $zero, " << x << "\n";
+                storeResult(instr, d);
+            }
+            break;
+
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+            if (isFloat) {
+                loadFloat("$f0", a[0]);
+                loadFloat("$f2", a[1]);
+                if (instr.op == Opcode::Div) {
+                    // +0.0 and -0.0 both have all bits but the sign clear.
+                    textSection << "    mfc1 $t1, $f2\n";
+                    textSection << "    sll $t1, $t1, 1\n";
+                    textSection << "    beq $t1, $zero, div_by_zero\n";
+                }
+                const char* mnemonic = instr.op == Opcode::Add ? "add.s"
+                    : instr.op == Opcode::Sub ? "sub.s"
+                    : instr.op == Opcode::Mul ? "mul.s" : "div.s";
+                textSection << "    " << mnemonic << " $f0, $f0, $f2\n";
+                storeResult(instr, "$f0");
+            } else if (instr.op == Opcode::Div && a[1].isImm() && a[1].intValue != 0) {
+                loadInt("$t0", a[0]);
+                emitDivByConstant(a[1].intValue);
+                storeResult(instr, "$t0");
+            } else if (instr.op == Opcode::Mul && (a[0].isImm() || a[1].isImm()) &&
+                       mulByConstant(a[1].isImm() ? a[1].intValue : a[0].intValue, sequence)) {
+                loadInt("$t0", a[1].isImm() ? a[0] : a[1]);
+                for (const std::string& line : sequence) {
+                    textSection << "    " << line << "\n";
+                }
+                storeResult(instr, "$t0");
+            } else if (instr.op != Opcode::Mul && instr.op != Opcode::Div && a[1].isImm() &&
+                       immediateAdd(instr.op, a[1].intValue)) {
+                // Adding or subtracting a small literal takes its immediate form.
+                std::string x = intOperand(a[0], "$t0");
+                std::string d = resultReg(instr);
+                int32_t c = instr.op == Opcode::Add ? a[1].intValue : -a[1].intValue;
+                textSection << "    addiu " << d << ", " << x << ", " << c << "\n";
+                storeResult(instr, d);
+            } else {
+                std::string x = intOperand(a[0], "$t0");
+                std::string y = intOperand(a[1], "$t1");
+                std::string d = resultReg(instr);
+                switch (instr.op) {
+                    case Opcode::Add:
+                        textSection << "    addu " << d << ", " << x << ", " << y << "\n";
+                        break;
+                    case Opcode::Sub:
+                        textSection << "    subu " << d << ", " << x << ", " << y << "\n";
+                        break;
+                    case Opcode::Mul:
+                        textSection << "    mul " << d << ", " << x << ", " << y << "\n";
+                        break;
+                    default:
+                        if (!instr.divisorNonZero) {
+                            textSection << "    beq " << y << ", $zero, div_by_zero\n";
+                        }
+                        textSection << "    div " << x << ", " << y << "\n";
+                        textSection << "    mflo " << d << "\n";
+                        break;
+                }
+                storeResult(instr, d);
+            }
+            break;
+
+        case Opcode::CmpEq:
+        case Opcode::CmpNe:
+        case Opcode::CmpLt:
+        case Opcode::CmpGt:
+        case Opcode::CmpLe:
+        case Opcode::CmpGe:
+            if (fusedCompares.count(&instr)) {
+                break;
+            }
+            if (isFloat) {
+                // c.<cond>.s sets the FP condition flag; materialize it.
+                loadFloat("$f0", a[0]);
+                loadFloat("$f2", a[1]);
+                std::string cmp;
+                bool branchIfTrue = floatCompare(instr.op, cmp);
+                std::string done = newLabel("fcmp_done");
+                textSection << "    li $t0, 1\n";
+                textSection << "    " << cmp << "\n";
+                textSection << "    " << (branchIfTrue ? "bc1t " : "bc1f ")
+                            << done << "\n";
+                textSection << "    li $t0, 0\n";
+                textSection << done << ":\n";
+                storeResult(instr, "$t0");
+            } else {
+                std::string x = intOperand(a[0], "$t0");
+                std::string y = intOperand(a[1], "$t1");
+                std::string d = resultReg(instr);
+                const char* mnemonic = instr.op == Opcode::CmpEq ? "seq"
+                    : instr.op == Opcode::CmpNe ? "sne"
+                    : instr.op == Opcode::CmpLt ? "slt"
+                    : instr.op == Opcode::CmpGt ? "sgt"
+                    : instr.op == Opcode::CmpLe ? "sle" : "sge";
+                textSection << "    " << mnemonic << " " << d << ", " << x << ", " << y << "\n";
+                storeResult(instr, d);
+            }
+            break;
+
+        case Opcode::IntToFloat: {
+            std::string x = intOperand(a[0], "$t0");
+            textSection << "    mtc1 " << x << ", $f0\n";
+            textSection << "    cvt.s.w $f0, $f0\n";
+            storeResult(instr, "$f0");
+            break;
+        }
+
+        case Opcode::IntToBool: {
+            std::string x = intOperand(a[0], "$t0");
+            std::string d = resultReg(instr);
+            textSection << "    sne " << d << ", " << x << ", $zero\n";
+            storeResult(instr, d);
+            break;
+        }
+
+        case Opcode::LoadGlobal:
+            if (instr.type == Type::Float) {
+                textSection << "    l.s $f0, " << globalLabel(instr.symbol) << "\n";
+                storeResult(instr, "$f0");
+            } else {
+                std::string d = resultReg(instr);
+                textSection << "    lw " << d << ", " << globalLabel(instr.symbol) << "\n";
+                storeResult(instr, d);
+            }
+            break;
+
+        case Opcode::StoreGlobal:
+            if (isFloat) {
+                loadFloat("$f0", a[0]);
+                textSection << "    s.s $f0, " << globalLabel(instr.symbol) << "\n";
+            } else {
+                std::string x = intOperand(a[0], "$t0");
+                textSection << "    sw " << x << ", " << globalLabel(instr.symbol) << "\n";
+            }
+            break;
+
+        case Opcode::Call:
+            // Push arguments left-to-right
+            for (const Operand& arg : a) {
+                if (arg.type == Type::Float) {
+                    loadFloat("$f0", arg);
+                    textSection << "    addi $sp, $sp, -4\n";
+                    textSection << "    s.s $f0, 0($sp)\n";
+                } else {
+                    std::string x = intOperand(arg, "$t0");
+                    textSection << "    addi $sp, $sp, -4\n";
+                    textSection << "    sw " << x << ", 0($sp)\n";
+                }
+            }
+            textSection << "    jal " << instr.symbol << "\n";
+            if (!a.empty()) {
+                textSection << "    addi $sp, $sp, " << 4 * a.size() << "\n";
+            }
+            if (instr.type == Type::Float) {
+                storeResult(instr, "$f0");
+            } else if (instr.type != Type::Void) {
+                storeResult(instr, "$v0");
+            }
+            break;
+
+        case Opcode::Print:
+            if (isFloat) {
+                loadFloat("$f0", a[0]);
+                textSection << "    mov.s $f12, $f0\n";
+                textSection << "    li $v0, 2\n";
+            } else {
+                // ints and bools (0/1) both use print_int
+                loadInt("$a0", a[0]);
+                textSection << "    li $v0, 1\n";
+            }
+            textSection << "    syscall\n";
+            textSection << "    la $a0, newline_str\n";
+            textSection << "    li $v0, 4\n";
+            textSection << "    syscall\n";
+            break;
+
+        case Opcode::Count: {
+            int offset = 4 * a[0].intValue;
+            textSection << "    li $t1, " << offset << "\n";
+            textSection << "    lw $t0, profile_counters($t1)\n";
+            textSection << "    addi $t0, $t0, 1\n";
+            textSection << "    sw $t0, profile_counters($t1)\n";
+            break;
+        }
+
+        case Opcode::Br:
+            if (instr.targets[0] != nextBlock) {
+                textSection << "    j " << blockLabel(instr.targets[0]) << "\n";
+            }
+            break;
+
+        case Opcode::CondBr: {
+            if (fusedBranches.count(&instr)) {
+                const ir::Instr& cmp = *fusedBranches[&instr];
+                if (instr.targets[1] == nextBlock) {
+                    emitCompareBranch(cmp, true, blockLabel(instr.targets[0]));
+                } else {
+                    emitCompareBranch(cmp, false, blockLabel(instr.targets[1]));
+                    if (instr.targets[0] != nextBlock) {
+                        textSection << "    j " << blockLabel(instr.targets[0]) << "\n";
+                    }
+                }
+                break;
+            }
+            std::string x = intOperand(a[0], "$t0");
+            if (instr.targets[1] == nextBlock) {
+                textSection << "    bne " << x << ", $zero, "
+                            << blockLabel(instr.targets[0]) << "\n";
+            } else {
+                textSection << "    beq " << x << ", $zero, "
+                            << blockLabel(instr.targets[1]) << "\n";
+                if (instr.targets[0] != nextBlock) {
+                    textSection << "    j " << blockLabel(instr.targets[0]) << "\n";
+                }
+            }
+            break;
+        }
+
+        case Opcode::Ret:
+            if (!a.empty()) {
+                if (isFloat) {
+                    loadFloat("$f0", a[0]);
+                } else {
+                    loadInt("$v0", a[0]);
+                }
+            }
+            // Jump to the function epilogue
+            textSection << "    j " << endLabel << "\n";
+            break;
+
+        case Opcode::Phi:
+            throw CodeGenException("phi in function '" + fn->name +
+                                   "' reached the backend");
+    }
+}
+
+// ===============================
+// Module
+// ===============================
+
+void MipsBackend::emitRuntime(bool hasMain, bool sharedEpilogue) {
+    if (profileCounters > 0) {
+        // Writes profile_data (header and counters, profile.hpp) to the
+        // profile file; nothing is written if it cannot be opened.
+        textSection << "\n# Profile dump, called on exit\n";
+        textSection << "profile_dump:\n";
+        textSection << "    la $a0, profile_file\n";
+        textSection << "    li $a1, " << kProfileOpenFlags << "\n";
+        textSection << "    li $a2, " << kProfileOpenMode << "\n";
+        textSection << "    li $v0, 13\n";
+        textSection << "    syscall\n";
+        textSection << "    bltz $v0, profile_dump_done\n";
+        textSection << "    move $a0, $v0\n";
+        textSection << "    la $a1, profile_data\n";
+        textSection << "    li $a2, " << 12 + 4 * profileCounters << "\n";
+        textSection << "    li $v0, 15\n";
+        textSection << "    syscall\n";
+        textSection << "    li $v0, 16\n";
+        textSection << "    syscall\n";
+        textSection << "profile_dump_done:\n";
+        textSection << "    jr $ra\n";
+    }
+
+    if (sharedEpilogue) {
+        textSection << "\n# Epilogue shared by every function but main\n";
+        textSection << kSharedEpilogue << ":\n";
+        textSection << "    move $sp, $fp\n";
+        textSection << "    lw $ra, 0($sp)\n";
+        textSection << "    lw $fp, 4($sp)\n";
+        textSection << "    addi $sp, $sp, 8\n";
+        textSection << "    jr $ra\n";
+    }
+
+    // Division-by-zero handler
+    textSection << "\n# Division-by-zero runtime handler\n";
+    textSection << "div_by_zero:\n";
+    textSection << "    la $a0, div_zero_msg\n";
+    textSection << "    li $v0, 4\n";
+    textSection << "    syscall\n";
+    if (profileCounters > 0) {
+        textSection << "    jal profile_dump\n";
+    }
+    textSection << "    li $v0, 10\n";
+    textSection << "    syscall\n";
+
+    // If there is no main function, emit a stub main
+    if (!hasMain) {
+        textSection << "\n# Stub main for missing main function\n";
+        textSection << ".globl main\n";
+        textSection << "main:\n";
+        textSection << "    la $a0, missing_main_msg\n";
+        textSection << "    li $v0, 4\n";
+        textSection << "    syscall\n";
+        textSection << "    li $v0, 10\n";
+        textSection << "    syscall\n";
+    }
+}
+
+std::string MipsBackend::generate(const ir::Module& module) {
+    dataSection << ".data\n";
+    dataSection << "newline_str:\n"
+                << "    .asciiz \"\\n\"\n";
+    dataSection << "div_zero_msg:\n"
+                << "    .asciiz \"Runtime Error: Division by zero\\n\"\n";
+    dataSection << "missing_main_msg:\n"
+                << "    .asciiz \"Runtime Error: Missing main function\\n\"\n";
+    profileCounters = module.profileCounters;
+    if (profileCounters > 0) {
+        std::string file;
+        for (char c : module.profileFile) {
+            if (c == '"' || c == '\\') {
+                file += '\\';
+            }
+            file += c;
+        }
+        dataSection << "profile_file:\n"
+                    << "    .asciiz \"" << file << "\"\n";
+    }
+    // Everything after the strings is a word (globals, float constants).
+    dataSection << "    .align 2\n";
+    for (const ir::Global& g : module.globals) {
+        dataSection << globalLabel(g.name) << ":\n"
+                    << "    .word 0\n";
+    }
+    if (profileCounters > 0) {
+        dataSection << "profile_data:\n"
+                    << "    .word " << static_cast<int32_t>(ir::kProfileMagic) << ", "
+                    << static_cast<int32_t>(module.profileChecksum)
+                    << ", " << profileCounters << "\n"
+                    << "profile_counters:\n"
+                    << "    .space " << 4 * profileCounters << "\n";
+    }
+    for (const auto& function : module.functions) {
+        if (function->memoEntries > 0) {
+            int words = function->memoEntries;
+            dataSection << function->label << "_memo_keys:\n"
+                        << "    .space " << 4 * words << "\n"
+                        << function->label << "_memo_values:\n"
+                        << "    .space " << 4 * words << "\n"
+                        << function->label << "_memo_valid:\n"
+                        << "    .space " << (words + 31) / 32 * 4 << "\n";
+        }
+    }
+
+    std::vector<EmittedFunction> functions;
+    bool sharedEpilogue = false;
+    for (const auto& function : module.functions) {
+        textSection.str("");
+        emitFunction(*function);
+        std::string code = textSection.str();
+        functions.push_back({function->label, peephole ? peephole->run(code) : code});
+        sharedEpilogue = sharedEpilogue || (optimizeSize && function->label != "main");
+    }
+    std::string text = ".text\n";
+    if (optimizeSize) {
+        text += optimizeCodeSize(functions);
+    } else {
+        for (const EmittedFunction& function : functions) {
+            text += function.code;
+        }
+    }
+    textSection.str("");
+    emitRuntime(module.findFunction("main") != nullptr, sharedEpilogue);
+    text += textSection.str();
+
+    std::ostringstream full;
+    full << dataSection.str() << "\n" << text;
+    return full.str();
+}
@@ -0,0 +1,82 @@
+#ifndef MIPS_BACKEND_HPP
+#define MIPS_BACKEND_HPP
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+#include "mips_peephole.hpp"
+#include "mips_regalloc.hpp"
+#include "mips_size.hpp"
+
+// Translates an IR module into SPIM assembly. Every virtual register gets
+// a stack slot in its function's frame; operands are loaded into $t0/$t1
+// ($f0/$f2 for floats) around each instruction. Allocating registers, the
+// int and bool registers allocateRegisters (mips_regalloc.hpp) keeps in
+// machine registers get no slot and are read and written in place, and a
+// function saves the $s registers it is given. With a peephole optimizer
+// every function is passed through it once emitted. Optimizing for size,
+// functions other than main return through one shared epilogue and the
+// program is shrunk by optimizeCodeSize (mips_size.hpp). An instrumented
+// module counts in profile_counters and writes them out on exit.
+class MipsBackend {
+ public:
+    explicit MipsBackend(PeepholeOptimizer* p = nullptr, bool size = false,
+                         bool allocate = false)
+        : peephole(p), optimizeSize(size), allocate(allocate) {}
+
+    std::string generate(const ir::Module& module);
+
+ private:
+    PeepholeOptimizer* peephole;
+    bool optimizeSize;
+    bool allocate;
+    std::ostringstream dataSection;
+    std::ostringstream textSection;
+    int labelCounter = 0;
+    int profileCounters = 0;       // counters of an instrumented module (profile.hpp)
+    std::map<uint32_t, std::string> floatConstants;
+
+    // State for the function being emitted.
+    const ir::Function* fn = nullptr;
+    std::vector<int> slotOffset;   // $fp offset of every virtual register
+    std::vector<std::string> physReg;   // machine register, "" for a slot
+    int memoKeyOffset = 0;         // $fp offset of a memoized function's argument
+    std::string endLabel;
+    // Comparisons only read by the conditional branch after them, which
+    // branches on the operands instead (CondBr -> comparison).
+    std::map<const ir::Instr*, const ir::Instr*> fusedBranches;
+    std::set<const ir::Instr*> fusedCompares;
+
+    std::string newLabel(const std::string& base);
+    std::string blockLabel(int id) const;
+    std::string floatLabel(float value);
+    std::string globalLabel(const std::string& name) const;
+
+    void emitFunction(const ir::Function& function);
+    void emitInstr(const ir::Instr& instr, int nextBlock);
+    // Branches to `target` when comparison `cmp` is `ifTrue`.
+    void emitCompareBranch(const ir::Instr& cmp, bool ifTrue, const std::string& target);
+    void emitRuntime(bool hasMain, bool sharedEpilogue);
+    // Returns through `returnLabel` with the stored result of a memoized
+    // function's argument, if there is one.
+    void emitMemoLookup(const std::string& returnLabel);
+    // Stores the result in $v0/$f0 for the argument.
+    void emitMemoStore();
+    // $t0 = $t0 / d for a non-zero constant d, without a div instruction.
+    void emitDivByConstant(int32_t d);
+
+    // The register holding int operand `op`: its own, or `scratch`
+    // loaded with it.
+    std::string intOperand(const ir::Operand& op, const std::string& scratch);
+    // The register an int result is computed into: its own, or $t0.
+    std::string resultReg(const ir::Instr& instr) const;
+    void loadInt(const std::string& reg, const ir::Operand& op);
+    void loadFloat(const std::string& reg, const ir::Operand& op);
+    void storeResult(const ir::Instr& instr, const std::string& reg);
+};
+
+#endif /* MIPS_BACKEND_HPP */
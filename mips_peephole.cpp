@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <iomanip>
+#include <set>
+
+#include "mips_peephole.hpp"
+
+// ===============================
+// Lines
+// ===============================
+
+namespace {
+
+// Instructions the window-based rules look back over.
+const int kWindow = 4;
+// Rewrites enable each other (a forwarded load leaves a store nobody
+// reads), so the rules are applied until a sweep changes nothing.
+const int kMaxSweeps = 8;
+
+struct Line {
+    std::string text;                    // as emitted, until the line is rewritten
+    std::string label;                   // "name" for a "name:" line
+    std::string op;                      // mnemonic; empty unless an instruction
+    std::vector<std::string> operands;
+    bool deleted = false;
+
+    bool isInstr() const { return !op.empty(); }
+
+    void set(const std::string& mnemonic, const std::vector<std::string>& ops) {
+        op = mnemonic;
+        operands = ops;
+        text = "    " + op;
+        for (size_t k = 0; k < operands.size(); ++k) {
+            text += (k == 0 ? " " : ", ") + operands[k];
+        }
+    }
+};
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+Line parseLine(const std::string& text) {
+    Line line;
+    line.text = text;
+    std::string body = trim(text);
+    if (body.empty() || body[0] == '#' || body[0] == '.') {
+        return line;
+    }
+    if (body.back() == ':') {
+        line.label = body.substr(0, body.size() - 1);
+        return line;
+    }
+    size_t space = body.find(' ');
+    line.op = body.substr(0, space);
+    if (space != std::string::npos) {
+        std::string rest = body.substr(space + 1);
+        size_t start = 0;
+        while (start <= rest.size()) {
+            size_t comma = rest.find(',', start);
+            if (comma == std::string::npos) {
+                comma = rest.size();
+            }
+            line.operands.push_back(trim(rest.substr(start, comma - start)));
+            start = comma + 1;
+        }
+    }
+    return line;
+}
+
+// The lines of one function; deleted lines stay in place until the end of
+// a sweep so indices remain valid while the rules run.
+struct Code {
+    std::vector<Line> lines;
+    std::set<std::string> loadedSlots;   // memory operands of every lw/l.s
+
+    int next(int i) const {
+        for (++i; i < static_cast<int>(lines.size()); ++i) {
+            if (!lines[i].deleted) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int prev(int i) const {
+        for (--i; i >= 0; --i) {
+            if (!lines[i].deleted) {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+// ===============================
+// Instruction effects
+// ===============================
+
+// Instructions whose only effect is writing their first operand.
+const std::set<std::string> kPureOps = {
+    "li", "la", "lw", "l.s", "move", "mov.s", "neg.s", "abs.s", "cvt.s.w", "mfc1",
+    "mfhi", "mflo", "addu", "addi", "addiu", "subu", "mul", "and", "or", "xor", "nor",
+    "sll", "srl", "sra", "seq", "sne", "slt", "sgt", "sle", "sge", "add.s", "sub.s",
+    "mul.s", "div.s"
+};
+
+const std::set<std::string> kJumps = {
+    "j", "jal", "jr", "beq", "bne", "blt", "bgt", "ble", "bge", "beqz", "bnez",
+    "bltz", "bgtz", "blez", "bgez", "bc1t", "bc1f"
+};
+
+struct Effects {
+    std::vector<std::string> defs;
+    std::vector<std::string> uses;
+    bool pure = false;       // deletable once defs[0] is dead
+    bool control = false;    // jumps, branches and calls
+    bool unknown = false;    // nothing is assumed about it
+};
+
+// The register an operand reads: itself, or the base of a memory operand.
+std::string regOf(const std::string& operand) {
+    size_t open = operand.find('(');
+    if (open != std::string::npos) {
+        return operand.substr(open + 1, operand.find(')') - open - 1);
+    }
+    return !operand.empty() && operand[0] == '$' ? operand : "";
+}
+
+bool contains(const std::vector<std::string>& regs, const std::string& reg) {
+    return std::find(regs.begin(), regs.end(), reg) != regs.end();
+}
+
+Effects effectsOf(const Line& line) {
+    Effects e;
+    const std::string& op = line.op;
+    const std::vector<std::string>& ops = line.operands;
+    auto readFrom = [&](size_t first) {
+        for (size_t k = first; k < ops.size(); ++k) {
+            std::string reg = regOf(ops[k]);
+            if (!reg.empty()) {
+                e.uses.push_back(reg);
+            }
+        }
+    };
+
+    if (kPureOps.count(op) && !ops.empty()) {
+        e.pure = true;
+        e.defs.push_back(ops[0]);
+        readFrom(1);
+    } else if (op == "mtc1" && ops.size() == 2) {
+        e.pure = true;
+        e.defs.push_back(ops[1]);
+        e.uses.push_back(ops[0]);
+    } else if (op == "sw" || op == "s.s") {
+        readFrom(0);
+    } else if (op == "mult" || op == "div") {
+        readFrom(0);
+        e.defs = {"$hi", "$lo"};
+    } else if (op.compare(0, 2, "c.") == 0) {
+        readFrom(0);
+        e.defs.push_back("$fcc");
+    } else if (op == "syscall") {
+        e.uses = {"$v0", "$a0", "$f12"};
+        e.defs.push_back("$v0");
+    } else if (kJumps.count(op)) {
+        e.control = true;
+        readFrom(0);
+        if (op == "bc1t" || op == "bc1f") {
+            e.uses.push_back("$fcc");
+        }
+    } else {
+        e.unknown = true;
+    }
+    return e;
+}
+
+bool isScratch(const std::string& reg) {
+    return reg == "$t0" || reg == "$t1" || reg == "$f0" || reg == "$f2";
+}
+
+// True if the value of scratch register `reg` after line `i` is never
+// read. Labels and branches end the search: a float comparison carries
+// $t0 into its fcmp_done label. Jumps and calls only leave a block or an
+// IR instruction, which keep nothing in $t0/$t1; $f0 holds float results
+// across both.
+bool deadAfter(const Code& code, int i, const std::string& reg) {
+    for (int j = code.next(i); j >= 0; j = code.next(j)) {
+        const Line& line = code.lines[j];
+        if (!line.isInstr()) {
+            return false;
+        }
+        Effects e = effectsOf(line);
+        if (e.unknown || contains(e.uses, reg)) {
+            return false;
+        }
+        if (e.control) {
+            return (line.op == "j" || line.op == "jal" || line.op == "jr") && reg[1] == 't';
+        }
+        if (contains(e.defs, reg)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isLoad(const Line& line) {
+    return (line.op == "lw" || line.op == "l.s") && line.operands.size() == 2;
+}
+
+bool isStore(const Line& line) {
+    return (line.op == "sw" || line.op == "s.s") && line.operands.size() == 2;
+}
+
+// Replaces the load at `i` by a copy from `reg`, which holds the value.
+void forwardLoad(Code& code, int i, const std::string& reg) {
+    Line& load = code.lines[i];
+    if (load.operands[0] == reg) {
+        load.deleted = true;
+    } else {
+        load.set(load.op == "lw" ? "move" : "mov.s", {load.operands[0], reg});
+    }
+}
+
+// The nearest instruction before `i`, at most kWindow back, that stores
+// or loads the memory operand `mem` with the same width and whose
+// register still holds that value, or -1.
+int findAvailable(const Code& code, int i, const std::string& mem, bool isFloat) {
+    std::string base = regOf(mem);
+    std::vector<std::string> clobbered;
+    int j = i;
+    for (int n = 0; n < kWindow; ++n) {
+        j = code.prev(j);
+        if (j < 0 || !code.lines[j].isInstr()) {
+            return -1;
+        }
+        const Line& line = code.lines[j];
+        Effects e = effectsOf(line);
+        if (e.unknown || e.control) {
+            return -1;
+        }
+        if ((isLoad(line) || isStore(line)) && line.operands[1] == mem) {
+            const std::string& reg = line.operands[0];
+            bool sameWidth = (line.op == "l.s" || line.op == "s.s") == isFloat;
+            if (!sameWidth || contains(clobbered, reg) || contains(clobbered, base) ||
+                (isLoad(line) && reg == base)) {
+                return -1;
+            }
+            return j;
+        }
+        // Other offsets from the same base (or other labels) are other
+        // words; anything else may overlap `mem`.
+        if (isStore(line) && regOf(line.operands[1]) != base) {
+            return -1;
+        }
+        clobbered.insert(clobbered.end(), e.defs.begin(), e.defs.end());
+    }
+    return -1;
+}
+
+// ===============================
+// Rules
+// ===============================
+
+//     addi $sp, $sp, -4      =>   move R2, R
+//     sw R, 0($sp)
+//     lw R2, 0($sp)
+//     addi $sp, $sp, 4
+bool pushPop(Code& code, int i) {
+    int window[4] = {i, -1, -1, -1};
+    for (int k = 1; k < 4; ++k) {
+        window[k] = code.next(window[k - 1]);
+        if (window[k] < 0) {
+            return false;
+        }
+    }
+    const Line& push = code.lines[window[0]];
+    const Line& store = code.lines[window[1]];
+    const Line& load = code.lines[window[2]];
+    const Line& pop = code.lines[window[3]];
+    bool matches = push.op == "addi" && push.operands ==
+                       std::vector<std::string>{"$sp", "$sp", "-4"} &&
+                   isStore(store) && store.operands[1] == "0($sp)" &&
+                   isLoad(load) && load.operands[1] == "0($sp)" &&
+                   (store.op == "s.s") == (load.op == "l.s") &&
+                   pop.op == "addi" && pop.operands ==
+                       std::vector<std::string>{"$sp", "$sp", "4"};
+    if (!matches) {
+        return false;
+    }
+    std::string reg = store.operands[0];
+    forwardLoad(code, window[2], reg);
+    code.lines[window[0]].deleted = true;
+    code.lines[window[1]].deleted = true;
+    code.lines[window[3]].deleted = true;
+    return true;
+}
+
+//     sw R, -8($fp)          =>   sw R, -8($fp)
+//     lw R2, -8($fp)              move R2, R
+bool storeLoad(Code& code, int i) {
+    const Line& load = code.lines[i];
+    if (!isLoad(load)) {
+        return false;
+    }
+    int j = findAvailable(code, i, load.operands[1], load.op == "l.s");
+    if (j < 0 || !isStore(code.lines[j])) {
+        return false;
+    }
+    forwardLoad(code, i, code.lines[j].operands[0]);
+    return true;
+}
+
+//     lw R, -8($fp)          =>   lw R, -8($fp)
+//     lw R2, -8($fp)              move R2, R
+bool loadLoad(Code& code, int i) {
+    const Line& load = code.lines[i];
+    if (!isLoad(load)) {
+        return false;
+    }
+    int j = findAvailable(code, i, load.operands[1], load.op == "l.s");
+    if (j < 0 || !isLoad(code.lines[j])) {
+        return false;
+    }
+    forwardLoad(code, i, code.lines[j].operands[0]);
+    return true;
+}
+
+//     move $t0, $v0          =>   move $t0, $v0
+//     move $a0, $t0               move $a0, $v0
+bool copyChain(Code& code, int i) {
+    Line& copy = code.lines[i];
+    if ((copy.op != "move" && copy.op != "mov.s") || copy.operands.size() != 2) {
+        return false;
+    }
+    const std::string& from = copy.operands[1];
+    std::vector<std::string> clobbered;
+    int j = i;
+    for (int n = 0; n < kWindow; ++n) {
+        j = code.prev(j);
+        if (j < 0 || !code.lines[j].isInstr()) {
+            return false;
+        }
+        const Line& line = code.lines[j];
+        Effects e = effectsOf(line);
+        if (e.unknown || e.control) {
+            return false;
+        }
+        if (contains(e.defs, from)) {
+            if (line.op != copy.op || line.operands.size() != 2 || line.operands[1] == from ||
+                contains(clobbered, line.operands[1])) {
+                return false;
+            }
+            if (line.operands[1] == copy.operands[0]) {
+                copy.deleted = true;
+            } else {
+                copy.set(copy.op, {copy.operands[0], line.operands[1]});
+            }
+            return true;
+        }
+        clobbered.insert(clobbered.end(), e.defs.begin(), e.defs.end());
+    }
+    return false;
+}
+
+//     lw $t0, -8($fp)        =>   lw $a0, -8($fp)
+//     move $a0, $t0
+bool retarget(Code& code, int i) {
+    const Line& copy = code.lines[i];
+    if ((copy.op != "move" && copy.op != "mov.s") || copy.operands.size() != 2 ||
+        !isScratch(copy.operands[1]) || copy.operands[0] == "$zero") {
+        return false;
+    }
+    int j = code.prev(i);
+    if (j < 0 || !code.lines[j].isInstr()) {
+        return false;
+    }
+    Line& def = code.lines[j];
+    Effects e = effectsOf(def);
+    if (!e.pure || e.defs[0] != copy.operands[1] || !deadAfter(code, i, copy.operands[1])) {
+        return false;
+    }
+    std::vector<std::string> operands = def.operands;
+    operands[def.op == "mtc1" ? 1 : 0] = copy.operands[0];
+    def.set(def.op, operands);
+    code.lines[i].deleted = true;
+    return true;
+}
+
+//     li $t1, 5              =>   (nothing)
+//     li $t1, 7                   li $t1, 7
+bool deadScratch(Code& code, int i) {
+    Line& line = code.lines[i];
+    if (!line.isInstr()) {
+        return false;
+    }
+    Effects e = effectsOf(line);
+    if (!e.pure || !isScratch(e.defs[0]) || !deadAfter(code, i, e.defs[0])) {
+        return false;
+    }
+    line.deleted = true;
+    return true;
+}
+
+//     sw $t0, -8($fp)        =>   (nothing), when no lw reads -8($fp)
+bool deadStore(Code& code, int i) {
+    Line& store = code.lines[i];
+    if (!isStore(store)) {
+        return false;
+    }
+    const std::string& mem = store.operands[1];
+    if (regOf(mem) != "$fp" || code.loadedSlots.count(mem)) {
+        return false;
+    }
+    store.deleted = true;
+    return true;
+}
+
+//     j L                    =>   L:
+//   L:
+bool branchNext(Code& code, int i) {
+    Line& jump = code.lines[i];
+    if (!kJumps.count(jump.op) || jump.op == "jal" || jump.op == "jr" ||
+        jump.operands.empty()) {
+        return false;
+    }
+    for (int j = code.next(i); j >= 0 && !code.lines[j].label.empty(); j = code.next(j)) {
+        if (code.lines[j].label == jump.operands.back()) {
+            jump.deleted = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Rule {
+    const char* name;
+    const char* description;
+    bool (*apply)(Code& code, int i);
+};
+
+// Tried in order on every line.
+const Rule kRules[] = {
+    {"push-pop", "register pushed and popped right away", pushPop},
+    {"store-load", "reload of a slot that was just stored", storeLoad},
+    {"load-load", "second load of the same slot", loadLoad},
+    {"copy-chain", "move of a register that was itself a move", copyChain},
+    {"retarget", "scratch value only computed to be moved", retarget},
+    {"dead-scratch", "scratch register written but never read", deadScratch},
+    {"dead-store", "store to a stack slot that is never loaded", deadStore},
+    {"branch-next", "jump or branch to the next line", branchNext},
+};
+
+const size_t kNumRules = sizeof(kRules) / sizeof(kRules[0]);
+
+}  // anonymous namespace
+
+// ===============================
+// PeepholeOptimizer
+// ===============================
+
+bool isPeepholeRule(const std::string& name) {
+    if (name == "all") {
+        return true;
+    }
+    for (const Rule& rule : kRules) {
+        if (name == rule.name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PeepholeOptimizer::PeepholeOptimizer(const std::vector<std::string>& disabled)
+    : enabled(kNumRules, true), fired(kNumRules, 0) {
+    for (size_t r = 0; r < kNumRules; ++r) {
+        for (const std::string& name : disabled) {
+            if (name == "all" || name == kRules[r].name) {
+                enabled[r] = false;
+            }
+        }
+    }
+}
+
+std::string PeepholeOptimizer::run(const std::string& text) {
+    Code code;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        code.lines.push_back(parseLine(text.substr(start, end - start)));
+        start = end + 1;
+    }
+
+    for (int sweep = 0; sweep < kMaxSweeps; ++sweep) {
+        code.loadedSlots.clear();
+        for (const Line& line : code.lines) {
+            if (isLoad(line)) {
+                code.loadedSlots.insert(line.operands[1]);
+            }
+        }
+        bool changed = false;
+        for (int i = 0; i < static_cast<int>(code.lines.size()); ++i) {
+            for (size_t r = 0; r < kNumRules && !code.lines[i].deleted; ++r) {
+                if (enabled[r] && kRules[r].apply(code, i)) {
+                    ++fired[r];
+                    changed = true;
+                }
+            }
+        }
+        code.lines.erase(std::remove_if(code.lines.begin(), code.lines.end(),
+                                        [](const Line& line) { return line.deleted; }),
+                         code.lines.end());
+        if (!changed) {
+            break;
+        }
+    }
+
+    std::string result;
+    for (const Line& line : code.lines) {
+        result += line.text + "\n";
+    }
+    return result;
+}
+
+void PeepholeOptimizer::report(std::ostream& os) const {
+    int total = 0;
+    os << "===== Peephole rule report =====\n";
+    os << std::left << std::setw(16) << "Rule"
+       << std::right << std::setw(8) << "Fired" << "  Description\n";
+    for (size_t r = 0; r < kNumRules; ++r) {
+        os << std::left << std::setw(16) << kRules[r].name << std::right << std::setw(8);
+        if (enabled[r]) {
+            os << fired[r];
+        } else {
+            os << "off";
+        }
+        os << "  " << kRules[r].description << "\n";
+        total += fired[r];
+    }
+    os << std::left << std::setw(16) << "Total" << std::right << std::setw(8) << total << "\n";
+}
@@ -0,0 +1,44 @@
+#ifndef MIPS_PEEPHOLE_HPP
+#define MIPS_PEEPHOLE_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ===============================
+// Peephole optimization of MIPS assembly
+// ===============================
+// The backend loads every operand from its stack slot and stores every
+// result back, so its output is full of sequences such as
+//     sw $t0, -8($fp)             move $t0, $v0
+//     lw $t0, -8($fp)             move $a0, $t0
+// that a second look at a few neighbouring instructions can shorten. The
+// optimizer rewrites the assembly of one function at a time with a table
+// of rules, each matching a small window of instructions that never spans
+// a label. It relies on the backend's conventions: $t0/$t1 and $f0/$f2 are
+// scratch registers that hold nothing across IR instructions, and a stack
+// slot below or above $fp is only read through lw/l.s of that slot.
+//
+// Every rule can be switched off by name (--disable-peephole=) and counts
+// how often it fired (--peephole-stats).
+
+// Rewrites function bodies with the enabled rules until none applies.
+class PeepholeOptimizer {
+ public:
+    // Rules named in `disabled` are never applied; "all" disables every rule.
+    explicit PeepholeOptimizer(const std::vector<std::string>& disabled = {});
+
+    // Returns `code`, the assembly of one function, optimized.
+    std::string run(const std::string& code);
+    // Prints how often every rule fired.
+    void report(std::ostream& os) const;
+
+ private:
+    std::vector<bool> enabled;
+    std::vector<int> fired;
+};
+
+// True if `name` is a rule of the table (or "all").
+bool isPeepholeRule(const std::string& name);
+
+#endif /* MIPS_PEEPHOLE_HPP */
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#include "mips_regalloc.hpp"
+#include "ir_analysis.hpp"
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+
+// Allocatable registers: the caller-saved ones first, then the callee-saved.
+const char* const kRegisters[] = {
+    "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$t8", "$t9",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7"
+};
+const int kNumRegisters = 16;
+const int kFirstCalleeSaved = 8;
+
+// Weight of a definition or use per enclosing loop, and the deepest
+// nesting that still adds to it.
+const int64_t kLoopWeight = 8;
+const int kMaxWeightedDepth = 6;
+
+struct Interval {
+    int reg = -1;
+    int start = INT_MAX;
+    int end = -1;
+    bool crossesCall = false;
+    int64_t weight = 0;
+    int assigned = -1;            // index into kRegisters
+
+    void cover(int position) {
+        start = std::min(start, position);
+        end = std::max(end, position);
+    }
+};
+
+bool allocatable(ir::Type type) {
+    return type == ir::Type::Int || type == ir::Type::Bool;
+}
+
+}  // anonymous namespace
+
+RegisterAllocation allocateRegisters(const ir::Function& fn) {
+    size_t numRegs = fn.vregs.size();
+    size_t numBlocks = fn.blocks.size();
+    std::vector<int> indexOf(numBlocks, -1);
+    for (size_t b = 0; b < numBlocks; ++b) {
+        indexOf[fn.blocks[b]->id] = static_cast<int>(b);
+    }
+    std::vector<std::vector<int>> succs(numBlocks);
+    for (size_t b = 0; b < numBlocks; ++b) {
+        for (int s : fn.blocks[b]->successors()) {
+            succs[b].push_back(indexOf[s]);
+        }
+    }
+
+    // Liveness: in = gen | (out - kill), out = union of the successors' in.
+    std::vector<ir::BitSet> gen(numBlocks, ir::BitSet(numRegs));
+    std::vector<ir::BitSet> kill(numBlocks, ir::BitSet(numRegs));
+    for (size_t b = 0; b < numBlocks; ++b) {
+        for (const Instr& instr : fn.blocks[b]->instrs) {
+            ir::forEachUse(instr, [&](int r) {
+                if (!kill[b].test(r)) {
+                    gen[b].set(r);
+                }
+            });
+            if (instr.dst >= 0) {
+                kill[b].set(instr.dst);
+            }
+        }
+    }
+    std::vector<ir::BitSet> liveIn = gen;
+    std::vector<ir::BitSet> liveOut(numBlocks, ir::BitSet(numRegs));
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = numBlocks; b-- > 0;) {
+            for (int s : succs[b]) {
+                liveOut[b].unionWith(liveIn[s]);
+            }
+            ir::BitSet in = liveOut[b];
+            in.subtract(kill[b]);
+            in.unionWith(gen[b]);
+            if (in != liveIn[b]) {
+                liveIn[b] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+
+    // Loop depth by layout: a branch back to an earlier block closes a
+    // loop over the blocks in between.
+    std::vector<int> depth(numBlocks, 0);
+    for (size_t b = 0; b < numBlocks; ++b) {
+        for (int s : succs[b]) {
+            for (int k = s; s <= static_cast<int>(b) && k <= static_cast<int>(b); ++k) {
+                ++depth[k];
+            }
+        }
+    }
+
+    std::vector<Interval> intervals(numRegs);
+    std::vector<int> calls;
+    std::vector<int> callResults;
+    int position = 0;
+    for (size_t b = 0; b < numBlocks; ++b) {
+        int first = position;
+        int64_t weight = 1;
+        for (int d = 0; d < std::min(depth[b], kMaxWeightedDepth); ++d) {
+            weight *= kLoopWeight;
+        }
+        liveIn[b].forEach([&](size_t r) { intervals[r].cover(first); });
+        // A comparison only read by the branch ending the block may be
+        // fused into it (mips_backend.hpp), which reads its operands there.
+        const std::vector<Instr>& instrs = fn.blocks[b]->instrs;
+        int tested = !instrs.empty() && instrs.back().op == Opcode::CondBr &&
+                     instrs.back().args[0].isReg() ? instrs.back().args[0].reg : -1;
+        int branch = first + static_cast<int>(instrs.size()) - 1;
+        for (const Instr& instr : instrs) {
+            if (instr.dst == tested && ir::isCompare(instr.op)) {
+                ir::forEachUse(instr, [&](int r) { intervals[r].cover(branch); });
+            }
+            ir::forEachUse(instr, [&](int r) {
+                intervals[r].cover(position);
+                intervals[r].weight += weight;
+            });
+            if (instr.dst >= 0) {
+                intervals[instr.dst].cover(position);
+                intervals[instr.dst].weight += weight;
+            }
+            if (instr.op == Opcode::Call) {
+                calls.push_back(position);
+                callResults.push_back(instr.dst);
+            }
+            ++position;
+        }
+        int last = position - 1;
+        liveOut[b].forEach([&](size_t r) { intervals[r].cover(last); });
+    }
+
+    std::vector<Interval*> order;
+    for (size_t r = 0; r < numRegs; ++r) {
+        Interval& interval = intervals[r];
+        interval.reg = static_cast<int>(r);
+        if (interval.end < 0 || !allocatable(fn.regType(static_cast<int>(r)))) {
+            continue;
+        }
+        // A call where the interval starts clobbers it too (a parameter
+        // or a block's live-in value), unless the call defines it.
+        auto call = std::lower_bound(calls.begin(), calls.end(), interval.start);
+        if (call != calls.end() && *call == interval.start &&
+            callResults[call - calls.begin()] == interval.reg) {
+            ++call;
+        }
+        interval.crossesCall = call != calls.end() && *call < interval.end;
+        order.push_back(&interval);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Interval* x, const Interval* y) {
+        return x->start < y->start;
+    });
+
+    std::vector<bool> busy(kNumRegisters, false);
+    std::vector<Interval*> active;
+    for (Interval* current : order) {
+        // Intervals ending before this one starts give their registers
+        // back; one ending where it starts is still read there.
+        for (size_t k = 0; k < active.size();) {
+            if (active[k]->end < current->start) {
+                busy[active[k]->assigned] = false;
+                active.erase(active.begin() + k);
+            } else {
+                ++k;
+            }
+        }
+        int first = current->crossesCall ? kFirstCalleeSaved : 0;
+        for (int k = first; k < kNumRegisters && current->assigned < 0; ++k) {
+            if (!busy[k]) {
+                current->assigned = k;
+            }
+        }
+        if (current->assigned < 0) {
+            Interval* victim = nullptr;
+            for (Interval* other : active) {
+                if (other->assigned >= first && (!victim || other->weight < victim->weight)) {
+                    victim = other;
+                }
+            }
+            if (!victim || victim->weight >= current->weight) {
+                continue;
+            }
+            current->assigned = victim->assigned;
+            victim->assigned = -1;
+            active.erase(std::find(active.begin(), active.end(), victim));
+        }
+        busy[current->assigned] = true;
+        active.push_back(current);
+    }
+
+    RegisterAllocation result;
+    result.reg.assign(numRegs, "");
+    std::vector<bool> saved(kNumRegisters, false);
+    for (const Interval& interval : intervals) {
+        if (interval.assigned >= 0) {
+            result.reg[interval.reg] = kRegisters[interval.assigned];
+            saved[interval.assigned] = interval.assigned >= kFirstCalleeSaved;
+        }
+    }
+    for (int k = kFirstCalleeSaved; k < kNumRegisters; ++k) {
+        if (saved[k]) {
+            result.calleeSaved.push_back(kRegisters[k]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,34 @@
+#ifndef MIPS_REGALLOC_HPP
+#define MIPS_REGALLOC_HPP
+
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+// ===============================
+// Register allocation
+// ===============================
+// Linear scan (Poletto and Sarkar) over the int and bool registers of a
+// function that is out of SSA form. The instructions are numbered in the
+// order the backend emits the blocks; a register's live interval runs
+// from the first to the last number where it is live, widened to whole
+// blocks it is live into or out of. Walking the intervals by start, each
+// takes a free machine register, or, when none is free, the one of the
+// active interval that matters least: every definition and use weighs 8
+// per enclosing loop, so loop counters and accumulators keep theirs and
+// the interval that loses goes to its stack slot for its whole life.
+//
+// The caller-saved $t2-$t9 only go to intervals that no call crosses, so
+// calls need not save anything; intervals living across a call take the
+// callee-saved $s0-$s7, which the function saves in its prologue. $t0/$t1
+// and $f0/$f2 stay scratch registers for the backend, $a0/$v0 are used by
+// calls, syscalls and memo tables, and floats keep their stack slots.
+
+struct RegisterAllocation {
+    std::vector<std::string> reg;           // per virtual register, "" if it stays in its slot
+    std::vector<std::string> calleeSaved;   // $s registers handed out, in order
+};
+
+RegisterAllocation allocateRegisters(const ir::Function& fn);
+
+#endif /* MIPS_REGALLOC_HPP */
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include "mips_size.hpp"
+
+// ===============================
+// Lines
+// ===============================
+
+namespace {
+
+// Longest instruction sequence considered for outlining.
+const int kMaxOutlineLength = 12;
+// Longest run of instructions merged in front of a common jump.
+const int kMaxTailLength = 16;
+// Earlier jumps (the latest ones) a jump's run is compared with.
+const size_t kMaxTailCandidates = 32;
+
+struct Line {
+    std::string text;
+    std::string label;                   // "name" for a "name:" line
+    std::string op;                      // mnemonic; empty unless an instruction
+    std::vector<std::string> operands;
+
+    bool isInstr() const { return !op.empty(); }
+};
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+Line parseLine(const std::string& text) {
+    Line line;
+    line.text = text;
+    std::string body = trim(text);
+    if (body.empty() || body[0] == '#' || body[0] == '.') {
+        return line;
+    }
+    if (body.back() == ':') {
+        line.label = body.substr(0, body.size() - 1);
+        return line;
+    }
+    size_t space = body.find(' ');
+    line.op = body.substr(0, space);
+    if (space != std::string::npos) {
+        std::string rest = body.substr(space + 1);
+        size_t start = 0;
+        while (start <= rest.size()) {
+            size_t comma = rest.find(',', start);
+            if (comma == std::string::npos) {
+                comma = rest.size();
+            }
+            line.operands.push_back(trim(rest.substr(start, comma - start)));
+            start = comma + 1;
+        }
+    }
+    return line;
+}
+
+std::vector<Line> parseLines(const std::string& text) {
+    std::vector<Line> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        lines.push_back(parseLine(text.substr(start, end - start)));
+        start = end + 1;
+    }
+    return lines;
+}
+
+Line labelLine(const std::string& label) {
+    return parseLine(label + ":");
+}
+
+Line instrLine(const std::string& op, const std::string& operand) {
+    return parseLine("    " + op + " " + operand);
+}
+
+// Jumps and branches, which neither move into a subroutine nor end up in
+// the middle of a merged tail.
+bool isJump(const Line& line) {
+    return line.op == "j" || line.op == "jal" || line.op == "jr" || line.op == "jalr" ||
+           line.op[0] == 'b';
+}
+
+bool readsOrWritesRa(const Line& line) {
+    for (const std::string& o : line.operands) {
+        if (o.find("$ra") != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ===============================
+// Identical functions
+// ===============================
+
+// The code of `function` with its labels numbered in order of definition,
+// so functions differing only in their names compare equal; self-calls
+// become calls of the first label. Comments and directives are left out.
+std::string canonicalCode(const EmittedFunction& function) {
+    std::vector<Line> lines = parseLines(function.code);
+    std::map<std::string, std::string> renamed;
+    for (const Line& line : lines) {
+        if (!line.label.empty()) {
+            renamed.emplace(line.label, "L" + std::to_string(renamed.size()));
+        }
+    }
+    std::string key;
+    for (const Line& line : lines) {
+        if (!line.label.empty()) {
+            key += renamed[line.label] + ":\n";
+        } else if (line.isInstr()) {
+            key += line.op;
+            for (const std::string& o : line.operands) {
+                auto found = renamed.find(o);
+                key += " " + (found != renamed.end() ? found->second : o);
+            }
+            key += "\n";
+        }
+    }
+    return key;
+}
+
+// The functions with the code of every group of identical ones kept once,
+// the other labels of the group placed right after the kept one's.
+std::vector<Line> mergeIdenticalFunctions(const std::vector<EmittedFunction>& functions) {
+    std::map<std::string, size_t> firstWithCode;
+    std::vector<std::vector<std::string>> aliases(functions.size());
+    std::vector<bool> merged(functions.size(), false);
+    for (size_t f = 0; f < functions.size(); ++f) {
+        if (functions[f].label == "main") {
+            continue;
+        }
+        auto inserted = firstWithCode.emplace(canonicalCode(functions[f]), f);
+        if (!inserted.second) {
+            aliases[inserted.first->second].push_back(functions[f].label);
+            merged[f] = true;
+        }
+    }
+
+    std::vector<Line> lines;
+    for (size_t f = 0; f < functions.size(); ++f) {
+        if (merged[f]) {
+            continue;
+        }
+        for (const Line& line : parseLines(functions[f].code)) {
+            lines.push_back(line);
+            if (line.label == functions[f].label) {
+                for (const std::string& alias : aliases[f]) {
+                    lines.push_back(labelLine(alias));
+                }
+            }
+        }
+    }
+    return lines;
+}
+
+// ===============================
+// Tail merging
+// ===============================
+
+// A run of up to kMaxTailLength straight-line instructions in front of a
+// `j`, identical to the run in front of an earlier `j` to the same label,
+// is replaced by a jump to the start of the earlier run.
+void mergeTails(std::vector<Line>& lines) {
+    auto straightLine = [&](int k) {
+        return k >= 0 && lines[k].isInstr() && !isJump(lines[k]);
+    };
+    // Earlier jumps by target and the instruction before them.
+    std::map<std::pair<std::string, std::string>, std::vector<int>> jumpsTo;
+    std::vector<bool> removed(lines.size(), false);
+    std::map<int, std::string> labelAt;
+    for (int i = 0; i < static_cast<int>(lines.size()); ++i) {
+        if (lines[i].op != "j" || !straightLine(i - 1)) {
+            continue;
+        }
+        std::vector<int>& earlier = jumpsTo[{lines[i].operands[0], lines[i - 1].text}];
+        int best = -1;
+        int bestLength = 0;
+        size_t first = earlier.size() > kMaxTailCandidates ? earlier.size() - kMaxTailCandidates : 0;
+        for (size_t k = first; k < earlier.size(); ++k) {
+            int e = earlier[k];
+            int length = 0;
+            while (length < kMaxTailLength && straightLine(i - 1 - length) &&
+                   straightLine(e - 1 - length) &&
+                   lines[i - 1 - length].text == lines[e - 1 - length].text) {
+                ++length;
+            }
+            if (length > bestLength) {
+                best = e;
+                bestLength = length;
+            }
+        }
+        if (best < 0) {
+            earlier.push_back(i);
+            continue;
+        }
+        int start = best - bestLength;
+        if (!labelAt.count(start)) {
+            std::string label = "tail_" + std::to_string(labelAt.size());
+            labelAt[start] = label;
+        }
+        for (int k = i - bestLength; k < i; ++k) {
+            removed[k] = true;
+        }
+        lines[i] = instrLine("j", labelAt[start]);
+    }
+
+    std::vector<Line> result;
+    for (size_t k = 0; k < lines.size(); ++k) {
+        auto label = labelAt.find(static_cast<int>(k));
+        if (label != labelAt.end()) {
+            result.push_back(labelLine(label->second));
+        }
+        if (!removed[k]) {
+            result.push_back(lines[k]);
+        }
+    }
+    lines = std::move(result);
+}
+
+// ===============================
+// Outlining
+// ===============================
+
+// Lines that may move into a subroutine: instructions other than jumps,
+// not touching $ra, and not where $ra still holds the return address of
+// the function (from its entry to the store in its prologue, and from the
+// load in its epilogue on).
+std::vector<bool> outlinable(const std::vector<Line>& lines,
+                             const std::set<std::string>& entries) {
+    std::vector<bool> result(lines.size(), false);
+    bool raLive = false;
+    for (size_t k = 0; k < lines.size(); ++k) {
+        const Line& line = lines[k];
+        if (entries.count(line.label)) {
+            raLive = true;
+        }
+        result[k] = line.isInstr() && !raLive && !isJump(line) && !readsOrWritesRa(line);
+        if (readsOrWritesRa(line)) {
+            raLive = line.op == "lw";
+        }
+    }
+    return result;
+}
+
+// Outlines repeated sequences, those saving the most instructions first:
+// n copies of a sequence of length m cost n * m instructions, n calls and
+// a subroutine of m + 1. Copies overlapping an outlined one are skipped.
+void outline(std::vector<Line>& lines, const std::vector<bool>& candidate,
+             std::vector<std::vector<Line>>& subroutines) {
+    std::unordered_map<std::string, int> ids;
+    std::vector<int> id(lines.size());
+    for (size_t k = 0; k < lines.size(); ++k) {
+        id[k] = ids.emplace(lines[k].text, static_cast<int>(ids.size())).first->second;
+    }
+    int n = static_cast<int>(lines.size());
+    auto same = [&](int a, int b, int length) {
+        for (int k = 0; k < length; ++k) {
+            if (id[a + k] != id[b + k]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto saving = [](int count, int length) { return count * length - (count + length + 1); };
+
+    // Start positions of the sequences of every length, keyed by a hash of
+    // their lines; collisions are weeded out by comparing with the first.
+    std::vector<std::unordered_map<size_t, std::vector<int>>> starts(kMaxOutlineLength + 1);
+    for (int i = 0; i < n; ++i) {
+        size_t hash = 0;
+        for (int length = 1; length <= kMaxOutlineLength && i + length <= n; ++length) {
+            if (!candidate[i + length - 1]) {
+                break;
+            }
+            hash = hash * 1000003 + std::hash<int>()(id[i + length - 1]);
+            if (length >= 2) {
+                starts[length][hash].push_back(i);
+            }
+        }
+    }
+
+    struct Sequence {
+        int saving;
+        int length;
+        std::vector<int> uses;
+    };
+    std::vector<Sequence> sequences;
+    for (int length = 2; length <= kMaxOutlineLength; ++length) {
+        for (const auto& entry : starts[length]) {
+            const std::vector<int>& at = entry.second;
+            std::vector<int> uses;
+            for (int p : at) {
+                if ((uses.empty() || p >= uses.back() + length) && same(p, at[0], length)) {
+                    uses.push_back(p);
+                }
+            }
+            int count = static_cast<int>(uses.size());
+            if (saving(count, length) > 0) {
+                sequences.push_back({saving(count, length), length, std::move(uses)});
+            }
+        }
+    }
+    std::sort(sequences.begin(), sequences.end(), [](const Sequence& x, const Sequence& y) {
+        return x.saving != y.saving ? x.saving > y.saving
+             : x.length != y.length ? x.length > y.length
+                                    : x.uses[0] < y.uses[0];
+    });
+
+    std::vector<bool> taken(n, false);
+    std::vector<int> calls(n, -1);
+    for (const Sequence& sequence : sequences) {
+        std::vector<int> uses;
+        for (int p : sequence.uses) {
+            bool free = true;
+            for (int k = p; k < p + sequence.length && free; ++k) {
+                free = !taken[k];
+            }
+            if (free) {
+                uses.push_back(p);
+            }
+        }
+        if (saving(static_cast<int>(uses.size()), sequence.length) <= 0) {
+            continue;
+        }
+        int number = static_cast<int>(subroutines.size());
+        subroutines.emplace_back();
+        std::vector<Line>& code = subroutines.back();
+        code.push_back(labelLine("outlined_" + std::to_string(number)));
+        for (int k = 0; k < sequence.length; ++k) {
+            code.push_back(lines[uses[0] + k]);
+        }
+        code.push_back(instrLine("jr", "$ra"));
+        for (int p : uses) {
+            std::fill(taken.begin() + p, taken.begin() + p + sequence.length, true);
+            calls[p] = number;
+        }
+    }
+
+    std::vector<Line> result;
+    for (int k = 0; k < n; ++k) {
+        if (calls[k] >= 0) {
+            result.push_back(instrLine("jal", "outlined_" + std::to_string(calls[k])));
+        } else if (!taken[k]) {
+            result.push_back(lines[k]);
+        }
+    }
+    lines = std::move(result);
+}
+
+}  // anonymous namespace
+
+std::string optimizeCodeSize(const std::vector<EmittedFunction>& functions) {
+    std::vector<Line> lines = mergeIdenticalFunctions(functions);
+    mergeTails(lines);
+
+    std::set<std::string> entries;
+    for (const EmittedFunction& function : functions) {
+        entries.insert(function.label);
+    }
+    std::vector<std::vector<Line>> subroutines;
+    outline(lines, outlinable(lines, entries), subroutines);
+
+    std::string text;
+    for (const Line& line : lines) {
+        text += line.text + "\n";
+    }
+    if (!subroutines.empty()) {
+        text += "\n# Outlined code\n";
+        for (const std::vector<Line>& code : subroutines) {
+            for (const Line& line : code) {
+                text += line.text + "\n";
+            }
+        }
+    }
+    return text;
+}
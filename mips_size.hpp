@@ -0,0 +1,37 @@
+#ifndef MIPS_SIZE_HPP
+#define MIPS_SIZE_HPP
+
+#include <string>
+#include <vector>
+
+// ===============================
+// Code-size optimization of MIPS assembly
+// ===============================
+// At -Os the assembly of the whole program is shrunk after the peephole
+// optimizer has run over every function:
+//
+//  - functions whose code is the same up to the names of their labels are
+//    emitted once, the others' labels placed next to the kept one's;
+//  - of two paths ending in the same jump with the same instructions
+//    before it (two `return`s of the same value, say), the second jumps
+//    into the first instead;
+//  - instruction sequences repeated often enough to pay for a call, such
+//    as the syscalls of a print, are outlined into subroutines reached
+//    with jal and left with jr $ra.
+//
+// Outlining clobbers $ra, which the backend only relies on between a
+// function's entry and the store of $ra in its prologue, and between the
+// load of $ra in its epilogue and the final jr; lines there are never
+// outlined. The outlined code does not move $sp or $fp, so the stack slots
+// it addresses are still the caller's.
+
+struct EmittedFunction {
+    std::string label;
+    std::string code;      // assembly of the function, starting with its comment
+};
+
+// Returns the assembly of `functions`, in order, with the optimizations
+// above applied, followed by the outlined subroutines.
+std::string optimizeCodeSize(const std::vector<EmittedFunction>& functions);
+
+#endif /* MIPS_SIZE_HPP */
@@ -0,0 +1,83 @@
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "interpreter.hpp"
+
+// ===============================
+// Whole-program partial evaluation
+// ===============================
+// MiniLang programs read no input, so everything they print is fixed at
+// compile time unless they run for too long. -O3 starts by running main
+// (global initializers included) in ir::Interpreter; when the program
+// finishes within kProgramFuel instructions, the module is replaced by a
+// main that prints the recorded values and returns main's result. A
+// program stopped by a division by zero keeps its output and ends in a
+// division by a constant zero, which reaches div_by_zero as before.
+//
+// Programs that run out of fuel, recurse deeper than the interpreter
+// allows or print more than kMaxOutput values are left unchanged for the
+// rest of the pipeline.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const int64_t kProgramFuel = 10000000;
+// Straight-line prints cost a few instructions each; beyond this the
+// loops that produced them are the smaller program.
+const size_t kMaxOutput = 10000;
+
+class PartialEvaluationPass : public IRModulePass {
+ public:
+    const char* name() const override { return "peval"; }
+
+    bool runOnModule(ir::Module& module, AnalysisManager&) override {
+        const ir::Function* mainFn = module.findFunction("main");
+        if (!mainFn || !mainFn->params.empty()) {
+            return false;
+        }
+        ir::Interpreter interp(module, kProgramFuel);
+        Operand result;
+        ir::ExecStatus status = interp.call(*mainFn, {}, result);
+        if ((status != ir::ExecStatus::Returned && status != ir::ExecStatus::DivByZero) ||
+            interp.output().size() > kMaxOutput) {
+            return false;
+        }
+
+        auto fn = std::make_unique<ir::Function>();
+        fn->name = mainFn->name;
+        fn->label = mainFn->label;
+        fn->retType = mainFn->retType;
+        ir::BasicBlock* block = fn->newBlock("entry");
+        for (const Operand& value : interp.output()) {
+            block->instrs.emplace_back(Opcode::Print, value.type, -1,
+                                       std::vector<Operand>{value});
+        }
+        if (status == ir::ExecStatus::DivByZero) {
+            int quotient = fn->newVReg(ir::Type::Int);
+            block->instrs.emplace_back(Opcode::Div, ir::Type::Int, quotient,
+                                       std::vector<Operand>{Operand::ofInt(1),
+                                                            Operand::ofInt(0)});
+        }
+        if (!result.isImm()) {
+            result = fn->retType == ir::Type::Float ? Operand::ofFloat(0.0f)
+                : fn->retType == ir::Type::Bool ? Operand::ofBool(false)
+                                                : Operand::ofInt(0);
+        }
+        block->instrs.emplace_back(Opcode::Ret, fn->retType, -1, std::vector<Operand>{result});
+
+        module.functions.clear();
+        module.functions.push_back(std::move(fn));
+        module.globals.clear();
+        return true;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createPartialEvaluationPass() {
+    return std::make_unique<PartialEvaluationPass>();
+}
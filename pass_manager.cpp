@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "pass_manager.hpp"
+#include "passes.hpp"
+#include "exception.hpp"
+#include "ir_lowering.hpp"
+#include "profile.hpp"
+
+// ===============================
+// Timing
+// ===============================
+
+void PassTimer::record(const std::string& name, double seconds, bool changed) {
+    auto it = index.find(name);
+    if (it == index.end()) {
+        it = index.emplace(name, entries.size()).first;
+        entries.push_back({name, 0.0, 0, 0});
+    }
+    PassTiming& t = entries[it->second];
+    t.seconds += seconds;
+    t.runs += 1;
+    if (changed) {
+        t.changes += 1;
+    }
+}
+
+void PassTimer::report(std::ostream& os) const {
+    double total = 0.0;
+    for (const auto& t : entries) {
+        total += t.seconds;
+    }
+
+    os << "===== Pass execution timing report =====\n";
+    os << std::left << std::setw(32) << "Pass"
+       << std::right << std::setw(12) << "Time (ms)"
+       << std::setw(8) << "%"
+       << std::setw(8) << "Runs"
+       << std::setw(10) << "Changed" << "\n";
+    for (const auto& t : entries) {
+        double pct = total > 0.0 ? 100.0 * t.seconds / total : 0.0;
+        os << std::left << std::setw(32) << t.name
+           << std::right << std::setw(12) << std::fixed << std::setprecision(3)
+           << t.seconds * 1000.0
+           << std::setw(8) << std::setprecision(1) << pct
+           << std::setw(8) << t.runs
+           << std::setw(10) << t.changes << "\n";
+    }
+    os << std::left << std::setw(32) << "Total"
+       << std::right << std::setw(12) << std::fixed << std::setprecision(3)
+       << total * 1000.0 << "\n";
+}
+
+// ===============================
+// AnalysisManager
+// ===============================
+
+void AnalysisManager::invalidate(const void* unit, const PreservedAnalyses& pa) {
+    for (auto it = cache.begin(); it != cache.end();) {
+        // Module-wide results depend on every function, so any change can
+        // make them stale.
+        bool affected = unit == nullptr || it->first.second == unit ||
+                        it->first.second == moduleUnit;
+        if (affected && !pa.preserves(it->first.first)) {
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// ===============================
+// Registry and pipelines
+// ===============================
+
+void PassRegistry::add(const std::string& name, const std::string& description,
+                       std::function<std::unique_ptr<Pass>()> create) {
+    passes.push_back({name, description, std::move(create)});
+}
+
+const PassInfo* PassRegistry::find(const std::string& name) const {
+    for (const auto& info : passes) {
+        if (info.name == name) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const PassRegistry& PassRegistry::builtin() {
+    static const PassRegistry registry = [] {
+        PassRegistry r;
+        r.add("verify", "Check AST invariants the code generator relies on",
+              createVerifierPass);
+        r.add("constfold", "Fold literal expressions and propagate constant lets",
+              createConstantFoldPass);
+        r.add("print-analyses", "Print CFG, dominator, loop and dataflow results for every IR function",
+              createPrintAnalysesPass);
+        r.add("inline", "Inline small non-recursive functions bottom-up over the call graph",
+              createInlinerPass);
+        r.add("tailrec", "Turn self tail calls and accumulating recursion into loops",
+              createTailRecursionPass);
+        r.add("ssa", "Put IR functions into SSA form", createSSAPass);
+        r.add("out-of-ssa", "Replace phis by copies", createOutOfSSAPass);
+        r.add("sccp", "Sparse conditional constant propagation and dead branch removal",
+              createSCCPPass);
+        r.add("gvn", "Dominator-based value numbering of pure expressions and global loads",
+              createGVNPass);
+        r.add("licm", "Hoist loop-invariant computations into loop preheaders",
+              createLICMPass);
+        r.add("ivsr", "Replace products of induction variables by added-up phis",
+              createIVStrengthReductionPass);
+        r.add("unroll", "Unroll counted innermost loops, keeping a remainder loop",
+              createLoopUnrollPass);
+        r.add("rotate", "Move while-loop tests to the bottom, guarded once at the entry",
+              createLoopRotationPass);
+        r.add("layout", "Move returns out of loops to the end of the function",
+              createBlockLayoutPass);
+        r.add("ctfe", "Evaluate calls of pure functions with constant arguments at compile time",
+              createCallEvaluationPass);
+        r.add("specialize", "Clone functions for call sites passing constant arguments",
+              createSpecializationPass);
+        r.add("peval", "Run input-free programs at compile time and emit only their output",
+              createPartialEvaluationPass);
+        r.add("divcheck", "Drop division-by-zero checks on divisors proven non-zero by value ranges",
+              createDivCheckPass);
+        r.add("dce", "Remove dead instructions, unused variables and dead stores",
+              createDCEPass);
+        r.add("globaldce", "Remove functions unreachable from main and unread globals",
+              createGlobalDCEPass);
+        r.add("memoize", "Cache results of pure recursive functions of one int (--memoize)",
+              createMemoizePass);
+        return r;
+    }();
+    return registry;
+}
+
+bool isKnownOptLevel(const std::string& level) {
+    return level == "O0" || level == "O1" || level == "O2" || level == "O3" ||
+           level == "Os";
+}
+
+std::vector<std::string> pipelineForLevel(const std::string& level) {
+    // -O0 keeps the translation one-to-one for debugging; higher levels
+    // trade compile time for code quality, -Os favours size over speed.
+    if (level == "O1") {
+        return {"constfold", "tailrec", "ctfe", "inline", "sccp", "gvn", "licm", "ivsr",
+                "divcheck", "rotate", "dce", "globaldce", "layout"};
+    }
+    if (level == "O2") {
+        return {"constfold", "tailrec", "ctfe", "specialize", "inline", "sccp", "gvn", "licm",
+                "ivsr", "unroll", "divcheck", "rotate", "dce", "globaldce", "layout"};
+    }
+    if (level == "O3") {
+        return {"constfold", "peval", "tailrec", "ctfe", "specialize", "inline", "sccp", "gvn",
+                "licm", "ivsr", "unroll", "divcheck", "rotate", "dce", "globaldce", "layout"};
+    }
+    if (level == "Os") {
+        return {"constfold", "tailrec", "ctfe", "inline", "sccp", "gvn", "licm", "ivsr",
+                "divcheck", "dce", "globaldce", "layout"};
+    }
+    return {};
+}
+
+// ===============================
+// PassManager
+// ===============================
+
+bool PassManager::schedule(const std::string& name,
+                           std::vector<std::string>& stack) {
+    const PassInfo* info = registry.find(name);
+    if (!info) {
+        std::cerr << "Optimization error: unknown pass '" << name << "'"
+                  << std::endl;
+        std::cerr << "Available passes:";
+        for (const auto& p : registry.all()) {
+            std::cerr << " " << p.name;
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+
+    if (std::find(stack.begin(), stack.end(), name) != stack.end()) {
+        std::cerr << "Optimization error: dependency cycle through pass '"
+                  << name << "'" << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<Pass> pass = info->create();
+    pass->setOptions(options);
+
+    // Bring in prerequisites that have not been scheduled yet.
+    stack.push_back(name);
+    for (const auto& dep : pass->dependencies()) {
+        std::vector<std::string> scheduled = passNames();
+        if (std::find(scheduled.begin(), scheduled.end(), dep) == scheduled.end()) {
+            if (!schedule(dep, stack)) {
+                return false;
+            }
+        }
+    }
+    stack.pop_back();
+
+    pipeline.push_back(std::move(pass));
+    return true;
+}
+
+bool PassManager::addPass(const std::string& name) {
+    std::vector<std::string> stack;
+    return schedule(name, stack);
+}
+
+bool PassManager::configure(const OptimizationOptions& options) {
+    pipeline.clear();
+    this->options = options;
+    timePasses = options.timePasses;
+
+    std::vector<std::string> names = options.customPipeline
+        ? options.passes
+        : pipelineForLevel(options.level);
+    // Memoization trades data space for time and is only done on request.
+    if (options.memoize) {
+        names.push_back("memoize");
+    }
+    for (const auto& name : names) {
+        if (!addPass(name)) {
+            return false;
+        }
+    }
+
+    // Once lowered, the AST is no longer what gets compiled.
+    bool seenIR = false;
+    for (const auto& pass : pipeline) {
+        bool isIR = pass->kind() == PassKind::IRModule ||
+                    pass->kind() == PassKind::IRFunction;
+        if (!isIR && seenIR) {
+            std::cerr << "Optimization error: AST pass '" << pass->name()
+                      << "' cannot run after IR passes" << std::endl;
+            return false;
+        }
+        seenIR = seenIR || isIR;
+    }
+    return true;
+}
+
+std::vector<std::string> PassManager::passNames() const {
+    std::vector<std::string> names;
+    for (const auto& p : pipeline) {
+        names.push_back(p->name());
+    }
+    return names;
+}
+
+bool PassManager::runPass(Pass& pass, ProgramNode* program, ir::Module* module,
+                          AnalysisManager& am) {
+    bool changed = false;
+
+    switch (pass.kind()) {
+        case PassKind::Module: {
+            auto& modulePass = static_cast<ModulePass&>(pass);
+            if (modulePass.runOnModule(program, am)) {
+                am.invalidate(nullptr, pass.preserved());
+                changed = true;
+            }
+            break;
+        }
+        case PassKind::Function: {
+            auto& functionPass = static_cast<FunctionPass&>(pass);
+            for (FuncDeclNode* func : collectFunctions(program)) {
+                if (functionPass.runOnFunction(func, am)) {
+                    am.invalidate(func, pass.preserved());
+                    changed = true;
+                }
+            }
+            break;
+        }
+        case PassKind::IRModule: {
+            auto& modulePass = static_cast<IRModulePass&>(pass);
+            if (modulePass.runOnModule(*module, am)) {
+                am.invalidate(nullptr, pass.preserved());
+                changed = true;
+            }
+            break;
+        }
+        case PassKind::IRFunction: {
+            auto& functionPass = static_cast<IRFunctionPass&>(pass);
+            for (auto& func : module->functions) {
+                if (functionPass.runOnFunction(*func, am)) {
+                    am.invalidate(func.get(), pass.preserved());
+                    changed = true;
+                }
+            }
+            break;
+        }
+    }
+    return changed;
+}
+
+bool PassManager::run(ProgramNode* program, std::unique_ptr<ir::Module>& module) {
+    AnalysisManager am(timePasses ? &timer : nullptr);
+    am.setModule(program);
+
+    auto lower = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        module = lowerProgram(program);
+        // Profile counters are numbered on the lowered code, before any
+        // pass changes it (profile.hpp).
+        if (!options.profileGenerate.empty()) {
+            ir::instrumentModule(*module, options.profileGenerate);
+        }
+        if (!options.profileUse.empty()) {
+            ir::Profile profile;
+            std::string error;
+            if (!ir::readProfile(options.profileUse, profile, error) ||
+                !ir::applyProfile(*module, profile, error)) {
+                std::cerr << "Warning: " << error << ", compiling without profile"
+                          << std::endl;
+            }
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        timer.record("lower-to-ir", elapsed.count(), true);
+        am.clear();
+        am.setModule(module.get());
+    };
+
+    for (auto& pass : pipeline) {
+        bool isIR = pass->kind() == PassKind::IRModule ||
+                    pass->kind() == PassKind::IRFunction;
+        if (isIR && !module) {
+            lower();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool changed = runPass(*pass, program, module.get(), am);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        timer.record(pass->name(), elapsed.count(), changed);
+    }
+    if (!module) {
+        lower();
+    }
+
+    if (timePasses) {
+        timer.report(std::cerr);
+    }
+    return true;
+}
+
+// ===============================
+// Helpers
+// ===============================
+
+static void collectFromBlock(BlockNode* block, std::vector<FuncDeclNode*>& out);
+
+static void collectFromItem(ASTNode* item, std::vector<FuncDeclNode*>& out) {
+    if (auto* func = dynamic_cast<FuncDeclNode*>(item)) {
+        out.push_back(func);
+        collectFromBlock(func->body, out);
+    } else if (auto* ifs = dynamic_cast<IfStmtNode*>(item)) {
+        collectFromBlock(ifs->thenBlk, out);
+        collectFromBlock(ifs->elseBlk, out);
+    } else if (auto* w = dynamic_cast<WhileStmtNode*>(item)) {
+        collectFromBlock(w->body, out);
+    }
+}
+
+static void collectFromBlock(BlockNode* block, std::vector<FuncDeclNode*>& out) {
+    if (!block) {
+        return;
+    }
+    for (ASTNode* item : block->orderedItems) {
+        collectFromItem(item, out);
+    }
+}
+
+std::vector<FuncDeclNode*> collectFunctions(ProgramNode* program) {
+    std::vector<FuncDeclNode*> out;
+    if (!program) {
+        return out;
+    }
+    for (DeclNode* decl : program->declarations) {
+        collectFromItem(decl, out);
+    }
+    return out;
+}
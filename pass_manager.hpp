@@ -0,0 +1,246 @@
+#ifndef PASS_MANAGER_HPP
+#define PASS_MANAGER_HPP
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "astnode.hpp"
+#include "compiler_context.hpp"
+#include "ir.hpp"
+
+class AnalysisManager;
+
+// ===============================
+// Analyses
+// ===============================
+
+// Base class for cached analysis results. Every analysis declares a
+// static `name` used for caching, dependencies and invalidation, and a
+// constructor taking (Unit&, AnalysisManager&) that computes the result.
+class AnalysisResult {
+ public:
+    virtual ~AnalysisResult() = default;
+};
+
+// Records which analyses a transformation left intact.
+class PreservedAnalyses {
+ private:
+    bool all = false;
+    std::vector<std::string> names;
+
+ public:
+    static PreservedAnalyses none() { return PreservedAnalyses(); }
+    static PreservedAnalyses allAnalyses() {
+        PreservedAnalyses pa;
+        pa.all = true;
+        return pa;
+    }
+
+    PreservedAnalyses& preserve(const std::string& name) {
+        names.push_back(name);
+        return *this;
+    }
+
+    bool preserves(const std::string& name) const {
+        if (all) {
+            return true;
+        }
+        for (const auto& n : names) {
+            if (n == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct PassTiming {
+    std::string name;
+    double seconds = 0.0;
+    int runs = 0;
+    int changes = 0;
+};
+
+// Collects per-pass and per-analysis wall-clock time for --time-passes.
+class PassTimer {
+ private:
+    std::vector<PassTiming> entries;
+    std::map<std::string, size_t> index;
+
+ public:
+    void record(const std::string& name, double seconds, bool changed);
+    void report(std::ostream& os) const;
+};
+
+// Computes analyses on demand and caches them per unit (a function or the
+// whole module) until a transformation invalidates them.
+class AnalysisManager {
+ private:
+    using Key = std::pair<std::string, const void*>;
+    std::map<Key, std::unique_ptr<AnalysisResult>> cache;
+    PassTimer* timer = nullptr;
+    const void* moduleUnit = nullptr;
+
+ public:
+    explicit AnalysisManager(PassTimer* t = nullptr) : timer(t) {}
+
+    // Results keyed on the module unit are invalidated by any change.
+    void setModule(const void* unit) { moduleUnit = unit; }
+
+    template <typename A, typename Unit>
+    A& get(Unit& unit) {
+        Key key(A::name, static_cast<const void*>(&unit));
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<AnalysisResult> result =
+                std::make_unique<A>(unit, *this);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            if (timer) {
+                timer->record(std::string("analysis: ") + A::name,
+                              elapsed.count(), false);
+            }
+            it = cache.emplace(key, std::move(result)).first;
+        }
+        return static_cast<A&>(*it->second);
+    }
+
+    template <typename A, typename Unit>
+    A* getCached(Unit& unit) {
+        auto it = cache.find(Key(A::name, static_cast<const void*>(&unit)));
+        return it == cache.end() ? nullptr : static_cast<A*>(it->second.get());
+    }
+
+    // Drop results for `unit` (and all module-wide results) that `pa` does
+    // not preserve. A null unit invalidates every unit.
+    void invalidate(const void* unit, const PreservedAnalyses& pa);
+    void clear() { cache.clear(); }
+};
+
+// ===============================
+// Passes
+// ===============================
+
+enum class PassKind {
+    Module,      // runs once over the whole ProgramNode
+    Function,    // runs once per FuncDeclNode, nested ones included
+    IRModule,    // runs once over the lowered ir::Module
+    IRFunction   // runs once per ir::Function
+};
+
+class Pass {
+ public:
+    virtual ~Pass() = default;
+    virtual const char* name() const = 0;
+    virtual PassKind kind() const = 0;
+
+    // Passes that must have run earlier in the pipeline; the pass manager
+    // schedules missing ones automatically.
+    virtual std::vector<std::string> dependencies() const { return {}; }
+
+    // Analyses that remain valid when this pass reports a change.
+    virtual PreservedAnalyses preserved() const {
+        return PreservedAnalyses::none();
+    }
+
+    // Called once when the pass is added to a pipeline, for passes with
+    // tunable parameters.
+    virtual void setOptions(const OptimizationOptions&) {}
+};
+
+class ModulePass : public Pass {
+ public:
+    PassKind kind() const override { return PassKind::Module; }
+    // Returns true if the program was changed.
+    virtual bool runOnModule(ProgramNode* program, AnalysisManager& am) = 0;
+};
+
+class FunctionPass : public Pass {
+ public:
+    PassKind kind() const override { return PassKind::Function; }
+    // Returns true if the function was changed.
+    virtual bool runOnFunction(FuncDeclNode* func, AnalysisManager& am) = 0;
+};
+
+// IR passes run after the program has been lowered; the pass manager
+// lowers it right before the first IR pass of the pipeline.
+class IRModulePass : public Pass {
+ public:
+    PassKind kind() const override { return PassKind::IRModule; }
+    // Returns true if the module was changed.
+    virtual bool runOnModule(ir::Module& module, AnalysisManager& am) = 0;
+};
+
+class IRFunctionPass : public Pass {
+ public:
+    PassKind kind() const override { return PassKind::IRFunction; }
+    // Returns true if the function was changed.
+    virtual bool runOnFunction(ir::Function& func, AnalysisManager& am) = 0;
+};
+
+// ===============================
+// Registry and pipelines
+// ===============================
+
+struct PassInfo {
+    std::string name;
+    std::string description;
+    std::function<std::unique_ptr<Pass>()> create;
+};
+
+class PassRegistry {
+ private:
+    std::vector<PassInfo> passes;
+
+ public:
+    void add(const std::string& name, const std::string& description,
+             std::function<std::unique_ptr<Pass>()> create);
+    const PassInfo* find(const std::string& name) const;
+    const std::vector<PassInfo>& all() const { return passes; }
+
+    // Registry holding every pass shipped with the compiler.
+    static const PassRegistry& builtin();
+};
+
+// Named pass orderings selected with -O0/-O1/-O2/-Os.
+bool isKnownOptLevel(const std::string& level);
+std::vector<std::string> pipelineForLevel(const std::string& level);
+
+class PassManager {
+ private:
+    const PassRegistry& registry;
+    OptimizationOptions options;
+    std::vector<std::unique_ptr<Pass>> pipeline;
+    PassTimer timer;
+    bool timePasses = false;
+
+    bool schedule(const std::string& name, std::vector<std::string>& stack);
+    bool runPass(Pass& pass, ProgramNode* program, ir::Module* module,
+                 AnalysisManager& am);
+
+ public:
+    explicit PassManager(const PassRegistry& reg = PassRegistry::builtin())
+        : registry(reg) {}
+
+    // Builds the pipeline from options; reports unknown passes, dependency
+    // cycles and AST passes scheduled after IR passes to std::cerr and
+    // returns false.
+    bool configure(const OptimizationOptions& options);
+    bool addPass(const std::string& name);
+    std::vector<std::string> passNames() const;
+
+    // Runs the pipeline: AST passes first, then the program is lowered into
+    // `module` and the IR passes transform it.
+    bool run(ProgramNode* program, std::unique_ptr<ir::Module>& module);
+};
+
+// Helper shared by passes: every FuncDeclNode in source order, including
+// functions declared inside blocks.
+std::vector<FuncDeclNode*> collectFunctions(ProgramNode* program);
+
+#endif /* PASS_MANAGER_HPP */
@@ -0,0 +1,30 @@
+#ifndef PASSES_HPP
+#define PASSES_HPP
+
+#include <memory>
+#include "pass_manager.hpp"
+
+// Factories for every pass the PassRegistry knows about.
+std::unique_ptr<Pass> createVerifierPass();
+std::unique_ptr<Pass> createConstantFoldPass();
+std::unique_ptr<Pass> createPrintAnalysesPass();
+std::unique_ptr<Pass> createInlinerPass();
+std::unique_ptr<Pass> createTailRecursionPass();
+std::unique_ptr<Pass> createSSAPass();
+std::unique_ptr<Pass> createOutOfSSAPass();
+std::unique_ptr<Pass> createSCCPPass();
+std::unique_ptr<Pass> createGVNPass();
+std::unique_ptr<Pass> createLICMPass();
+std::unique_ptr<Pass> createIVStrengthReductionPass();
+std::unique_ptr<Pass> createLoopUnrollPass();
+std::unique_ptr<Pass> createLoopRotationPass();
+std::unique_ptr<Pass> createBlockLayoutPass();
+std::unique_ptr<Pass> createDivCheckPass();
+std::unique_ptr<Pass> createCallEvaluationPass();
+std::unique_ptr<Pass> createPartialEvaluationPass();
+std::unique_ptr<Pass> createSpecializationPass();
+std::unique_ptr<Pass> createDCEPass();
+std::unique_ptr<Pass> createGlobalDCEPass();
+std::unique_ptr<Pass> createMemoizePass();
+
+#endif /* PASSES_HPP */
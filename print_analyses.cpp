@@ -0,0 +1,91 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Analysis printer
+// ===============================
+// Dumps the CFG analyses of every IR function to stderr, one line per
+// block, for debugging pipelines given with --passes=.
+
+namespace {
+
+void printBlockList(std::ostream& os, const std::vector<int>& blocks) {
+    os << "[";
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        os << (i ? " " : "") << "bb" << blocks[i];
+    }
+    os << "]";
+}
+
+void printTreeParent(std::ostream& os, const ir::DomTreeBase& tree, int block) {
+    if (!tree.covers(block)) {
+        os << "none";
+    } else if (tree.immediate(block) < 0) {
+        os << "-";
+    } else {
+        os << "bb" << tree.immediate(block);
+    }
+}
+
+class PrintAnalysesPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "print-analyses"; }
+
+    PreservedAnalyses preserved() const override {
+        return PreservedAnalyses::allAnalyses();
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        auto& cfg = am.get<ir::CFG>(fn);
+        auto& dt = am.get<ir::DominatorTree>(fn);
+        auto& pdt = am.get<ir::PostDominatorTree>(fn);
+        auto& loops = am.get<ir::LoopInfo>(fn);
+        auto& live = am.get<ir::Liveness>(fn);
+        auto& rd = am.get<ir::ReachingDefinitions>(fn);
+
+        // Built up front: stderr is unbuffered and the dump can be large.
+        std::ostringstream os;
+        os << "analyses for " << fn.label << ":\n";
+        for (int b : cfg.rpo) {
+            os << "  bb" << b << ": preds ";
+            printBlockList(os, cfg.preds[b]);
+            os << " succs ";
+            printBlockList(os, cfg.succs[b]);
+            os << " idom ";
+            printTreeParent(os, dt, b);
+            os << " ipdom ";
+            printTreeParent(os, pdt, b);
+            os << " loop-depth " << loops.depthOf(b);
+            os << " live-in {";
+            bool first = true;
+            live.liveIn[b].forEach([&](size_t bit) {
+                int r = live.tracked[bit];
+                os << (first ? "" : " ");
+                ir::printOperand(os, fn, ir::Operand::ofReg(r, fn.regType(r)));
+                first = false;
+            });
+            os << "} reaching-defs " << rd.in[b].count() << "\n";
+        }
+        for (size_t i = 0; i < loops.loops.size(); ++i) {
+            const ir::Loop& loop = loops.loops[i];
+            os << "  loop " << i << ": header bb" << loop.header
+               << " depth " << loop.depth << " blocks ";
+            printBlockList(os, loop.blocks);
+            os << " exits ";
+            printBlockList(os, loops.exitBlocks(static_cast<int>(i), cfg));
+            os << "\n";
+        }
+        std::cerr << os.str();
+        return false;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createPrintAnalysesPass() {
+    return std::make_unique<PrintAnalysesPass>();
+}
@@ -0,0 +1,118 @@
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "profile.hpp"
+
+namespace ir {
+
+namespace {
+
+// Calls `visit(block, call, counter)` for every block (call == nullptr)
+// and every call of `module` in counter order, and returns the checksum of
+// the walk: FNV-1a over the function labels, block sizes and callees.
+uint32_t walkCounters(Module& module,
+                      const std::function<void(BasicBlock&, Instr*, int)>& visit) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&](const std::string& text) {
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 16777619u;
+        }
+        hash = (hash ^ 0xff) * 16777619u;
+    };
+    int counter = 0;
+    for (auto& fn : module.functions) {
+        mix(fn->label);
+        for (auto& block : fn->blocks) {
+            mix(std::to_string(block->instrs.size()));
+            visit(*block, nullptr, counter++);
+            for (Instr& instr : block->instrs) {
+                if (instr.op == Opcode::Call) {
+                    mix(instr.symbol);
+                    visit(*block, &instr, counter++);
+                }
+            }
+        }
+    }
+    mix(std::to_string(counter));
+    return hash;
+}
+
+uint32_t readWord(const std::vector<unsigned char>& bytes, size_t word) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | bytes[4 * word + i];
+    }
+    return value;
+}
+
+}  // anonymous namespace
+
+void instrumentModule(Module& module, const std::string& file) {
+    // Counters go in once the walk is done, so it sees the lowered code.
+    std::vector<std::pair<BasicBlock*, int>> blocks;
+    int counters = 0;
+    module.profileChecksum = walkCounters(module, [&](BasicBlock& block, Instr* call, int n) {
+        if (!call) {
+            blocks.emplace_back(&block, n);
+        }
+        counters = n + 1;
+    });
+    module.profileCounters = counters;
+    module.profileFile = file;
+
+    auto count = [](int n) { return Instr(Opcode::Count, Type::Void, -1, {Operand::ofInt(n)}); };
+    for (const auto& entry : blocks) {
+        BasicBlock& block = *entry.first;
+        int n = entry.second;
+        std::vector<Instr> instrs;
+        instrs.push_back(count(n++));
+        for (Instr& instr : block.instrs) {
+            if (instr.op == Opcode::Call) {
+                instrs.push_back(count(n++));
+            }
+            instrs.push_back(std::move(instr));
+        }
+        block.instrs = std::move(instrs);
+    }
+}
+
+bool readProfile(const std::string& path, Profile& profile, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "cannot open profile '" + path + "'";
+        return false;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)),
+                                     std::istreambuf_iterator<char>());
+    if (bytes.size() < 12 || readWord(bytes, 0) != kProfileMagic ||
+        bytes.size() != 12 + 4 * size_t(readWord(bytes, 2))) {
+        error = "'" + path + "' is not a profile";
+        return false;
+    }
+    profile.checksum = readWord(bytes, 1);
+    profile.counters.clear();
+    for (size_t w = 3; w < bytes.size() / 4; ++w) {
+        profile.counters.push_back(readWord(bytes, w));
+    }
+    return true;
+}
+
+bool applyProfile(Module& module, const Profile& profile, std::string& error) {
+    int counters = 0;
+    uint32_t checksum = walkCounters(module, [&](BasicBlock&, Instr*, int n) {
+        counters = n + 1;
+    });
+    if (checksum != profile.checksum ||
+        counters != static_cast<int>(profile.counters.size())) {
+        error = "profile does not match the program";
+        return false;
+    }
+    walkCounters(module, [&](BasicBlock& block, Instr* call, int n) {
+        (call ? call->count : block.count) = profile.counters[n];
+    });
+    return true;
+}
+
+}  // namespace ir
@@ -0,0 +1,53 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+// ===============================
+// Execution profiles
+// ===============================
+// Profile-guided optimization compiles a program twice. With
+// -fprofile-generate every basic block of the freshly lowered module gets
+// a counter, and so does every call site; the program counts how often
+// each one runs and writes the counters to a file when it exits. With
+// -fprofile-use those counts are read back into the freshly lowered
+// module of the same program (ir::BasicBlock::count, ir::Instr::count of
+// calls), where the inliner, loop unrolling and block placement use them.
+//
+// Counters are numbered by walking the lowered module in order: every
+// block takes the next number, then every call in it. Both builds lower
+// the same program the same way, so the numbers agree whatever the
+// passes do afterwards; a checksum of the walk catches profiles of
+// another version of the program.
+//
+// The file holds little-endian 32-bit words: kProfileMagic, the checksum,
+// the number of counters and the counters themselves.
+
+namespace ir {
+
+const uint32_t kProfileMagic = 0x464f5250;   // "PROF"
+
+struct Profile {
+    uint32_t checksum = 0;
+    std::vector<uint32_t> counters;
+};
+
+// Puts a Count at the top of every block and in front of every call of a
+// freshly lowered module and records the counters in module.profile*.
+void instrumentModule(Module& module, const std::string& file);
+
+// Reads a profile written by an instrumented program. Returns false with
+// the reason in `error` if the file cannot be read or is no profile.
+bool readProfile(const std::string& path, Profile& profile, std::string& error);
+
+// Sets the counts of the blocks and calls of a freshly lowered module.
+// Returns false with the reason in `error`, leaving the module alone, if
+// the profile was recorded for a different program.
+bool applyProfile(Module& module, const Profile& profile, std::string& error);
+
+}  // namespace ir
+
+#endif /* PROFILE_HPP */
@@ -0,0 +1,291 @@
+#include <utility>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Sparse conditional constant propagation
+// ===============================
+// Wegman-Zadeck SCCP over SSA form. Every register starts out unknown and
+// only blocks reachable through edges whose branch condition is not a
+// known constant are evaluated, so constants flowing through branches
+// (including phis joining equal constants) are found together with the
+// arms and loop bodies that never run. Registers proven constant are
+// replaced by immediates, branches on constants become jumps and the dead
+// blocks are deleted.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+struct Cell {
+    enum class State { Unknown, Constant, Varying };
+
+    State state = State::Unknown;
+    Operand value;
+};
+
+class SCCPSolver {
+ private:
+    ir::Function& fn;
+    ir::CFG& cfg;
+    std::vector<Cell> cells;
+    std::vector<char> executable;                   // per block
+    std::vector<std::vector<char>> edgeExecutable;  // per block, per pred index
+    std::vector<std::vector<std::pair<int, int>>> users;
+    std::vector<std::pair<int, int>> edgeWork;
+    std::vector<int> valueWork;
+
+    Cell valueOf(const Operand& op) const {
+        if (op.isImm()) {
+            return {Cell::State::Constant, op};
+        }
+        return cells[op.reg];
+    }
+
+    void update(int reg, const Cell& cell) {
+        Cell& old = cells[reg];
+        if (old.state == cell.state &&
+            (cell.state != Cell::State::Constant || old.value == cell.value)) {
+            return;
+        }
+        old = cell;
+        valueWork.push_back(reg);
+    }
+
+    void markVarying(int reg) {
+        update(reg, {Cell::State::Varying, Operand()});
+    }
+
+    void markEdge(int from, int to) {
+        const std::vector<int>& preds = cfg.preds[to];
+        for (size_t i = 0; i < preds.size(); ++i) {
+            if (preds[i] == from && !edgeExecutable[to][i]) {
+                edgeExecutable[to][i] = 1;
+                edgeWork.emplace_back(from, to);
+            }
+        }
+    }
+
+    bool edgeLive(int from, int to) const {
+        const std::vector<int>& preds = cfg.preds[to];
+        for (size_t i = 0; i < preds.size(); ++i) {
+            if (preds[i] == from && edgeExecutable[to][i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void visitPhi(int block, const Instr& phi) {
+        Cell result;
+        for (size_t i = 0; i < phi.args.size(); ++i) {
+            if (!edgeLive(phi.targets[i], block)) {
+                continue;
+            }
+            Cell in = valueOf(phi.args[i]);
+            if (in.state == Cell::State::Unknown) {
+                continue;
+            }
+            if (in.state == Cell::State::Varying ||
+                (result.state == Cell::State::Constant && !(result.value == in.value))) {
+                markVarying(phi.dst);
+                return;
+            }
+            result = in;
+        }
+        if (result.state == Cell::State::Constant) {
+            update(phi.dst, result);
+        }
+    }
+
+    void visit(int block, const Instr& instr) {
+        if (instr.op == Opcode::Phi) {
+            visitPhi(block, instr);
+            return;
+        }
+
+        if (instr.op == Opcode::Br) {
+            markEdge(block, instr.targets[0]);
+            return;
+        }
+        if (instr.op == Opcode::CondBr) {
+            Cell cond = valueOf(instr.args[0]);
+            if (cond.state == Cell::State::Constant) {
+                markEdge(block, instr.targets[cond.value.intValue ? 0 : 1]);
+            } else if (cond.state == Cell::State::Varying) {
+                markEdge(block, instr.targets[0]);
+                markEdge(block, instr.targets[1]);
+            }
+            return;
+        }
+        if (instr.dst < 0) {
+            return;
+        }
+        if (instr.op == Opcode::Call || instr.op == Opcode::LoadGlobal) {
+            markVarying(instr.dst);
+            return;
+        }
+
+        std::vector<Operand> args;
+        for (const Operand& a : instr.args) {
+            Cell c = valueOf(a);
+            if (c.state == Cell::State::Unknown) {
+                return;
+            }
+            if (c.state == Cell::State::Varying) {
+                markVarying(instr.dst);
+                return;
+            }
+            args.push_back(c.value);
+        }
+        Operand folded;
+        if (ir::foldConstant(instr.op, instr.type, args, folded)) {
+            update(instr.dst, {Cell::State::Constant, folded});
+        } else {
+            markVarying(instr.dst);
+        }
+    }
+
+ public:
+    SCCPSolver(ir::Function& f, ir::CFG& c) : fn(f), cfg(c) {}
+
+    void solve() {
+        int n = cfg.numBlocks();
+        cells.assign(fn.vregs.size(), Cell());
+        executable.assign(n, 0);
+        edgeExecutable.assign(n, {});
+        users.assign(fn.vregs.size(), {});
+        for (int b = 0; b < n; ++b) {
+            edgeExecutable[b].assign(cfg.preds[b].size(), 0);
+            const auto& instrs = fn.blocks[b]->instrs;
+            for (size_t i = 0; i < instrs.size(); ++i) {
+                ir::forEachUse(instrs[i], [&](int r) {
+                    users[r].emplace_back(b, static_cast<int>(i));
+                });
+            }
+        }
+        for (int p : fn.params) {
+            cells[p].state = Cell::State::Varying;
+        }
+
+        auto enter = [&](int b) {
+            executable[b] = 1;
+            for (const Instr& instr : fn.blocks[b]->instrs) {
+                visit(b, instr);
+            }
+        };
+        enter(0);
+        while (!edgeWork.empty() || !valueWork.empty()) {
+            while (!edgeWork.empty()) {
+                int to = edgeWork.back().second;
+                edgeWork.pop_back();
+                if (!executable[to]) {
+                    enter(to);
+                    continue;
+                }
+                // Only the phis see the new edge.
+                for (const Instr& instr : fn.blocks[to]->instrs) {
+                    if (instr.op != Opcode::Phi) {
+                        break;
+                    }
+                    visitPhi(to, instr);
+                }
+            }
+            while (!valueWork.empty()) {
+                int reg = valueWork.back();
+                valueWork.pop_back();
+                for (auto [b, i] : users[reg]) {
+                    if (executable[b]) {
+                        visit(b, fn.blocks[b]->instrs[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Applies the solution; returns true if anything changed.
+    bool rewrite() {
+        bool changed = false;
+        for (auto& block : fn.blocks) {
+            if (!executable[block->id]) {
+                continue;
+            }
+            auto& instrs = block->instrs;
+            std::vector<Instr> kept;
+            kept.reserve(instrs.size());
+            for (Instr& instr : instrs) {
+                for (Operand& a : instr.args) {
+                    if (a.isReg() && cells[a.reg].state == Cell::State::Constant) {
+                        a = cells[a.reg].value;
+                        changed = true;
+                    }
+                }
+                if (instr.dst >= 0 && cells[instr.dst].state == Cell::State::Constant &&
+                    !instr.hasSideEffects() && instr.op != Opcode::Call) {
+                    changed = true;
+                    continue;
+                }
+                if (instr.op == Opcode::CondBr && instr.args[0].isImm()) {
+                    int taken = instr.targets[instr.args[0].intValue ? 0 : 1];
+                    int dropped = instr.targets[instr.args[0].intValue ? 1 : 0];
+                    if (dropped != taken) {
+                        fn.blocks[dropped]->removeIncoming(block->id);
+                    }
+                    Instr br(Opcode::Br, ir::Type::Void, -1);
+                    br.targets = {taken};
+                    kept.push_back(std::move(br));
+                    changed = true;
+                    continue;
+                }
+                kept.push_back(std::move(instr));
+            }
+            instrs = std::move(kept);
+        }
+
+        changed = fn.removeUnreachableBlocks() || changed;
+
+        // Phis left with one input are plain copies.
+        for (auto& block : fn.blocks) {
+            for (Instr& instr : block->instrs) {
+                if (instr.op != Opcode::Phi) {
+                    break;
+                }
+                if (instr.args.size() == 1) {
+                    instr.op = Opcode::Copy;
+                    instr.targets.clear();
+                    changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+class SCCPPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "sccp"; }
+
+    std::vector<std::string> dependencies() const override { return {"ssa"}; }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        bool changed = false;
+        if (!fn.ssa) {
+            changed = ir::constructSSA(fn, am);
+            am.invalidate(&fn, PreservedAnalyses::none());
+        }
+        SCCPSolver solver(fn, am.get<ir::CFG>(fn));
+        solver.solve();
+        return solver.rewrite() || changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createSCCPPass() {
+    return std::make_unique<SCCPPass>();
+}
@@ -0,0 +1,217 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+// ===============================
+// Function specialization
+// ===============================
+// A call passing constants for some parameters, like a mode flag or a
+// fixed size, is redirected to a clone of the callee that takes only the
+// other arguments and starts by copying the constants into the remaining
+// parameter registers. sccp and dce, which run later, then fold the tests
+// on those parameters and delete the arms that can no longer run. Call
+// sites passing the same constants share a clone.
+//
+// Clones are only made of functions of at most kMaxCloneSize instructions
+// that compare, branch on, multiply or divide by a constant parameter, and
+// at most kMaxClones per function; globaldce drops originals that no
+// longer have callers.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+const int kMaxCloneSize = 150;
+const int kMaxClones = 4;
+
+int sizeOf(const ir::Function& fn) {
+    int size = 0;
+    for (const auto& block : fn.blocks) {
+        size += static_cast<int>(block->instrs.size());
+    }
+    return size;
+}
+
+// True if knowing `reg` decides a branch or simplifies a multiplication
+// or division in `fn`; other uses rarely pay for a copy of the function.
+bool worthSpecializing(const ir::Function& fn, int reg) {
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            if (!ir::isCompare(instr.op) && instr.op != Opcode::CondBr &&
+                instr.op != Opcode::IntToBool && instr.op != Opcode::Mul &&
+                instr.op != Opcode::Div) {
+                continue;
+            }
+            for (const Operand& a : instr.args) {
+                if (a.isReg() && a.reg == reg) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<ir::Function> cloneFunction(const ir::Function& fn) {
+    auto clone = std::make_unique<ir::Function>();
+    clone->name = fn.name;
+    clone->retType = fn.retType;
+    clone->params = fn.params;
+    clone->vregs = fn.vregs;
+    clone->ssa = fn.ssa;
+    for (const auto& block : fn.blocks) {
+        clone->blocks.push_back(std::make_unique<ir::BasicBlock>(*block));
+    }
+    return clone;
+}
+
+// Constant arguments of a call site, by parameter index.
+using Binding = std::vector<std::pair<size_t, Operand>>;
+
+std::string keyOf(const ir::Function& callee, const Binding& binding) {
+    std::string key = callee.label;
+    for (const auto& b : binding) {
+        const Operand& value = b.second;
+        key += " " + std::to_string(b.first) + "=";
+        // Floats by their bits, so nearby values never share a clone.
+        uint32_t bits = static_cast<uint32_t>(value.intValue);
+        if (value.type == ir::Type::Float) {
+            std::memcpy(&bits, &value.floatValue, sizeof bits);
+        }
+        key += std::to_string(bits);
+    }
+    return key;
+}
+
+class SpecializationPass : public IRModulePass {
+ private:
+    static std::string cloneLabel(const ir::Module& module, const std::string& base) {
+        for (int n = 1;; ++n) {
+            std::string label = base + "__spec" + std::to_string(n);
+            if (!module.findFunction(label)) {
+                return label;
+            }
+        }
+    }
+
+    // The clone of `callee` with the parameters in `binding` fixed.
+    static std::unique_ptr<ir::Function> specialize(const ir::Module& module,
+                                                    const ir::Function& callee,
+                                                    const Binding& binding) {
+        auto clone = cloneFunction(callee);
+        clone->label = cloneLabel(module, callee.label);
+        // The copies must run once, so an entry block that is also a loop
+        // header gets a new block in front of it.
+        bool entryIsTarget = false;
+        for (const auto& block : clone->blocks) {
+            for (int succ : block->successors()) {
+                entryIsTarget = entryIsTarget || succ == 0;
+            }
+        }
+        if (entryIsTarget) {
+            auto entry = std::make_unique<ir::BasicBlock>();
+            entry->id = static_cast<int>(clone->blocks.size());
+            entry->hint = "spec.entry";
+            entry->instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+            entry->instrs.back().targets = {clone->blocks[0]->id};
+            clone->blocks.insert(clone->blocks.begin(), std::move(entry));
+            clone->renumberBlocks();
+        }
+        auto& entry = clone->entry()->instrs;
+        size_t at = 0;
+        std::vector<int> params;
+        size_t next = 0;
+        for (size_t i = 0; i < callee.params.size(); ++i) {
+            int p = callee.params[i];
+            if (next < binding.size() && binding[next].first == i) {
+                Operand value = binding[next++].second;
+                value.type = callee.regType(p);
+                entry.insert(entry.begin() + at++,
+                             Instr(Opcode::Copy, callee.regType(p), p, {value}));
+            } else {
+                params.push_back(p);
+            }
+        }
+        clone->params = std::move(params);
+        return clone;
+    }
+
+ public:
+    const char* name() const override { return "specialize"; }
+
+    bool runOnModule(ir::Module& module, AnalysisManager& am) override {
+        auto& cg = am.get<ir::CallGraph>(module);
+        std::vector<ir::Function*> functions = cg.functions;
+        std::vector<int> sizes;
+        for (ir::Function* fn : functions) {
+            sizes.push_back(sizeOf(*fn));
+        }
+
+        std::map<std::string, std::string> clones;
+        std::vector<int> cloneCount(functions.size(), 0);
+        bool changed = false;
+
+        for (ir::Function* caller : functions) {
+            for (auto& block : caller->blocks) {
+                for (Instr& call : block->instrs) {
+                    int g = call.op == Opcode::Call ? cg.find(call.symbol) : -1;
+                    if (g < 0 || sizes[g] > kMaxCloneSize) {
+                        continue;
+                    }
+                    const ir::Function& callee = *functions[g];
+                    Binding binding;
+                    for (size_t i = 0; i < call.args.size(); ++i) {
+                        if (call.args[i].isImm() && worthSpecializing(callee, callee.params[i])) {
+                            Operand value = call.args[i];
+                            value.type = callee.regType(callee.params[i]);
+                            binding.emplace_back(i, value);
+                        }
+                    }
+                    if (binding.empty()) {
+                        continue;
+                    }
+
+                    std::string key = keyOf(callee, binding);
+                    auto found = clones.find(key);
+                    if (found == clones.end()) {
+                        if (cloneCount[g] >= kMaxClones) {
+                            continue;
+                        }
+                        ++cloneCount[g];
+                        module.functions.push_back(specialize(module, callee, binding));
+                        found = clones.emplace(key, module.functions.back()->label).first;
+                    }
+
+                    std::vector<Operand> args;
+                    size_t next = 0;
+                    for (size_t i = 0; i < call.args.size(); ++i) {
+                        if (next < binding.size() && binding[next].first == i) {
+                            ++next;
+                        } else {
+                            args.push_back(call.args[i]);
+                        }
+                    }
+                    call.args = std::move(args);
+                    call.symbol = found->second;
+                    changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createSpecializationPass() {
+    return std::make_unique<SpecializationPass>();
+}
@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <utility>
+
+#include "ssa.hpp"
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+
+namespace ir {
+
+namespace {
+
+// Value read on paths where a variable has no definition yet. The
+// language initializes every variable at its declaration, so this only
+// feeds phi inputs that are never used.
+Operand undefinedValue(Type t) {
+    switch (t) {
+        case Type::Float: return Operand::ofFloat(0.0f);
+        case Type::Bool: return Operand::ofBool(false);
+        default: return Operand::ofInt(0);
+    }
+}
+
+// Follows chains of substitutions recorded for deleted registers.
+Operand resolve(const std::vector<Operand>& subst, Operand op) {
+    while (op.isReg() && subst[op.reg].kind != Operand::Kind::None) {
+        op = subst[op.reg];
+    }
+    return op;
+}
+
+// Removes phis whose inputs are all the same value (or the phi itself),
+// which renaming leaves behind for variables that a loop never changes.
+void removeTrivialPhis(Function& fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<Operand> subst(fn.vregs.size());
+        for (auto& block : fn.blocks) {
+            auto& instrs = block->instrs;
+            for (size_t i = 0; i < instrs.size() && instrs[i].op == Opcode::Phi;) {
+                Instr& phi = instrs[i];
+                Operand same;
+                bool trivial = true;
+                for (const Operand& a : phi.args) {
+                    Operand v = resolve(subst, a);
+                    if ((v.isReg() && v.reg == phi.dst) || v == same) {
+                        continue;
+                    }
+                    if (same.kind != Operand::Kind::None) {
+                        trivial = false;
+                        break;
+                    }
+                    same = v;
+                }
+                if (trivial) {
+                    subst[phi.dst] = same.kind == Operand::Kind::None
+                        ? undefinedValue(phi.type)
+                        : same;
+                    instrs.erase(instrs.begin() + i);
+                    changed = true;
+                } else {
+                    ++i;
+                }
+            }
+        }
+        if (!changed) {
+            break;
+        }
+        for (auto& block : fn.blocks) {
+            for (Instr& instr : block->instrs) {
+                for (Operand& a : instr.args) {
+                    a = resolve(subst, a);
+                }
+            }
+        }
+    }
+}
+
+struct Move {
+    int dst;
+    Operand src;
+};
+
+// Orders the moves of a parallel copy so that no source is overwritten
+// before it is read, breaking cycles (x <- y, y <- x) with a temporary.
+std::vector<Instr> sequentialize(Function& fn, std::vector<Move> moves) {
+    std::vector<Instr> out;
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [](const Move& m) {
+                    return m.src.isReg() && m.src.reg == m.dst;
+                }),
+                moves.end());
+
+    auto isRead = [&](int reg, size_t except) {
+        for (size_t j = 0; j < moves.size(); ++j) {
+            if (j != except && moves[j].src.isReg() && moves[j].src.reg == reg) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (!moves.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < moves.size(); ++i) {
+            if (!isRead(moves[i].dst, i)) {
+                out.emplace_back(Opcode::Copy, fn.regType(moves[i].dst),
+                                 moves[i].dst, std::vector<Operand>{moves[i].src});
+                moves.erase(moves.begin() + i);
+                progress = true;
+                break;
+            }
+        }
+        if (progress) {
+            continue;
+        }
+        int saved = moves[0].dst;
+        Type type = fn.regType(saved);
+        int tmp = fn.newVReg(type);
+        out.emplace_back(Opcode::Copy, type, tmp,
+                         std::vector<Operand>{Operand::ofReg(saved, type)});
+        for (Move& m : moves) {
+            if (m.src.isReg() && m.src.reg == saved) {
+                m.src = Operand::ofReg(tmp, type);
+            }
+        }
+    }
+    return out;
+}
+
+}  // anonymous namespace
+
+// ===============================
+// Construction
+// ===============================
+
+bool constructSSA(Function& fn, AnalysisManager& am) {
+    if (fn.ssa) {
+        return false;
+    }
+    if (fn.removeUnreachableBlocks()) {
+        am.invalidate(&fn, PreservedAnalyses::none());
+    }
+
+    CFG& cfg = am.get<CFG>(fn);
+    DominatorTree& dt = am.get<DominatorTree>(fn);
+    Liveness& live = am.get<Liveness>(fn);
+    int n = cfg.numBlocks();
+    size_t numRegs = fn.vregs.size();
+
+    // Variables are the registers lowering assigns more than once or that
+    // stand for a named source variable or parameter.
+    std::vector<int> defCount(numRegs, 0);
+    std::vector<std::vector<int>> defBlocks(numRegs);
+    for (int p : fn.params) {
+        defCount[p]++;
+        defBlocks[p].push_back(0);
+    }
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            if (instr.dst < 0) {
+                continue;
+            }
+            defCount[instr.dst]++;
+            auto& blocks = defBlocks[instr.dst];
+            if (blocks.empty() || blocks.back() != block->id) {
+                blocks.push_back(block->id);
+            }
+        }
+    }
+    std::vector<char> isVar(numRegs, 0);
+    for (size_t r = 0; r < numRegs; ++r) {
+        isVar[r] = defCount[r] > 0 &&
+                   (!fn.vregs[r].name.empty() || defCount[r] > 1);
+    }
+
+    // Pruned phi placement on the iterated dominance frontier.
+    std::vector<std::vector<int>> phiVars(n);
+    std::vector<int> hasPhi(n, -1);
+    std::vector<int> queued(n, -1);
+    for (size_t r = 0; r < numRegs; ++r) {
+        if (!isVar[r] || live.index[r] < 0) {
+            continue;
+        }
+        int reg = static_cast<int>(r);
+        std::vector<int> work = defBlocks[r];
+        for (int b : work) {
+            queued[b] = reg;
+        }
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int f : dt.frontier(b)) {
+                if (hasPhi[f] == reg || !live.isLiveIn(f, reg)) {
+                    continue;
+                }
+                hasPhi[f] = reg;
+                phiVars[f].push_back(reg);
+                if (queued[f] != reg) {
+                    queued[f] = reg;
+                    work.push_back(f);
+                }
+            }
+        }
+    }
+    for (int b = 0; b < n; ++b) {
+        if (phiVars[b].empty()) {
+            continue;
+        }
+        std::vector<Instr> phis;
+        for (int r : phiVars[b]) {
+            Instr phi(Opcode::Phi, fn.regType(r), r);
+            for (int p : cfg.preds[b]) {
+                if (cfg.reachable(p)) {
+                    phi.args.push_back(undefinedValue(phi.type));
+                    phi.targets.push_back(p);
+                }
+            }
+            phis.push_back(std::move(phi));
+        }
+        auto& instrs = fn.blocks[b]->instrs;
+        instrs.insert(instrs.begin(), phis.begin(), phis.end());
+    }
+
+    // Renaming along the dominator tree, iteratively since the tree of a
+    // long function can be very deep.
+    std::vector<std::vector<Operand>> stacks(numRegs);
+    for (int p : fn.params) {
+        stacks[p].push_back(Operand::ofReg(p, fn.regType(p)));
+    }
+    auto current = [&](int r) {
+        return stacks[r].empty() ? undefinedValue(fn.regType(r)) : stacks[r].back();
+    };
+    auto rename = [&](int r) {
+        VReg var = fn.vregs[r];
+        int fresh = fn.newVReg(var.type, var.name);
+        stacks[r].push_back(Operand::ofReg(fresh, var.type));
+        return fresh;
+    };
+
+    struct Frame {
+        int block;
+        size_t next;
+        std::vector<int> pushed;
+    };
+    std::vector<Frame> walk;
+    walk.push_back({0, 0, {}});
+    bool entering = true;
+    while (!walk.empty()) {
+        Frame& frame = walk.back();
+        if (entering) {
+            int b = frame.block;
+            for (size_t i = 0; i < fn.blocks[b]->instrs.size(); ++i) {
+                Instr& instr = fn.blocks[b]->instrs[i];
+                if (instr.op == Opcode::Phi) {
+                    int var = instr.dst;
+                    instr.dst = rename(var);
+                    frame.pushed.push_back(var);
+                    continue;
+                }
+                for (Operand& a : instr.args) {
+                    if (a.isReg() && isVar[a.reg]) {
+                        a = current(a.reg);
+                    }
+                }
+                if (instr.dst >= 0 && isVar[instr.dst]) {
+                    int var = instr.dst;
+                    if (instr.op == Opcode::Copy) {
+                        // Fold the copy: later uses read the source directly.
+                        stacks[var].push_back(instr.args[0]);
+                        instr.dst = -1;
+                        instr.args.clear();
+                    } else {
+                        instr.dst = rename(var);
+                    }
+                    frame.pushed.push_back(var);
+                }
+            }
+            for (int s : cfg.succs[b]) {
+                auto& instrs = fn.blocks[s]->instrs;
+                for (size_t k = 0; k < phiVars[s].size(); ++k) {
+                    Instr& phi = instrs[k];
+                    for (size_t i = 0; i < phi.targets.size(); ++i) {
+                        if (phi.targets[i] == b) {
+                            phi.args[i] = current(phiVars[s][k]);
+                        }
+                    }
+                }
+            }
+        }
+
+        const std::vector<int>& kids = dt.children(frame.block);
+        if (frame.next < kids.size()) {
+            int child = kids[frame.next++];
+            walk.push_back({child, 0, {}});
+            entering = true;
+            continue;
+        }
+        for (int var : frame.pushed) {
+            stacks[var].pop_back();
+        }
+        walk.pop_back();
+        entering = false;
+    }
+
+    for (auto& block : fn.blocks) {
+        auto& instrs = block->instrs;
+        instrs.erase(std::remove_if(instrs.begin(), instrs.end(), [](const Instr& i) {
+                         return i.op == Opcode::Copy && i.dst < 0;
+                     }),
+                     instrs.end());
+    }
+    removeTrivialPhis(fn);
+    fn.ssa = true;
+    return true;
+}
+
+// ===============================
+// Destruction
+// ===============================
+
+bool destroySSA(Function& fn) {
+    if (!fn.ssa) {
+        return false;
+    }
+    fn.ssa = false;
+
+    // A copy placed before a conditional branch would also run on the
+    // other edge, so such edges get a block of their own, laid out before
+    // the block it enters: first the one from the block laid out right
+    // before, which falls into it, last those of back edges, which fall
+    // into the target, so no loop iteration needs an extra jump.
+    size_t original = fn.blocks.size();
+    auto orderedPreds = [&](size_t b) {
+        std::vector<int> preds = fn.blocks[b]->instrs[0].targets;
+        auto rank = [&](int p) {
+            return p + 1 == static_cast<int>(b) ? 0 : p < static_cast<int>(b) ? 1 : 2;
+        };
+        std::sort(preds.begin(), preds.end(), [&](int x, int y) {
+            return rank(x) != rank(y) ? rank(x) < rank(y) : x < y;
+        });
+        preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+        return preds;
+    };
+    std::vector<std::vector<std::unique_ptr<BasicBlock>>> edgeBlocks(original);
+    for (size_t b = 0; b < original; ++b) {
+        BasicBlock* block = fn.blocks[b].get();
+        if (block->instrs.empty() || block->instrs[0].op != Opcode::Phi) {
+            continue;
+        }
+        std::vector<int> preds = orderedPreds(b);
+        for (int p : preds) {
+            Instr& term = fn.blocks[p]->terminator();
+            if (term.op == Opcode::Br) {
+                continue;
+            }
+            auto edge = std::make_unique<BasicBlock>();
+            edge->hint = "edge";
+            edge->instrs.emplace_back(Opcode::Br, Type::Void, -1);
+            edge->instrs.back().targets = {static_cast<int>(b)};
+            edgeBlocks[b].push_back(std::move(edge));
+        }
+    }
+
+    // Give the new blocks ids past the existing ones, then wire them in.
+    int nextId = static_cast<int>(original);
+    for (size_t b = 0; b < original; ++b) {
+        if (edgeBlocks[b].empty()) {
+            continue;
+        }
+        BasicBlock* block = fn.blocks[b].get();
+        std::vector<int> preds = orderedPreds(b);
+        size_t k = 0;
+        for (int p : preds) {
+            Instr& term = fn.blocks[p]->terminator();
+            if (term.op == Opcode::Br) {
+                continue;
+            }
+            BasicBlock* edge = edgeBlocks[b][k++].get();
+            edge->id = nextId++;
+            for (int& t : term.targets) {
+                if (t == static_cast<int>(b)) {
+                    t = edge->id;
+                }
+            }
+            block->replaceIncoming(p, edge->id);
+        }
+    }
+
+    std::vector<std::unique_ptr<BasicBlock>> ordered;
+    for (size_t b = 0; b < original; ++b) {
+        for (auto& edge : edgeBlocks[b]) {
+            ordered.push_back(std::move(edge));
+        }
+        ordered.push_back(std::move(fn.blocks[b]));
+    }
+    fn.blocks = std::move(ordered);
+    std::vector<BasicBlock*> byId(nextId, nullptr);
+    for (auto& block : fn.blocks) {
+        byId[block->id] = block.get();
+    }
+
+    for (auto& block : fn.blocks) {
+        auto& instrs = block->instrs;
+        size_t numPhis = 0;
+        while (numPhis < instrs.size() && instrs[numPhis].op == Opcode::Phi) {
+            ++numPhis;
+        }
+        if (numPhis == 0) {
+            continue;
+        }
+        std::vector<int> preds;
+        for (size_t i = 0; i < numPhis; ++i) {
+            for (int p : instrs[i].targets) {
+                if (std::find(preds.begin(), preds.end(), p) == preds.end()) {
+                    preds.push_back(p);
+                }
+            }
+        }
+        for (int p : preds) {
+            std::vector<Move> moves;
+            for (size_t i = 0; i < numPhis; ++i) {
+                for (size_t j = 0; j < instrs[i].targets.size(); ++j) {
+                    if (instrs[i].targets[j] == p) {
+                        moves.push_back({instrs[i].dst, instrs[i].args[j]});
+                        break;
+                    }
+                }
+            }
+            std::vector<Instr> copies = sequentialize(fn, moves);
+            auto& predInstrs = byId[p]->instrs;
+            predInstrs.insert(predInstrs.end() - 1, copies.begin(), copies.end());
+        }
+        instrs.erase(instrs.begin(), instrs.begin() + numPhis);
+    }
+
+    fn.renumberBlocks();
+    return true;
+}
+
+}  // namespace ir
+
+// ===============================
+// Passes
+// ===============================
+
+namespace {
+
+class SSAPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "ssa"; }
+
+    PreservedAnalyses preserved() const override {
+        // Only instructions change; the block structure stays.
+        return PreservedAnalyses()
+            .preserve(ir::CFG::name)
+            .preserve(ir::DominatorTree::name)
+            .preserve(ir::PostDominatorTree::name)
+            .preserve(ir::LoopInfo::name);
+    }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        return ir::constructSSA(fn, am);
+    }
+};
+
+class OutOfSSAPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "out-of-ssa"; }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager&) override {
+        return ir::destroySSA(fn);
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createSSAPass() {
+    return std::make_unique<SSAPass>();
+}
+
+std::unique_ptr<Pass> createOutOfSSAPass() {
+    return std::make_unique<OutOfSSAPass>();
+}
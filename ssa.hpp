@@ -0,0 +1,27 @@
+#ifndef SSA_HPP
+#define SSA_HPP
+
+#include "ir.hpp"
+#include "pass_manager.hpp"
+
+// ===============================
+// SSA construction and destruction
+// ===============================
+
+namespace ir {
+
+// Puts `fn` into SSA form: phis are placed on the iterated dominance
+// frontier of each variable's definitions wherever the variable is live,
+// then every definition is renamed to a fresh register along the dominator
+// tree. Copies into variables are folded into their uses. Returns false if
+// the function already was in SSA form.
+bool constructSSA(Function& fn, AnalysisManager& am);
+
+// Replaces phis by copies at the end of the incoming blocks, splitting
+// edges whose source ends in a conditional branch. Copies feeding the same
+// block are sequentialized so that swapped values are not clobbered.
+bool destroySSA(Function& fn);
+
+}  // namespace ir
+
+#endif /* SSA_HPP */
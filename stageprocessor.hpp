@@ -35,8 +35,8 @@ class OptimizationStageProcessor : public StageProcessor {
 
 class CodeGenerationStageProcessor : public StageProcessor {
  private:
-    ASTNode* astRoot = nullptr;
-    std::string generateCode();
+    ir::Module* module = nullptr;
+    std::string generateCode(const OptimizationOptions& options);
 
  public:
     bool process(CompilerContext& ctx) override;
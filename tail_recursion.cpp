@@ -0,0 +1,235 @@
+#include <string>
+#include <vector>
+
+#include "passes.hpp"
+#include "ir_analysis.hpp"
+#include "ssa.hpp"
+
+// ===============================
+// Tail recursion elimination
+// ===============================
+// Turns self-recursive calls in tail position into jumps back to the top
+// of the function, so the recursion runs as a loop inside one frame. A new
+// entry block is put in front of the old one, which becomes the loop
+// header; a tail call assigns its arguments to the parameter registers
+// (through temporaries, since an argument may read another parameter) and
+// branches there.
+//
+// Linear recursion whose result is combined with one more value,
+//     return n * f(n - 1);
+// is handled with an accumulator when the operator is an integer add or
+// mul, which are associative and commutative even when they wrap: every
+// such site folds its other operand into the accumulator before jumping,
+// and every other return hands back `acc op value`. The accumulator starts
+// at the operator's identity in the new entry block. Calls that are not in
+// tail position, like the first call of `fib(n - 1) + fib(n - 2)`, stay
+// ordinary calls. Float arithmetic is not associative, so float functions
+// only get plain tail calls removed.
+
+namespace {
+
+using ir::Instr;
+using ir::Opcode;
+using ir::Operand;
+
+// A recursive call found in tail position: `call` is followed by at most a
+// copy, the accumulating instruction `combine` and the block's ret.
+struct TailSite {
+    ir::BasicBlock* block;
+    size_t call;
+    int combine = -1;      // index of the add/mul, -1 for a plain tail call
+    Operand other;         // combine's operand that is not the call result
+};
+
+// Follows `reg` through the copies at `instrs[from...]` up to the ret.
+// Returns the index of the ret if the value returned is `reg`, or -1.
+int returnsValue(const std::vector<Instr>& instrs, size_t from, int reg) {
+    for (size_t i = from; i < instrs.size(); ++i) {
+        const Instr& instr = instrs[i];
+        if (instr.op == Opcode::Ret) {
+            bool returned = instr.args.empty()
+                ? reg < 0
+                : instr.args[0].isReg() && instr.args[0].reg == reg;
+            return returned ? static_cast<int>(i) : -1;
+        }
+        if (instr.op != Opcode::Copy || reg < 0 || !instr.args[0].isReg() ||
+            instr.args[0].reg != reg) {
+            return -1;
+        }
+        reg = instr.dst;
+    }
+    return -1;
+}
+
+bool findTailSite(const ir::Function& fn, ir::BasicBlock* block, TailSite& site) {
+    const auto& instrs = block->instrs;
+    if (instrs.empty() || instrs.back().op != Opcode::Ret) {
+        return false;
+    }
+    // The last self call of the block is the only candidate.
+    size_t call = instrs.size();
+    for (size_t i = instrs.size(); i-- > 0;) {
+        if (instrs[i].op == Opcode::Call) {
+            call = i;
+            break;
+        }
+    }
+    if (call == instrs.size() || instrs[call].symbol != fn.label ||
+        instrs[call].args.size() != fn.params.size()) {
+        return false;
+    }
+    int result = instrs[call].dst;
+    site.block = block;
+    site.call = call;
+    if (returnsValue(instrs, call + 1, result) >= 0) {
+        return true;
+    }
+
+    // `result op other`, possibly through copies on either side.
+    if (result < 0 || fn.retType != ir::Type::Int) {
+        return false;
+    }
+    size_t i = call + 1;
+    while (i < instrs.size() && instrs[i].op == Opcode::Copy &&
+           instrs[i].args[0].isReg() && instrs[i].args[0].reg == result) {
+        result = instrs[i].dst;
+        ++i;
+    }
+    if (i >= instrs.size()) {
+        return false;
+    }
+    const Instr& combine = instrs[i];
+    if ((combine.op != Opcode::Add && combine.op != Opcode::Mul) ||
+        combine.type != ir::Type::Int) {
+        return false;
+    }
+    const Operand& a = combine.args[0];
+    const Operand& b = combine.args[1];
+    bool aIsResult = a.isReg() && a.reg == result;
+    bool bIsResult = b.isReg() && b.reg == result;
+    if (aIsResult == bIsResult || returnsValue(instrs, i + 1, combine.dst) < 0) {
+        return false;
+    }
+    site.combine = static_cast<int>(i);
+    site.other = aIsResult ? b : a;
+    return true;
+}
+
+std::vector<TailSite> findTailSites(const ir::Function& fn) {
+    std::vector<TailSite> sites;
+    for (auto& block : fn.blocks) {
+        TailSite site;
+        if (findTailSite(fn, block.get(), site)) {
+            sites.push_back(site);
+        }
+    }
+    // All accumulating sites must agree on the operator.
+    Opcode accOp = Opcode::Copy;
+    for (auto it = sites.begin(); it != sites.end();) {
+        if (it->combine >= 0) {
+            Opcode op = it->block->instrs[it->combine].op;
+            if (accOp != Opcode::Copy && op != accOp) {
+                it = sites.erase(it);
+                continue;
+            }
+            accOp = op;
+        }
+        ++it;
+    }
+    return sites;
+}
+
+class TailRecursionPass : public IRFunctionPass {
+ public:
+    const char* name() const override { return "tailrec"; }
+
+    bool runOnFunction(ir::Function& fn, AnalysisManager& am) override {
+        std::vector<TailSite> sites = findTailSites(fn);
+        if (sites.empty()) {
+            return false;
+        }
+        if (fn.ssa) {
+            // Copies of the parameters need to be re-assignable.
+            ir::destroySSA(fn);
+            am.invalidate(&fn, PreservedAnalyses::none());
+            sites = findTailSites(fn);
+        }
+        Opcode accOp = Opcode::Copy;
+        for (const TailSite& site : sites) {
+            if (site.combine >= 0) {
+                accOp = site.block->instrs[site.combine].op;
+            }
+        }
+
+        int acc = -1;
+        if (accOp != Opcode::Copy) {
+            acc = fn.newVReg(ir::Type::Int, "tailrec.acc");
+            // Returns that are not accumulating sites combine their value
+            // with the accumulator.
+            for (auto& block : fn.blocks) {
+                bool isSite = false;
+                for (const TailSite& site : sites) {
+                    isSite = isSite || site.block == block.get();
+                }
+                Instr& ret = block->instrs.back();
+                if (isSite || ret.op != Opcode::Ret) {
+                    continue;
+                }
+                int value = fn.newVReg(ir::Type::Int);
+                Instr combine(accOp, ir::Type::Int, value,
+                              {Operand::ofReg(acc, ir::Type::Int), ret.args[0]});
+                ret.args[0] = Operand::ofReg(value, ir::Type::Int);
+                block->instrs.insert(block->instrs.end() - 1, std::move(combine));
+            }
+        }
+
+        // The old entry becomes the loop header; ids shift by one below.
+        auto entry = std::make_unique<ir::BasicBlock>();
+        entry->id = static_cast<int>(fn.blocks.size());
+        entry->hint = "tailrec.entry";
+        if (acc >= 0) {
+            entry->instrs.emplace_back(Opcode::Copy, ir::Type::Int, acc,
+                                       std::vector<Operand>{
+                                           Operand::ofInt(accOp == Opcode::Mul ? 1 : 0)});
+        }
+        entry->instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+        entry->instrs.back().targets = {fn.blocks[0]->id};
+
+        for (const TailSite& site : sites) {
+            auto& instrs = site.block->instrs;
+            Instr call = std::move(instrs[site.call]);
+            instrs.erase(instrs.begin() + site.call, instrs.end());
+            if (site.combine >= 0 && acc >= 0) {
+                instrs.emplace_back(accOp, ir::Type::Int, acc,
+                                    std::vector<Operand>{
+                                        Operand::ofReg(acc, ir::Type::Int), site.other});
+            }
+            std::vector<int> temps;
+            for (size_t i = 0; i < call.args.size(); ++i) {
+                int p = fn.params[i];
+                int t = fn.newVReg(fn.regType(p));
+                instrs.emplace_back(Opcode::Copy, fn.regType(p), t,
+                                    std::vector<Operand>{call.args[i]});
+                temps.push_back(t);
+            }
+            for (size_t i = 0; i < temps.size(); ++i) {
+                int p = fn.params[i];
+                instrs.emplace_back(Opcode::Copy, fn.regType(p), p,
+                                    std::vector<Operand>{
+                                        Operand::ofReg(temps[i], fn.regType(p))});
+            }
+            instrs.emplace_back(Opcode::Br, ir::Type::Void, -1);
+            instrs.back().targets = {fn.blocks[0]->id};
+        }
+
+        fn.blocks.insert(fn.blocks.begin(), std::move(entry));
+        fn.renumberBlocks();
+        return true;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createTailRecursionPass() {
+    return std::make_unique<TailRecursionPass>();
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+
+#include "value_range.hpp"
+
+namespace ir {
+
+namespace {
+
+// Phis may grow this many times before their range is widened.
+const int kWidenAfter = 3;
+
+Range hull(const Range& a, const Range& b) {
+    if (a.isEmpty()) {
+        return b;
+    }
+    if (b.isEmpty()) {
+        return a;
+    }
+    return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+Range intersect(const Range& a, const Range& b) {
+    return {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+// Results outside the int range wrap around to anything.
+Range wrapped(int64_t lo, int64_t hi) {
+    if (lo < INT32_MIN || hi > INT32_MAX) {
+        return Range::full();
+    }
+    return {lo, hi};
+}
+
+// Narrows x, knowing that `x op y` holds for some y in `y`.
+Range constrain(Range x, Opcode op, const Range& y) {
+    if (y.isEmpty()) {
+        return x;
+    }
+    switch (op) {
+        case Opcode::CmpLt: x.hi = std::min(x.hi, y.hi - 1); break;
+        case Opcode::CmpLe: x.hi = std::min(x.hi, y.hi); break;
+        case Opcode::CmpGt: x.lo = std::max(x.lo, y.lo + 1); break;
+        case Opcode::CmpGe: x.lo = std::max(x.lo, y.lo); break;
+        case Opcode::CmpEq: x = intersect(x, y); break;
+        case Opcode::CmpNe:
+            if (y.lo == y.hi && x.lo == y.lo) {
+                ++x.lo;
+            } else if (y.lo == y.hi && x.hi == y.lo) {
+                --x.hi;
+            }
+            break;
+        default:
+            break;
+    }
+    return x;
+}
+
+}  // anonymous namespace
+
+ValueRanges::ValueRanges(Function& function, AnalysisManager& am) : fn(function) {
+    int n = static_cast<int>(fn.blocks.size());
+    ranges.assign(fn.vregs.size(), Range::full());
+    for (size_t r = 0; r < fn.vregs.size(); ++r) {
+        if (fn.vregs[r].type == Type::Bool) {
+            ranges[r] = {0, 1};
+        }
+    }
+    blockFacts.assign(n, -1);
+    edgeFacts.assign(n, {});
+    if (!fn.ssa) {
+        return;
+    }
+    CFG& cfg = am.get<CFG>(function);
+    DominatorTree& dt = am.get<DominatorTree>(function);
+
+    std::vector<const Instr*> def(fn.vregs.size(), nullptr);
+    for (const auto& block : fn.blocks) {
+        for (const Instr& instr : block->instrs) {
+            if (instr.dst >= 0) {
+                def[instr.dst] = &instr;
+                ranges[instr.dst] = Range::empty();
+            }
+        }
+    }
+
+    // Facts known on entry to a block: those of its immediate dominator,
+    // plus the branch condition when it is only entered through one arm.
+    for (int b : cfg.rpo) {
+        int parent = -1;
+        if (cfg.preds[b].size() == 1) {
+            parent = edgeFact(cfg.preds[b][0], b);
+        } else if (dt.immediate(b) >= 0) {
+            parent = blockFacts[dt.immediate(b)];
+        }
+        blockFacts[b] = parent;
+
+        const Instr& br = fn.blocks[b]->terminator();
+        if (br.op != Opcode::CondBr || br.targets[0] == br.targets[1] ||
+            !br.args[0].isReg() || !def[br.args[0].reg]) {
+            continue;
+        }
+        const Instr& cond = *def[br.args[0].reg];
+        Opcode op;
+        Operand lhs;
+        Operand rhs;
+        if (isCompare(cond.op) && cond.args[0].type != Type::Float) {
+            op = cond.op;
+            lhs = cond.args[0];
+            rhs = cond.args[1];
+        } else if (cond.op == Opcode::IntToBool) {
+            op = Opcode::CmpNe;
+            lhs = cond.args[0];
+            rhs = Operand::ofInt(0);
+        } else {
+            continue;
+        }
+        edgeFacts[b].push_back(static_cast<int>(facts.size()));
+        facts.push_back({op, lhs, rhs, parent});
+        edgeFacts[b].push_back(static_cast<int>(facts.size()));
+        facts.push_back({invertCompare(op), lhs, rhs, parent});
+    }
+
+    std::vector<int> growth(fn.vregs.size(), 0);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int b : cfg.rpo) {
+            for (const Instr& instr : fn.blocks[b]->instrs) {
+                if (instr.dst < 0) {
+                    continue;
+                }
+                Range& current = ranges[instr.dst];
+                Range next = hull(current, evaluate(instr, b));
+                if (next == current) {
+                    continue;
+                }
+                if (instr.op == Opcode::Phi && ++growth[instr.dst] > kWidenAfter &&
+                    !current.isEmpty()) {
+                    if (next.lo < current.lo) {
+                        next.lo = INT32_MIN;
+                    }
+                    if (next.hi > current.hi) {
+                        next.hi = INT32_MAX;
+                    }
+                }
+                current = next;
+                changed = true;
+            }
+        }
+    }
+
+    // Widening overshoots loop counters bounded by their exit test; going
+    // over the function again with the final ranges pulls them back in.
+    for (int sweep = 0; sweep < 2; ++sweep) {
+        for (int b : cfg.rpo) {
+            for (const Instr& instr : fn.blocks[b]->instrs) {
+                if (instr.dst >= 0) {
+                    ranges[instr.dst] = intersect(ranges[instr.dst], evaluate(instr, b));
+                }
+            }
+        }
+    }
+}
+
+int ValueRanges::edgeFact(int from, int to) const {
+    const Instr& br = fn.blocks[from]->terminator();
+    if (edgeFacts[from].empty()) {
+        return blockFacts[from];
+    }
+    return edgeFacts[from][br.targets[0] == to ? 0 : 1];
+}
+
+Range ValueRanges::rangeOf(const Operand& op) const {
+    if (op.isImm()) {
+        return op.type == Type::Float ? Range::full() : Range::constant(op.intValue);
+    }
+    if (!op.isReg() || op.type == Type::Float) {
+        return Range::full();
+    }
+    return ranges[op.reg];
+}
+
+Range ValueRanges::rangeAt(const Operand& op, int block) const {
+    return refine(op, blockFacts[block]);
+}
+
+bool ValueRanges::isNonZeroAt(const Operand& op, int block) const {
+    if (!rangeAt(op, block).contains(0)) {
+        return true;
+    }
+    // An interval cannot leave a hole at zero, so `x != 0` is looked up
+    // as a fact of its own.
+    for (int f = blockFacts[block]; f >= 0 && op.isReg(); f = facts[f].parent) {
+        const Fact& known = facts[f];
+        if (known.op != Opcode::CmpNe) {
+            continue;
+        }
+        const Operand& other = known.a.isReg() && known.a.reg == op.reg ? known.b : known.a;
+        bool mentions = (known.a.isReg() && known.a.reg == op.reg) ||
+                        (known.b.isReg() && known.b.reg == op.reg);
+        if (mentions && rangeOf(other) == Range::constant(0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Range ValueRanges::refine(const Operand& op, int fact) const {
+    Range r = rangeOf(op);
+    if (!op.isReg()) {
+        return r;
+    }
+    for (int f = fact; f >= 0; f = facts[f].parent) {
+        const Fact& known = facts[f];
+        if (known.a.isReg() && known.a.reg == op.reg) {
+            r = constrain(r, known.op, rangeOf(known.b));
+        }
+        if (known.b.isReg() && known.b.reg == op.reg) {
+            r = constrain(r, swapCompare(known.op), rangeOf(known.a));
+        }
+    }
+    return r;
+}
+
+Range ValueRanges::evaluate(const Instr& instr, int block) const {
+    if (instr.type == Type::Float) {
+        return Range::full();
+    }
+    if (instr.op == Opcode::Phi) {
+        Range r = Range::empty();
+        for (size_t i = 0; i < instr.args.size(); ++i) {
+            r = hull(r, refine(instr.args[i], edgeFact(instr.targets[i], block)));
+        }
+        return r;
+    }
+
+    std::vector<Range> in;
+    for (const Operand& a : instr.args) {
+        in.push_back(refine(a, blockFacts[block]));
+        if (in.back().isEmpty()) {
+            return Range::empty();
+        }
+    }
+    switch (instr.op) {
+        case Opcode::Copy:
+            return in[0];
+        case Opcode::Neg:
+            return wrapped(-in[0].hi, -in[0].lo);
+        case Opcode::Add:
+            return wrapped(in[0].lo + in[1].lo, in[0].hi + in[1].hi);
+        case Opcode::Sub:
+            return wrapped(in[0].lo - in[1].hi, in[0].hi - in[1].lo);
+        case Opcode::Mul:
+        case Opcode::Div: {
+            const Range& a = in[0];
+            const Range& b = in[1];
+            if (instr.op == Opcode::Div && b.contains(0)) {
+                // |a / b| <= |a| for any non-zero b.
+                int64_t m = std::max(-a.lo, a.hi);
+                return wrapped(-m, m);
+            }
+            int64_t corners[4];
+            if (instr.op == Opcode::Mul) {
+                corners[0] = a.lo * b.lo;
+                corners[1] = a.lo * b.hi;
+                corners[2] = a.hi * b.lo;
+                corners[3] = a.hi * b.hi;
+            } else {
+                corners[0] = a.lo / b.lo;
+                corners[1] = a.lo / b.hi;
+                corners[2] = a.hi / b.lo;
+                corners[3] = a.hi / b.hi;
+            }
+            return wrapped(*std::min_element(corners, corners + 4),
+                           *std::max_element(corners, corners + 4));
+        }
+        case Opcode::CmpEq:
+        case Opcode::CmpNe:
+        case Opcode::CmpLt:
+        case Opcode::CmpGt:
+        case Opcode::CmpLe:
+        case Opcode::CmpGe:
+        case Opcode::IntToBool:
+            return {0, 1};
+        default:
+            return instr.type == Type::Bool ? Range{0, 1} : Range::full();
+    }
+}
+
+}  // namespace ir
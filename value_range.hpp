@@ -0,0 +1,80 @@
+#ifndef VALUE_RANGE_HPP
+#define VALUE_RANGE_HPP
+
+#include <cstdint>
+#include <vector>
+#include "ir.hpp"
+#include "ir_analysis.hpp"
+#include "pass_manager.hpp"
+
+// ===============================
+// Integer value ranges
+// ===============================
+// Interval analysis over the int and bool registers of a function in SSA
+// form. Each register gets the range of values it can hold; uses can be
+// narrowed further by the branch conditions that hold on every path to
+// them, so inside
+//     if (d != 0) { ... }      while (i < n) { ... }
+// `d` excludes zero and `i` stays below the largest value `n` can take.
+// Loops are solved by widening the phis whose range keeps growing to the
+// int limits, followed by two narrowing sweeps. Arithmetic that may wrap
+// around gives the full range. Functions not in SSA form get full ranges
+// for every register.
+
+namespace ir {
+
+// A closed interval of int values; lo > hi is the empty range.
+struct Range {
+    int64_t lo = INT32_MIN;
+    int64_t hi = INT32_MAX;
+
+    static Range full() { return {INT32_MIN, INT32_MAX}; }
+    static Range empty() { return {1, 0}; }
+    static Range constant(int64_t v) { return {v, v}; }
+
+    bool isEmpty() const { return lo > hi; }
+    bool contains(int64_t v) const { return lo <= v && v <= hi; }
+    bool operator==(const Range& other) const {
+        return (isEmpty() && other.isEmpty()) || (lo == other.lo && hi == other.hi);
+    }
+    bool operator!=(const Range& other) const { return !(*this == other); }
+};
+
+class ValueRanges : public AnalysisResult {
+ public:
+    static constexpr const char* name = "ranges";
+
+    ValueRanges(Function& fn, AnalysisManager& am);
+
+    // Range of `op` wherever its definition is available.
+    Range rangeOf(const Operand& op) const;
+    // Range of `op` on entry to `block`, narrowed by dominating branches.
+    Range rangeAt(const Operand& op, int block) const;
+    // True if `op` cannot be zero on entry to `block`, either by its range
+    // or by a dominating `op != 0` test.
+    bool isNonZeroAt(const Operand& op, int block) const;
+
+ private:
+    // A branch condition known to hold, `a op b`, linked to the facts
+    // that were already known before the branch.
+    struct Fact {
+        Opcode op;
+        Operand a;
+        Operand b;
+        int parent;
+    };
+
+    const Function& fn;
+    std::vector<Range> ranges;
+    std::vector<Fact> facts;
+    std::vector<int> blockFacts;                 // innermost fact per block, -1 if none
+    std::vector<std::vector<int>> edgeFacts;     // per block, per successor index
+
+    Range refine(const Operand& op, int fact) const;
+    Range evaluate(const Instr& instr, int block) const;
+    int edgeFact(int from, int to) const;
+};
+
+}  // namespace ir
+
+#endif /* VALUE_RANGE_HPP */
@@ -0,0 +1,140 @@
+#include <string>
+
+#include "passes.hpp"
+#include "astnode.hpp"
+#include "visitor.hpp"
+#include "exception.hpp"
+
+// ===============================
+// AST verifier
+// ===============================
+// Checks the invariants later stages rely on: every expression is typed
+// and every node has the children its kind requires. Useful between
+// transformations in a --passes= pipeline.
+
+namespace {
+
+class VerifierVisitor : public Visitor {
+ private:
+    std::string funcName;
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw OptimizationException("verify: " + what + " in function '" +
+                                    funcName + "'");
+    }
+
+    void checkExpr(ExpNode* e, const char* where) {
+        if (!e) {
+            fail(std::string("missing expression in ") + where);
+        }
+        e->accept(*this);
+        if (e->dataType == DataType::IOTA) {
+            fail(std::string("untyped expression in ") + where);
+        }
+    }
+
+    void checkBlock(BlockNode* b, const char* where) {
+        if (!b) {
+            fail(std::string("missing block in ") + where);
+        }
+        b->accept(*this);
+    }
+
+ public:
+    explicit VerifierVisitor(const std::string& name) : funcName(name) {}
+
+    void visit(ProgramNode*) override {}
+
+    void visit(VarDeclNode* node) override {
+        checkExpr(node->init, "var initializer");
+    }
+
+    void visit(LetDeclNode* node) override {
+        checkExpr(node->init, "let initializer");
+    }
+
+    void visit(FuncDeclNode* node) override {
+        // Nested functions are verified as units of their own.
+        if (!node->body || !node->retType) {
+            fail("incomplete nested function '" + node->name + "'");
+        }
+    }
+
+    void visit(BlockNode* node) override {
+        for (ASTNode* item : node->orderedItems) {
+            if (!item) {
+                fail("null block item");
+            }
+            item->accept(*this);
+        }
+    }
+
+    void visit(AssignStmtNode* node) override {
+        checkExpr(node->rhs, "assignment");
+    }
+
+    void visit(PrintStmtNode* node) override {
+        checkExpr(node->expr, "print");
+    }
+
+    void visit(ReturnStmtNode* node) override {
+        checkExpr(node->expr, "return");
+    }
+
+    void visit(IfStmtNode* node) override {
+        checkExpr(node->cond, "if condition");
+        checkBlock(node->thenBlk, "if");
+        if (node->elseBlk) {
+            checkBlock(node->elseBlk, "else");
+        }
+    }
+
+    void visit(WhileStmtNode* node) override {
+        checkExpr(node->cond, "while condition");
+        checkBlock(node->body, "while");
+    }
+
+    void visit(IntLitNode*) override {}
+    void visit(FloatLitNode*) override {}
+    void visit(BoolLitNode*) override {}
+    void visit(IdNode*) override {}
+
+    void visit(UnaryOpNode* node) override {
+        checkExpr(node->expr, "unary operand");
+    }
+
+    void visit(BinaryOpNode* node) override {
+        checkExpr(node->left, "binary operand");
+        checkExpr(node->right, "binary operand");
+    }
+
+    void visit(CallNode* node) override {
+        for (ExpNode* arg : node->args) {
+            checkExpr(arg, "call argument");
+        }
+    }
+
+    void visit(TypeNode*) override {}
+    void visit(ParamNode*) override {}
+};
+
+class VerifierPass : public FunctionPass {
+ public:
+    const char* name() const override { return "verify"; }
+
+    bool runOnFunction(FuncDeclNode* func, AnalysisManager&) override {
+        if (!func->body || !func->retType) {
+            throw OptimizationException("verify: incomplete function '" +
+                                        func->name + "'");
+        }
+        VerifierVisitor verifier(func->name);
+        func->body->accept(verifier);
+        return false;
+    }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<Pass> createVerifierPass() {
+    return std::make_unique<VerifierPass>();
+}